@@ -35,6 +35,13 @@ struct Vector3 {
 float dot(Vector3 v1, Vector3 v2);
 Vector3 cross(Vector3 v1, Vector3 v2);
 
+struct Quaternion {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
 struct Matrix4 {
 private:
     float v[16];
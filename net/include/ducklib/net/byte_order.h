@@ -0,0 +1,21 @@
+#ifndef DUCKLIB_BYTE_ORDER_H
+#define DUCKLIB_BYTE_ORDER_H
+#include <bit>
+
+namespace ducklib::net {
+template <typename T>
+auto host_to_net(T value) -> T {
+    if constexpr (std::endian::native == std::endian::little) {
+        return std::byteswap(value);
+    } else {
+        return value;
+    }
+}
+
+template <typename T>
+auto net_to_host(T value) -> T {
+    return host_to_net(value);
+}
+}
+
+#endif //DUCKLIB_BYTE_ORDER_H
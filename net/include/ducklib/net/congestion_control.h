@@ -0,0 +1,96 @@
+#ifndef DUCKLIB_CONGESTION_CONTROL_H
+#define DUCKLIB_CONGESTION_CONTROL_H
+#include <chrono>
+#include <cstdint>
+
+namespace ducklib::net {
+/*
+ * A Connection sends no faster than its CongestionController allows, and a TokenBucket spreads the packets out at that
+ * rate instead of letting them leave in bursts that fill the queues along the path.
+ *
+ * The controller is delay based: RTT growing past the lowest RTT seen means packets are waiting in a queue somewhere,
+ * so the rate is cut before that queue overflows rather than after. Loss cuts it as well. Once per round trip without
+ * either the rate is raised a little to find out whether the path can take more. A hard budget caps it either way.
+ */
+
+/// Lets through rate bytes per second on average and up to burst bytes at once
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// A rate of 0 lets everything through
+    void set_rate(uint32_t new_rate, Clock::time_point now);
+    [[nodiscard]]
+    auto rate() const -> uint32_t { return bytes_per_second; }
+
+    /**
+     * @brief Whether a packet may leave now. Sizes are not known before the packet is written, so one is let through
+     * as long as the bucket is not in debt and its size taken afterwards with consume.
+     */
+    [[nodiscard]]
+    bool can_send(Clock::time_point now) const { return bytes_per_second == 0 || now >= next_send_time(); }
+    /// When the bucket is out of debt
+    [[nodiscard]]
+    auto next_send_time() const -> Clock::time_point;
+    void consume(uint32_t bytes, Clock::time_point now);
+
+private:
+    void refill(Clock::time_point now);
+
+    uint32_t bytes_per_second = 0;
+    double tokens = 0.0; // Bytes, negative while in debt
+    double burst = 0.0;
+    Clock::time_point updated_at = {};
+};
+
+class CongestionController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t MIN_RATE = 8 * 1024; ///< Bytes per second, never backed off below
+    static constexpr uint32_t INITIAL_RATE = 128 * 1024;
+    static constexpr uint32_t MAX_RATE = 4 * 1024 * 1024; ///< Ceiling without a budget
+    /// Queueing delay tolerated on top of the lowest RTT seen, or half of that RTT if more
+    static constexpr std::chrono::microseconds DELAY_TARGET = std::chrono::milliseconds(25);
+    /// How long the lowest RTT is remembered, so a changed route can raise it
+    static constexpr std::chrono::seconds BASE_RTT_WINDOW{ 10 };
+    /// Shortest time between two rate changes, a round trip if that is longer
+    static constexpr std::chrono::microseconds MIN_ROUND = std::chrono::milliseconds(20);
+
+    void on_packet_sent(uint32_t bytes);
+    void on_rtt_sample(std::chrono::microseconds rtt, Clock::time_point now);
+    void on_packet_lost(Clock::time_point now);
+
+    /// Bytes per second, 0 when neither congestion control nor a budget limit the connection
+    [[nodiscard]]
+    auto rate() const -> uint32_t;
+    /// Hard limit in bytes per second whatever the path can take, 0 for none
+    void set_budget(uint32_t bytes_per_second);
+    /// Disabled, only the budget limits the rate
+    void set_enabled(bool enabled) { this->enabled = enabled; }
+
+private:
+    [[nodiscard]]
+    auto ceiling() const -> uint32_t { return budget == 0 ? MAX_RATE : budget; }
+    [[nodiscard]]
+    auto base_rtt() const -> std::chrono::microseconds;
+    void adjust(Clock::time_point now);
+
+    uint32_t current_rate = INITIAL_RATE;
+    uint32_t budget = 0;
+    bool enabled = true;
+
+    // Lowest RTT of this window and the last, so the minimum expires after one to two windows
+    std::chrono::microseconds window_min_rtt = std::chrono::microseconds::max();
+    std::chrono::microseconds previous_min_rtt = std::chrono::microseconds::max();
+    Clock::time_point window_start = {};
+    std::chrono::microseconds queueing_delay{ 0 }; // Smoothed over samples
+    bool sampled = false;
+
+    Clock::time_point round_start = {};
+    uint64_t round_bytes = 0;
+    bool round_lost = false;
+};
+}
+
+#endif //DUCKLIB_CONGESTION_CONTROL_H
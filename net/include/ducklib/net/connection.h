@@ -1,12 +1,25 @@
 #ifndef DUCKLIB_CONNECTION_H
 #define DUCKLIB_CONNECTION_H
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <map>
-#include <queue>
+#include <memory>
 #include <span>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#include "congestion_control.h"
+#include "connection_stats.h"
+#include "fragment.h"
+#include "message_pool.h"
+#include "packet.h"
+#include "priority_scheduler.h"
+#include "schema.h"
+#include "sequence_buffer.h"
 #include "serialization.h"
 #include "socket.h"
 
@@ -16,67 +29,401 @@ using MessageIdType = uint32_t;
 using AckTrailType = uint32_t;
 constexpr auto NUM_ACK_BITS = sizeof(AckTrailType) * 8;
 constexpr auto MAX_TRACKED_MESSAGES = 256;
+constexpr auto MAX_TRACKED_PACKETS = 256; ///< Sent and received packets remembered for acks, a power of two
+constexpr auto MAX_MESSAGES_PER_PACKET = 32;
+constexpr auto MAX_MESSAGE_WAIT = 128; ///< Packets sent before a queued message goes ahead of all newer ones
 constexpr auto DEFAULT_CHANNEL = 0;
+constexpr auto NUM_BASELINES = 32;
+constexpr auto MAX_BASELINE_SIZE = MTU;
+
+/// A message as handed to the message callback, data is only valid during the call
+struct ReceivedMessage {
+    PacketIdType packet_id; ///< Packet it arrived in, the one with the last slice for sliced messages
+    uint8_t type;
+    std::span<const std::byte> data;
+    uint32_t bit_size;
+};
 
 class Connection {
 public:
-    Connection(std::string_view ip, uint16_t port, const std::shared_ptr<Socket>& socket);
-    Connection(std::string_view ip, uint16_t port);
+    using Clock = std::chrono::steady_clock;
+    using MessageCallback = std::function<void(const ReceivedMessage& message)>;
+
+    /// Queued messages gain their priority's weight for every packet they wait, see priority_scheduler.h
+    static constexpr uint8_t LOW_PRIORITY = 0;
+    static constexpr uint8_t MEDIUM_PRIORITY = 1;
+    static constexpr uint8_t HIGH_PRIORITY = 2;
+
+    /**
+     * @param protocol_id Salts the packet CRC, both ends must use the same one (see packet.h)
+     */
+    Connection(
+        std::string_view ip,
+        uint16_t port,
+        const std::shared_ptr<Transport>& transport,
+        uint32_t protocol_id = DEFAULT_PROTOCOL_ID);
+    Connection(std::string_view ip, uint16_t port, uint32_t protocol_id = DEFAULT_PROTOCOL_ID);
+    Connection(
+        const Address& remote_address,
+        const std::shared_ptr<Transport>& transport,
+        uint32_t protocol_id = DEFAULT_PROTOCOL_ID);
     
-    template <typename T>
+    /**
+     * @brief Serializes a message with a Schema (see schema.h) directly into its queued payload.
+     */
+    template <HasSchema T>
     MessageIdType send_reliable(T& message, uint8_t type, bool ordered = false, uint8_t priority = MEDIUM_PRIORITY);
+    /**
+     * @brief Queues a copy of the message.
+     * @details Messages too large for one packet are sent in slices of SLICE_SIZE bytes (see fragment.h), up to
+     * MAX_FRAGMENTED_MESSAGE_SIZE. Those are sent one at a time in the order they were queued, a slice in every packet
+     * alongside the other messages, and ordered and priority do not apply to them.
+     */
     MessageIdType send_reliable(
         const std::byte* message_data,
-        uint16_t message_bit_size,
+        uint32_t message_bit_size,
         uint8_t type,
         bool ordered = false,
         uint8_t priority = MEDIUM_PRIORITY);
 
-    void send_message_packet();
+    /**
+     * @brief Queues state written relative to the newest baseline of the same type the remote has acknowledged.
+     * @details T must be trivially copyable and have a serialize_delta(stream, T& state, const T& baseline) found by
+     * ADL. Without an acknowledged baseline the state is written against a value-initialized T. Newest is the one
+     * queued last, which need not be the one sent last as priorities reorder messages:
+     *
+     *   [message id : 32][has baseline : 1][baseline packet id : 32][baseline message id : 32][delta]
+     *
+     * The baseline is named by its message id as well as the packet it went out in, several deltas of one type can
+     * share a packet.
+     */
+    template <typename T>
+    MessageIdType send_delta(T& state, uint8_t type, uint8_t priority = MEDIUM_PRIORITY);
+    /**
+     * @brief Reads state written by send_delta and keeps it as a baseline for the packet it was received in.
+     * @return false if the referenced baseline is no longer (or never was) available
+     */
+    template <typename T>
+    bool receive_delta(NetReadStream& stream, T& state, PacketIdType packet_id, uint8_t type);
+
+    /**
+     * @brief Marks baselines sent in the packet as acknowledged so later delta messages are written against them.
+     * @details Done for every packet the remote acks, see receive_packet.
+     */
+    void acknowledge_packet(PacketIdType packet_id);
+    /// false if the packet has not been acked yet or was sent too long ago to tell
+    [[nodiscard]]
+    bool is_packet_acked(PacketIdType packet_id) const;
+
+    /**
+     * @brief Sends a packet with the queued messages of the highest accumulated priority that fit, acking the packets
+     * received from the remote.
+     * @details After the CRC every packet starts with a header:
+     *
+     *   [sequence : 32][has_ack : 1][ack : 32][ack delay : 16][ack trail : 32]
+     *
+     * ack is the newest sequence received and bit n of the trail stands for ack - 1 - n, all three left out until
+     * something has been received. ack delay is how long ack had been received before this packet was sent, in
+     * ACK_DELAY_UNIT, so the remote can take it off its round trip samples.
+     *
+     * A slice of the message being sliced follows if one is due, then the messages:
+     *
+     *   slice   [3 : 2][type : 8][fragment id : 16][slice index : 8][message bit size : 21][padding][data]
+     *   message [delivery mode : 2][type : 8][id : 32, only if ordered][bit size : 14][data]
+     * @return Sequence of the packet
+     */
+    PacketIdType send_message_packet(Clock::time_point now = Clock::now());
+    /**
+     * @brief Sends a message packet if messages are queued or received packets need acking, the send interval has
+     * passed since the last one and the send rate allows another packet.
+     * @details Messages wait in their queue while the rate does not allow a packet. send_message_packet is not held
+     * back, but what it sends counts against the rate.
+     * @return true if a packet was sent
+     */
+    bool update(Clock::time_point now);
+    /// Least time between two packets sent by update, zero sends whenever messages are queued
+    void set_send_interval(Clock::duration interval) { send_interval = interval; }
+    /// Most bytes per second update sends whatever congestion control allows, 0 for no limit
+    void set_bandwidth_budget(uint32_t bytes_per_second);
+    /**
+     * @brief Whether the send rate follows what the path can take (see congestion_control.h), on by default.
+     * @details Without it only the bandwidth budget limits the rate.
+     */
+    void set_congestion_control(bool enabled);
+    /**
+     * @brief When update sends next, only meaningful while has_pending_sends is true.
+     * @details With nothing to send but slices waiting for their acks that is when the first of them is due for a
+     * resend.
+     */
+    [[nodiscard]]
+    auto next_send_time() const -> Clock::time_point;
+    [[nodiscard]]
+    bool has_pending_sends() const {
+        return !message_send_queue.empty() || ack_pending || fragment_sender.is_sending();
+    }
+
+    /// Called from receive_packet for every message received, sliced ones once all their slices have arrived
+    void set_message_callback(MessageCallback callback) { on_message = std::move(callback); }
+
+    /**
+     * @brief Takes message payloads from pool from now on, e.g. one pool shared by every connection on a thread.
+     * @details Only while nothing is queued, the payloads of queued messages belong to the previous pool.
+     */
+    void set_message_pool(const std::shared_ptr<MessagePool>& pool);
+
+    /// Latest measurements, updated as packets are sent and received. Safe to call from any thread.
+    [[nodiscard]]
+    auto get_stats() const -> ConnectionStats { return published_stats.read(); }
+    [[nodiscard]]
+    auto get_message_pool() const -> const std::shared_ptr<MessagePool>& { return message_pool; }
+
+    [[nodiscard]]
+    auto get_remote_address() const -> const Address& { return remote_address; }
+    [[nodiscard]]
+    auto get_transport() const -> const std::shared_ptr<Transport>& { return transport; }
+
+    /**
+     * @brief Handles a packet received from the remote, marking the sent packets it acks as acked.
+     * @param received_at When the packet arrived, RTT samples are only as good as this (see Socket::enable_timestamps)
+     * @return false if the packet was dropped, packets failing the CRC check are dropped before anything is read and
+     * duplicates or packets older than MAX_TRACKED_PACKETS after the header
+     */
+    bool receive_packet(std::span<const std::byte> packet, Clock::time_point received_at = Clock::now());
 
 private:
     static constexpr uint8_t UNRELIABLE = 0;
     static constexpr uint8_t RELIABLE = 1;
     static constexpr uint8_t RELIABLE_ORDERED = 2;
-    
+    static constexpr uint8_t SLICE = 3;
+
     struct PacketMessage {
-        std::unique_ptr<std::byte[]> data;
+        MessageBuffer data;
         uint16_t data_bit_size;
         PacketIdType id;
         uint8_t type;
-        uint8_t priority = MEDIUM_PRIORITY;
         uint8_t delivery_mode;
+        uint8_t baseline_slot = NO_BASELINE_SLOT;
+    };
+
+    static constexpr uint8_t NO_BASELINE_SLOT = 0xff;
+    /// Worst case size of what Connection::serialize writes in front of the message data
+    static constexpr uint32_t MAX_MESSAGE_HEADER_BITS = std::bit_width(static_cast<uint64_t>(SLICE)) + 8
+        + sizeof(MessageIdType) * 8 + std::bit_width(static_cast<uint64_t>(MTU * 8));
+    /// Ack delays are sent in these, up to 6.5 seconds
+    static constexpr std::chrono::microseconds ACK_DELAY_UNIT{ 100 };
+    /// Size of what send_message_packet writes in front of the messages
+    static constexpr uint32_t MAX_PACKET_HEADER_BITS = 2 * sizeof(PacketIdType) * 8 + 1 + 16 + NUM_ACK_BITS;
+    /// Largest message sent whole, anything larger is sliced
+    static constexpr uint32_t MAX_MESSAGE_BITS = (MTU - PACKET_CRC_SIZE) * 8 - MAX_PACKET_HEADER_BITS
+        - MAX_MESSAGE_HEADER_BITS;
+    /// Worst case size of a slice with its header, including the padding to align its data. The message bit size is
+    /// written as 1 to MAX_FRAGMENTED_MESSAGE_SIZE * 8, so in the bits of the difference.
+    static constexpr uint32_t MAX_SLICE_BITS = std::bit_width(static_cast<uint64_t>(SLICE)) + 8
+        + sizeof(FragmentIdType) * 8 + 8 + std::bit_width(static_cast<uint64_t>(MAX_FRAGMENTED_MESSAGE_SIZE * 8 - 1))
+        + 7 + SLICE_SIZE * 8;
+    static_assert(MAX_PACKET_HEADER_BITS + MAX_SLICE_BITS <= (MTU - PACKET_CRC_SIZE) * 8);
+    static_assert(std::has_single_bit(static_cast<size_t>(MAX_TRACKED_PACKETS)) && MAX_TRACKED_PACKETS > NUM_ACK_BITS);
 
-        bool operator <(const PacketMessage& other) const {
-            return priority < other.priority;
-        }
+    struct Baseline {
+        PacketIdType packet_id = 0;
+        MessageIdType message_id = 0;
+        uint8_t type = 0;
+        bool sent = false;
+        bool acked = false;
+        std::array<std::byte, MAX_BASELINE_SIZE> state;
     };
 
-    struct PacketContents {
-        PacketIdType packet_id;
-        std::vector<MessageIdType> messages;
+    struct PacketHeader {
+        PacketIdType sequence = 0;
+        bool has_ack = false;
+        PacketIdType ack = 0;
+        uint16_t ack_delay = 0; // In ACK_DELAY_UNIT
+        AckTrailType ack_trail = 0;
     };
 
-    static void serialize(NetWriteStream& writer, PacketMessage& message);
+    struct SentMessage {
+        MessageIdType id;
+        uint8_t type;
+    };
+
+    struct SentPacket {
+        Clock::time_point sent_at;
+        uint16_t size = 0;
+        bool acked = false;
+        bool has_slice = false;
+        uint8_t slice_index = 0;
+        FragmentIdType fragment_id = 0;
+        uint8_t message_count = 0;
+        std::array<SentMessage, MAX_MESSAGES_PER_PACKET> messages;
+    };
+
+    /// Only whether a sequence arrived matters for acks
+    struct ReceivedPacket {};
+
+    template <typename StreamType>
+    static bool serialize(StreamType& stream, PacketMessage& message);
+    template <typename StreamType>
+    static bool serialize(StreamType& stream, PacketHeader& header);
+    template <typename StreamType>
+    static bool serialize(StreamType& stream, SliceHeader& header);
+    /// Reads the message at the reader and hands it to the message callback
+    bool read_message(NetReadStream& reader, PacketIdType packet_id);
+    PacketHeader make_header(PacketIdType sequence, Clock::time_point now) const;
+    void process_acks(const PacketHeader& header, Clock::time_point received_at);
+    void on_packet_acked(PacketIdType packet_id, Clock::time_point received_at);
+    /// Counts packets that fell out of the ack trail before being acked as lost
+    void detect_lost_packets(Clock::time_point now);
+    void publish_stats();
+    MessageIdType queue_message(
+        MessageBuffer message_data,
+        uint16_t message_bit_size,
+        uint8_t type,
+        uint8_t priority,
+        uint8_t delivery_mode,
+        uint8_t baseline_slot = NO_BASELINE_SLOT);
+    uint8_t find_acked_baseline(uint8_t type) const;
+    uint8_t find_received_baseline(PacketIdType packet_id, MessageIdType message_id, uint8_t type) const;
     
     Address remote_address;
-    std::shared_ptr<Socket> socket;
-
-    static constexpr auto LOW_PRIORITY = 0;
-    static constexpr auto MEDIUM_PRIORITY = 1;
-    static constexpr auto HIGH_PRIORITY = 2;
+    std::shared_ptr<Transport> transport;
+    uint32_t protocol_id;
+    // Declared ahead of the queues so the pool outlives the payloads in them
+    std::shared_ptr<MessagePool> message_pool = std::make_shared<MessagePool>();
+    MessageCallback on_message;
 
     uint32_t next_packet_id = 0;
-    std::priority_queue<PacketMessage> message_send_queue;
+    Clock::duration send_interval = {};
+    Clock::time_point last_send_time = {};
+    // A low priority message waits 16 times as long as a high priority one queued at the same time
+    PriorityScheduler<PacketMessage, HIGH_PRIORITY + 1> message_send_queue{ { 1, 4, 16 }, MAX_MESSAGE_WAIT };
     std::unordered_map<MessageIdType, PacketMessage> pending_messages;
     std::map<uint8_t, MessageIdType> channel_message_counter;
+    FragmentSender fragment_sender;
+    FragmentReceiver fragment_receiver;
+    bool slice_deferred = false; // The last packet left out a due slice to make room for a large message
 
-    std::unordered_map<PacketIdType, PacketContents> packet_message_map;
+    SequenceBuffer<SentPacket, MAX_TRACKED_PACKETS, PacketIdType> sent_packets;
+    SequenceBuffer<ReceivedPacket, MAX_TRACKED_PACKETS, PacketIdType> received_packets;
+    Clock::time_point newest_received_at = {}; // When the newest sequence in received_packets arrived
+    bool ack_pending = false; // Received packets with messages that have not been acked yet
+    PacketIdType newest_ack = 0;
+    PacketIdType next_undecided = 0; // Oldest sent packet not known to be acked or lost
+    bool has_newest_ack = false;
+
+    RttEstimator rtt;
+    CongestionController congestion;
+    TokenBucket pacer;
+    LossWindow loss;
+    BandwidthMeter sent_bandwidth;
+    BandwidthMeter received_bandwidth;
+    BandwidthMeter acked_bandwidth;
+    ConnectionStats totals; // Only the packet counters are kept up to date, the rest is filled in when publishing
+    Snapshot<ConnectionStats> published_stats;
+
+    std::array<Baseline, NUM_BASELINES> sent_baselines = {};
+    std::array<Baseline, NUM_BASELINES> received_baselines = {};
+    uint8_t next_sent_baseline = 0;
+    uint8_t next_received_baseline = 0;
 };
 
-template <typename T>
+template <HasSchema T>
 MessageIdType Connection::send_reliable(T& message, uint8_t type, bool ordered, uint8_t priority) {
-    return 0;
+    constexpr auto max_bits = max_bit_size<T>();
+    static_assert(max_bits > 0 && max_bits + MAX_MESSAGE_HEADER_BITS + MAX_PACKET_HEADER_BITS <= (MTU - PACKET_CRC_SIZE) * 8,
+        "Message can never fit in a packet");
+    constexpr auto max_bytes = static_cast<size_t>((max_bits + 7) / 8);
+
+    auto data = message_pool->acquire(max_bytes);
+    NetWriteStream writer({ data.data(), max_bytes });
+    [[maybe_unused]] auto written = serialize_message(writer, message);
+    assert(written && "Message did not fit in the size computed from its schema");
+    auto message_bit_size = static_cast<uint16_t>(max_bytes * 8 - writer.bits_left());
+    writer.flush_scratch();
+
+    return queue_message(std::move(data), message_bit_size, type, priority, ordered ? RELIABLE_ORDERED : RELIABLE);
+}
+
+template <typename T>
+MessageIdType Connection::send_delta(T& state, uint8_t type, uint8_t priority) {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= MAX_BASELINE_SIZE);
+    auto acked_slot = find_acked_baseline(type);
+    auto has_baseline = acked_slot != NO_BASELINE_SLOT;
+    auto baseline_packet_id = has_baseline ? sent_baselines[acked_slot].packet_id : 0;
+    auto baseline_message_id = has_baseline ? sent_baselines[acked_slot].message_id : 0;
+    // The id queue_message is about to hand out
+    auto message_id = channel_message_counter[type];
+    T baseline = {};
+
+    if (has_baseline) {
+        memcpy(&baseline, sent_baselines[acked_slot].state.data(), sizeof(T));
+    }
+
+    std::array<std::byte, MTU> buffer;
+    NetWriteStream writer(buffer);
+    [[maybe_unused]] auto written = serialize_int(writer, message_id)
+        && serialize_bool(writer, has_baseline)
+        && (!has_baseline || (serialize_int(writer, baseline_packet_id) && serialize_int(writer, baseline_message_id)))
+        && serialize_delta(writer, state, baseline);
+    assert(written && "Delta message does not fit in a packet");
+    auto message_bit_size = static_cast<uint16_t>(MTU * 8 - writer.bits_left());
+    writer.flush_scratch();
+
+    auto byte_size = (message_bit_size + 7) / 8;
+    auto data = message_pool->acquire(byte_size);
+    memcpy(data.data(), buffer.data(), byte_size);
+
+    auto slot = next_sent_baseline;
+    next_sent_baseline = (next_sent_baseline + 1) % NUM_BASELINES;
+    [[maybe_unused]] auto queued_id = queue_message(
+        std::move(data),
+        message_bit_size,
+        type,
+        priority,
+        UNRELIABLE,
+        slot);
+    assert(queued_id == message_id);
+    auto& entry = sent_baselines[slot];
+    entry.message_id = message_id;
+    entry.type = type;
+    entry.sent = false;
+    entry.acked = false;
+    memcpy(entry.state.data(), &state, sizeof(T));
+
+    return message_id;
+}
+
+template <typename T>
+bool Connection::receive_delta(NetReadStream& stream, T& state, PacketIdType packet_id, uint8_t type) {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= MAX_BASELINE_SIZE);
+    MessageIdType message_id = 0;
+    bool has_baseline = false;
+    PacketIdType baseline_packet_id = 0;
+    MessageIdType baseline_message_id = 0;
+    T baseline = {};
+
+    DL_NET_CHECK(serialize_int(stream, message_id));
+    DL_NET_CHECK(serialize_bool(stream, has_baseline));
+
+    if (has_baseline) {
+        DL_NET_CHECK(serialize_int(stream, baseline_packet_id));
+        DL_NET_CHECK(serialize_int(stream, baseline_message_id));
+        auto slot = find_received_baseline(baseline_packet_id, baseline_message_id, type);
+        DL_NET_CHECK(slot != NO_BASELINE_SLOT);
+        memcpy(&baseline, received_baselines[slot].state.data(), sizeof(T));
+    }
+
+    DL_NET_CHECK(serialize_delta(stream, state, baseline));
+
+    auto& entry = received_baselines[next_received_baseline];
+    next_received_baseline = (next_received_baseline + 1) % NUM_BASELINES;
+    entry.packet_id = packet_id;
+    entry.message_id = message_id;
+    entry.type = type;
+    entry.sent = true;
+    entry.acked = true;
+    memcpy(entry.state.data(), &state, sizeof(T));
+
+    return true;
 }
 }
 
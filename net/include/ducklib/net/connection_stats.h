@@ -0,0 +1,149 @@
+#ifndef DUCKLIB_CONNECTION_STATS_H
+#define DUCKLIB_CONNECTION_STATS_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ducklib::net {
+/// What a Connection has measured about its path, see Connection::get_stats
+struct ConnectionStats {
+    /// Smoothed round trip time, zero until the first ack. Includes how long the remote holds acks, which resends
+    /// have to wait for as well.
+    std::chrono::microseconds rtt{ 0 };
+    std::chrono::microseconds rtt_variance{ 0 };
+    std::chrono::microseconds retransmission_timeout{ 0 }; ///< How long to wait for an ack before resending
+    float packet_loss = 0.0f; ///< Percent of recent packets the remote never acked
+    float sent_kbps = 0.0f;
+    float received_kbps = 0.0f;
+    float acked_kbps = 0.0f; ///< What actually got through, sent_kbps less what was lost
+    float send_rate_kbps = 0.0f; ///< What congestion control and the budget allow, 0 if nothing limits it
+    uint64_t packets_sent = 0;
+    uint64_t packets_received = 0;
+    uint64_t packets_acked = 0;
+    uint64_t packets_lost = 0;
+};
+
+/*
+ * Smoothed RTT and variance as in RFC 6298. A received packet gives at most one sample, from the newest packet it
+ * acks and only if that was not acked before, packets acked through the ack trail give none. The retransmission
+ * timeout follows the RFC except for its bounds: a game can not wait the RFC's one second minimum for a resend.
+ */
+class RttEstimator {
+public:
+    static constexpr std::chrono::microseconds INITIAL_TIMEOUT = std::chrono::seconds(1);
+    static constexpr std::chrono::microseconds MIN_TIMEOUT = std::chrono::milliseconds(20);
+    static constexpr std::chrono::microseconds MAX_TIMEOUT = std::chrono::seconds(10);
+
+    void add_sample(std::chrono::microseconds rtt);
+
+    [[nodiscard]]
+    bool has_samples() const { return sampled; }
+    [[nodiscard]]
+    auto smoothed() const -> std::chrono::microseconds { return smoothed_rtt; }
+    [[nodiscard]]
+    auto variance() const -> std::chrono::microseconds { return rtt_variance; }
+    /// INITIAL_TIMEOUT until the first sample
+    [[nodiscard]]
+    auto retransmission_timeout() const -> std::chrono::microseconds;
+
+private:
+    std::chrono::microseconds smoothed_rtt{ 0 };
+    std::chrono::microseconds rtt_variance{ 0 };
+    bool sampled = false;
+};
+
+/// Packet loss over the last WINDOW packets whose fate is known
+class LossWindow {
+public:
+    static constexpr uint32_t WINDOW = 64;
+
+    void add(bool lost);
+
+    /// Percent of the window that was lost, 0 while nothing is known
+    [[nodiscard]]
+    float loss_percent() const;
+
+private:
+    uint64_t lost_bits = 0; // Bit n is the packet added n packets ago
+    uint32_t count = 0;
+};
+
+/// Bytes per second measured over fixed intervals and smoothed between them
+class BandwidthMeter {
+public:
+    static constexpr std::chrono::milliseconds INTERVAL{ 250 };
+
+    void add(uint32_t bytes, std::chrono::steady_clock::time_point now);
+    /// Closes the interval once it is over even if nothing was added, so an idle link drops to zero
+    void advance(std::chrono::steady_clock::time_point now);
+
+    [[nodiscard]]
+    float kbps() const { return smoothed_kbps; }
+
+private:
+    std::chrono::steady_clock::time_point interval_start = {};
+    uint64_t interval_bytes = 0;
+    float smoothed_kbps = 0.0f;
+    bool started = false;
+    bool measured = false;
+};
+
+/*
+ * Hands a trivially copyable value from the thread writing it to any number of reader threads without locks. Readers
+ * retry while a write is in progress, the writer never waits. The value is held in atomic words so neither side races
+ * on it.
+ */
+template <typename T>
+class Snapshot {
+public:
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    /// Only one thread may publish
+    void publish(const T& value) {
+        std::array<uint64_t, WORD_COUNT> words = {};
+        memcpy(words.data(), &value, sizeof(T));
+        auto version = sequence.load(std::memory_order_relaxed);
+        sequence.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (auto i = 0U; i < WORD_COUNT; ++i) {
+            published[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(version + 2, std::memory_order_release);
+    }
+
+    T read() const {
+        std::array<uint64_t, WORD_COUNT> words;
+        uint32_t before;
+        uint32_t after;
+
+        do {
+            before = sequence.load(std::memory_order_acquire);
+
+            for (auto i = 0U; i < WORD_COUNT; ++i) {
+                words[i] = published[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1) != 0);
+
+        // T is trivially copyable, going through void* keeps -Wclass-memaccess from objecting to its constructors
+        T value;
+        memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr size_t WORD_COUNT = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> sequence = 0; // Odd while a write is in progress
+    std::array<std::atomic<uint64_t>, WORD_COUNT> published = {};
+};
+}
+
+#endif //DUCKLIB_CONNECTION_STATS_H
@@ -0,0 +1,18 @@
+#ifndef DUCKLIB_CRC32C_H
+#define DUCKLIB_CRC32C_H
+#include <cstdint>
+#include <span>
+
+namespace ducklib::net {
+/**
+ * @brief CRC32C (Castagnoli) of data, continuing from crc to checksum several spans as one.
+ * @details Uses the SSE4.2 or ARMv8 CRC32 instructions when the CPU has them, slicing-by-8 otherwise.
+ */
+uint32_t crc32c(std::span<const std::byte> data, uint32_t crc = 0);
+/// Table based implementation that runs on every CPU
+uint32_t crc32c_software(std::span<const std::byte> data, uint32_t crc = 0);
+/// Whether crc32c runs on CRC instructions
+bool crc32c_hardware_available();
+}
+
+#endif //DUCKLIB_CRC32C_H
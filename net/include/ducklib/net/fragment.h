@@ -0,0 +1,129 @@
+#ifndef DUCKLIB_FRAGMENT_H
+#define DUCKLIB_FRAGMENT_H
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <utility>
+
+#include "message_pool.h"
+
+namespace ducklib::net {
+/*
+ * Messages too large for one packet are sent as slices of SLICE_SIZE bytes, one message at a time. The sender keeps
+ * resending the slices the remote has not acked until every one of them is, only then does the next message start.
+ * The receiver so never holds more than one partly received message, at most MAX_FRAGMENTED_MESSAGE_SIZE bytes.
+ *
+ * Both only keep state, Connection writes the slices into its packets and maps packet acks back to slices.
+ */
+
+constexpr uint32_t SLICE_SIZE = 1024;
+constexpr uint32_t MAX_SLICES = 256;
+constexpr uint32_t MAX_FRAGMENTED_MESSAGE_SIZE = SLICE_SIZE * MAX_SLICES;
+
+using FragmentIdType = uint16_t;
+
+/// What every slice carries, so whichever slice arrives first tells the receiver how much to expect
+struct SliceHeader {
+    FragmentIdType fragment_id = 0;
+    uint8_t type = 0;
+    uint32_t bit_size = 0; ///< Of the whole message
+    uint8_t slice_index = 0;
+};
+
+/// Slices a message of bit_size bits is split into
+constexpr uint32_t slice_count(uint32_t bit_size) {
+    return (bit_size + SLICE_SIZE * 8 - 1) / (SLICE_SIZE * 8);
+}
+
+/// Bytes in slice slice_index of a message of bit_size bits, every slice but the last is SLICE_SIZE
+constexpr uint32_t slice_byte_size(uint32_t bit_size, uint32_t slice_index) {
+    auto byte_size = (bit_size + 7) / 8;
+    return std::min(SLICE_SIZE, byte_size - slice_index * SLICE_SIZE);
+}
+
+class FragmentSender {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Queues a message of at most MAX_FRAGMENTED_MESSAGE_SIZE bytes behind the ones already queued
+    void queue(MessageBuffer data, uint32_t bit_size, uint8_t type);
+
+    /// Whether a message is queued, including one whose slices have all been sent but not acked
+    [[nodiscard]]
+    bool is_sending() const { return !messages.empty(); }
+    /// Header and data of a slice of the message being sent
+    [[nodiscard]]
+    auto slice(uint8_t slice_index) const -> std::pair<SliceHeader, std::span<const std::byte>>;
+    /**
+     * @brief Picks the slice to send next, the first one that was never sent or has not been acked within
+     * resend_timeout.
+     * @return false if no slice is due
+     */
+    bool next_slice(Clock::time_point now, Clock::duration resend_timeout, uint8_t& slice_index) const;
+    /// When next_slice will have a slice, only meaningful while is_sending is true
+    [[nodiscard]]
+    auto next_send_time(Clock::duration resend_timeout) const -> Clock::time_point;
+
+    void on_slice_sent(uint8_t slice_index, Clock::time_point now);
+    /**
+     * @brief Marks the slice as received by the remote, moving on to the next message once all of them are.
+     * @details Acks for a message that is no longer being sent are ignored.
+     */
+    void on_slice_acked(FragmentIdType fragment_id, uint8_t slice_index);
+
+private:
+    struct Message {
+        MessageBuffer data;
+        uint32_t bit_size;
+        uint8_t type;
+    };
+
+    // Front is the message being sent
+    std::deque<Message> messages;
+    FragmentIdType fragment_id = 0;
+    uint32_t acked_count = 0;
+    std::bitset<MAX_SLICES> acked;
+    std::array<Clock::time_point, MAX_SLICES> sent_at = {}; // Epoch for slices never sent
+};
+
+class FragmentReceiver {
+public:
+    /**
+     * @brief Copies a slice into the message it belongs to, taking a buffer for it from pool on its first slice.
+     * @details Slices of messages completed before are ignored. A slice of a newer message than the one being
+     * received replaces it, the sender only starts one after the previous was received whole.
+     * @return false if the slice does not agree with the message or the message is too large
+     */
+    bool receive(const SliceHeader& header, std::span<const std::byte> data, MessagePool& pool);
+
+    /// Whether every slice of the message has arrived, it stays until take_message
+    [[nodiscard]]
+    bool is_complete() const { return receiving && received_count == slice_count(bit_size); }
+    /// Whether a buffer is held for a message, complete or not
+    [[nodiscard]]
+    bool is_receiving() const { return receiving; }
+    [[nodiscard]]
+    auto message_type() const -> uint8_t { return type; }
+    [[nodiscard]]
+    auto message_bit_size() const -> uint32_t { return bit_size; }
+    /// Hands out the completed message and makes room for the next one
+    MessageBuffer take_message();
+
+private:
+    MessageBuffer buffer;
+    FragmentIdType fragment_id = 0;
+    FragmentIdType completed_id = 0;
+    bool has_completed = false;
+    bool receiving = false;
+    uint8_t type = 0;
+    uint32_t bit_size = 0;
+    uint32_t received_count = 0;
+    std::bitset<MAX_SLICES> received;
+};
+}
+
+#endif //DUCKLIB_FRAGMENT_H
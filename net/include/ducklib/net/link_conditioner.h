@@ -0,0 +1,144 @@
+#ifndef DUCKLIB_LINK_CONDITIONER_H
+#define DUCKLIB_LINK_CONDITIONER_H
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "message_pool.h"
+#include "transport.h"
+
+namespace ducklib::net {
+/// How one direction of a conditioned link misbehaves, the defaults pass everything straight through
+struct LinkProfile {
+    std::chrono::microseconds latency{ 0 };
+    /// Extra delay picked uniformly from [0, jitter] per packet, more than the send interval reorders on its own
+    std::chrono::microseconds jitter{ 0 };
+    float loss = 0.0f;
+    /// Gilbert-Elliott bursts: chance per packet of going from good to bad, from bad back to good, and loss while bad
+    float burst_enter = 0.0f;
+    float burst_exit = 1.0f;
+    float burst_loss = 1.0f;
+    float duplicate = 0.0f;
+    /// Chance of a packet being held back by reorder_delay so later ones overtake it
+    float reorder = 0.0f;
+    std::chrono::microseconds reorder_delay{ 0 };
+    /// Bytes per second leaving the link, 0 = unlimited
+    uint64_t bandwidth = 0;
+    /// Bytes waiting on the bandwidth cap before more are dropped, 0 = unlimited
+    uint64_t queue_limit = 0;
+};
+
+struct LinkConditionerConfig {
+    LinkProfile send = {};
+    LinkProfile receive = {};
+    uint64_t seed = 0; ///< Same seed, traffic and clock give the same drops and delays on every platform
+    /// steady_clock if empty, tests drive their own. Only on steady_clock are the receive times of the inner transport
+    /// used, otherwise datagrams count as received when the link takes them from it.
+    std::function<ReceiveTime()> clock = {};
+};
+
+struct LinkStats {
+    uint64_t delivered = 0; ///< Passed on after their delay, duplicates included
+    uint64_t dropped = 0; ///< Lost to loss or burst_loss
+    uint64_t burst_dropped = 0; ///< Of dropped, lost while in a burst
+    uint64_t overflowed = 0; ///< Dropped because the bandwidth queue was full
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+};
+
+/*
+ * Transport that wraps another and makes it behave like a bad network: packets are delayed, dropped, duplicated and
+ * reordered according to a LinkProfile per direction. Hand it to a Connection or NetReactor in place of the socket to
+ * tune resends and congestion control against conditions a loopback test never sees:
+ *
+ *   auto socket = std::make_shared<Socket>(0);
+ *   auto link = std::make_shared<LinkConditioner>(socket, LinkConditionerConfig{
+ *       .send = { .latency = 50ms, .jitter = 10ms, .loss = 0.02f } });
+ *   Connection connection(address, link, protocol_id);
+ *
+ * Delayed sends go out on the next call into the conditioner once due, the reactor does that through next_wakeup.
+ * Call flush() when nothing else receives. Not thread safe.
+ */
+class LinkConditioner : public Transport {
+public:
+    explicit LinkConditioner(std::shared_ptr<Transport> inner, LinkConditionerConfig config = {});
+    LinkConditioner(const LinkConditioner& other) = delete;
+
+    LinkConditioner& operator=(const LinkConditioner& other) = delete;
+
+    [[nodiscard]]
+    auto get_port() const -> uint16_t override { return inner->get_port(); }
+    [[nodiscard]]
+    auto get_handle() const -> SocketHandle override { return inner->get_handle(); }
+    [[nodiscard]]
+    auto next_wakeup() const -> std::optional<ReceiveTime> override;
+
+    /// Reports every datagram as sent, whatever the link does with it afterwards
+    [[nodiscard]]
+    auto send(Address to, std::span<const std::byte> data) const -> size_t override;
+    auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t override;
+    auto send_batch(std::span<const OutgoingPacket> packets) const -> size_t override;
+    /// Datagrams are stamped with when the link let them through, the inner transport's receive time plus the delay
+    auto receive_batch(std::span<IncomingPacket> packets) const -> size_t override;
+
+    /**
+     * @brief Sends delayed packets that are due.
+     * @return Packets sent
+     */
+    auto flush() const -> size_t;
+
+    void set_send_profile(const LinkProfile& profile) { send_link.profile = profile; }
+    void set_receive_profile(const LinkProfile& profile) { receive_link.profile = profile; }
+
+    [[nodiscard]]
+    auto send_stats() const -> const LinkStats& { return send_link.stats; }
+    [[nodiscard]]
+    auto receive_stats() const -> const LinkStats& { return receive_link.stats; }
+
+private:
+    static constexpr size_t RECEIVE_BATCH_SIZE = 32;
+
+    struct DelayedPacket {
+        ReceiveTime release_at;
+        uint64_t sequence; // Packets due at the same time leave in the order they came in
+        Address address;
+        MessageBuffer data;
+        uint32_t size;
+    };
+
+    struct Link {
+        LinkProfile profile;
+        LinkStats stats;
+        std::vector<DelayedPacket> queue; // Min-heap on release_at
+        ReceiveTime free_at; // When the bandwidth cap has sent everything queued so far
+        bool in_burst = false;
+    };
+
+    auto now() const -> ReceiveTime;
+    /// Decides what happens to one packet and queues what survives
+    void submit(Link& link, const Address& address, std::span<const std::byte> data, ReceiveTime now) const;
+    void enqueue(Link& link, const Address& address, std::span<const std::byte> data, ReceiveTime release_at) const;
+    auto pop(Link& link) const -> DelayedPacket;
+    auto flush(ReceiveTime now) const -> size_t;
+    /// Moves everything the inner transport received onto the receive link, as of when it was received
+    void pull(ReceiveTime now) const;
+    /// Uniform in [0, 1)
+    auto random() const -> double;
+
+    std::shared_ptr<Transport> inner;
+    std::function<ReceiveTime()> clock;
+    mutable MessagePool pool; // Before the links so queued packets are released first
+    mutable Link send_link;
+    mutable Link receive_link;
+    mutable uint64_t rng_state;
+    mutable uint64_t next_sequence = 0;
+    mutable std::array<IncomingPacket, RECEIVE_BATCH_SIZE> incoming = {};
+    std::unique_ptr<std::byte[]> receive_storage;
+};
+}
+
+#endif //DUCKLIB_LINK_CONDITIONER_H
@@ -0,0 +1,75 @@
+#ifndef DUCKLIB_LOOPBACK_TRANSPORT_H
+#define DUCKLIB_LOOPBACK_TRANSPORT_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "transport.h"
+
+namespace ducklib::net {
+/*
+ * In-process stand-in for a pair of UDP sockets. Datagrams are copied into a lock-free single producer, single
+ * consumer ring owned by the receiving end, so two connections can talk without the kernel:
+ *
+ *   auto [client, server] = LoopbackTransport::make_pair();
+ *   Connection client_connection(server->get_address(), client);
+ *   Connection server_connection(client->get_address(), server);
+ *
+ * Each end only reaches its peer, sends to any other address fail. Like UDP a full ring drops what is sent, see
+ * dropped_count. One thread may send and another receive on each end at the same time.
+ *
+ * There is no handle to wait on, a NetReactor checks loopback transports after every wait and does not sleep while
+ * datagrams are waiting. Datagrams sent from another thread while it sleeps are picked up when its wait times out.
+ */
+class LoopbackTransport : public Transport {
+public:
+    static constexpr uint32_t DEFAULT_CAPACITY = 64;
+
+    /**
+     * @brief Makes two transports wired to each other.
+     * @param capacity Datagrams that can wait in each direction, rounded up to a power of two
+     */
+    static auto make_pair(uint32_t capacity = DEFAULT_CAPACITY)
+        -> std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>>;
+
+    LoopbackTransport(const LoopbackTransport& other) = delete;
+    ~LoopbackTransport() override;
+
+    LoopbackTransport& operator=(const LoopbackTransport& other) = delete;
+
+    /// Where datagrams from this end appear to come from
+    [[nodiscard]]
+    auto get_address() const -> const Address& { return address; }
+    [[nodiscard]]
+    auto get_port() const -> uint16_t override { return address.get_port(); }
+    [[nodiscard]]
+    auto get_handle() const -> SocketHandle override { return INVALID_SOCKET_HANDLE; }
+    /// Due right away while datagrams are waiting
+    [[nodiscard]]
+    auto next_wakeup() const -> std::optional<ReceiveTime> override;
+
+    [[nodiscard]]
+    auto send(Address to, std::span<const std::byte> data) const -> size_t override;
+    auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t override;
+    auto send_batch(std::span<const OutgoingPacket> packets) const -> size_t override;
+    auto receive_batch(std::span<IncomingPacket> packets) const -> size_t override;
+
+    /// Datagrams sent from this end that did not fit in the peer's ring
+    [[nodiscard]]
+    auto dropped_count() const -> uint64_t { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Ring;
+
+    LoopbackTransport(const Address& address, const Address& peer_address, std::shared_ptr<Ring> inbox, std::shared_ptr<Ring> outbox);
+
+    Address address;
+    Address peer_address;
+    std::shared_ptr<Ring> inbox; // Shared with the peer, which writes into it
+    std::shared_ptr<Ring> outbox;
+    mutable std::atomic<uint64_t> dropped = 0;
+};
+}
+
+#endif //DUCKLIB_LOOPBACK_TRANSPORT_H
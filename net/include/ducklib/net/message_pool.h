@@ -0,0 +1,125 @@
+#ifndef DUCKLIB_MESSAGE_POOL_H
+#define DUCKLIB_MESSAGE_POOL_H
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "packet_buffer.h"
+#include "shared.h"
+
+namespace ducklib::net {
+/*
+ * Queued message payloads come from a MessagePool rather than the heap. Every size class is a slab allocator, blocks
+ * are carved out of slabs allocated a batch at a time and go back on a free list when their MessageBuffer is released,
+ * so once a connection has warmed up sending a message allocates nothing.
+ *
+ * A pool can belong to one connection or be shared by all connections run by one thread (see
+ * Connection::set_message_pool). Not thread safe, buffers have to be released on the thread that owns the pool and
+ * must not outlive it.
+ */
+
+class MessagePool;
+
+class MessageBuffer {
+public:
+    MessageBuffer() = default;
+    MessageBuffer(const MessageBuffer& other) = delete;
+    MessageBuffer(MessageBuffer&& other) noexcept;
+    ~MessageBuffer();
+
+    MessageBuffer& operator=(const MessageBuffer& other) = delete;
+    MessageBuffer& operator=(MessageBuffer&& other) noexcept;
+    explicit operator bool() const { return block != nullptr; }
+
+    std::byte* data() const { return block; }
+    /// Size of the block, at least what was asked for
+    uint32_t capacity() const { return block_size; }
+
+private:
+    friend class MessagePool;
+
+    MessageBuffer(std::byte* block, uint32_t block_size, MessagePool* pool)
+        : block(block), block_size(block_size), pool(pool) {}
+
+    void release();
+
+    std::byte* block = nullptr;
+    uint32_t block_size = 0;
+    MessagePool* pool = nullptr;
+};
+
+class MessagePool {
+public:
+    static constexpr std::array<uint32_t, 7> SIZE_CLASSES = { 16, 32, 64, 128, 256, 512, MTU };
+    static constexpr uint32_t DEFAULT_BLOCKS_PER_SLAB = 64;
+
+    explicit MessagePool(uint32_t blocks_per_slab = DEFAULT_BLOCKS_PER_SLAB);
+    MessagePool(const MessagePool& other) = delete;
+    ~MessagePool();
+
+    MessagePool& operator=(const MessagePool& other) = delete;
+
+    /**
+     * @brief Takes a block of the smallest size class that fits byte_size, allocating a slab if the class is empty.
+     * @details Anything larger than the largest class is allocated on its own and counted in oversize_count.
+     */
+    MessageBuffer acquire(uint32_t byte_size);
+
+    /// One entry per size class, misses count the slabs allocated
+    std::span<const PoolStats> stats() const { return class_stats; }
+    uint64_t oversize_count() const { return oversize_acquires; }
+    /// Bytes held in slabs, whether in use or not
+    size_t reserved_bytes() const;
+
+private:
+    friend class MessageBuffer;
+
+    struct SizeClass {
+        std::vector<std::unique_ptr<std::byte[]>> slabs;
+        std::byte* free_list = nullptr; // Free blocks keep the pointer to the next one in their first bytes
+    };
+
+    static uint32_t class_index(uint32_t byte_size);
+    void allocate_slab(uint32_t index);
+    void release(std::byte* block, uint32_t block_size);
+
+    std::array<SizeClass, SIZE_CLASSES.size()> classes;
+    std::array<PoolStats, SIZE_CLASSES.size()> class_stats = {};
+    uint32_t blocks_per_slab;
+    uint64_t oversize_acquires = 0;
+};
+
+inline MessageBuffer::MessageBuffer(MessageBuffer&& other) noexcept
+    : block(other.block), block_size(other.block_size), pool(other.pool) {
+    other.block = nullptr;
+}
+
+inline MessageBuffer::~MessageBuffer() {
+    release();
+}
+
+inline MessageBuffer& MessageBuffer::operator=(MessageBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        block = other.block;
+        block_size = other.block_size;
+        pool = other.pool;
+        other.block = nullptr;
+    }
+
+    return *this;
+}
+
+inline void MessageBuffer::release() {
+    if (block) {
+        pool->release(block, block_size);
+    }
+
+    block = nullptr;
+}
+}
+
+#endif //DUCKLIB_MESSAGE_POOL_H
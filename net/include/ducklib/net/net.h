@@ -2,7 +2,8 @@
 #define NET_H
 
 #include <string>
-#include <bit>
+
+#include "byte_order.h"
 
 namespace ducklib::net {
 void net_initialize();
@@ -13,20 +14,6 @@ void net_log_error(const char* text, Args... args);
 template <typename... Args>
 void net_fail(const std::string& text, Args... args);
 
-template <typename T>
-auto host_to_net(T value) -> T {
-    if constexpr (std::endian::native == std::endian::little) {
-        return std::byteswap(value);
-    } else {
-        return value;
-    }
-}
-
-template <typename T>
-auto net_to_host(T value) -> T {
-    return host_to_net(value);
-}
-
 template <typename... Args>
 void net_log_error(const char* text, Args... args) {
     // static Logger logger;
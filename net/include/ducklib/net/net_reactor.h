@@ -0,0 +1,104 @@
+#ifndef DUCKLIB_NET_REACTOR_H
+#define DUCKLIB_NET_REACTOR_H
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "connection.h"
+#include "socket.h"
+
+namespace ducklib::net {
+/*
+ * Event loop for any number of transports and the connections using them. Each run_once sleeps in the kernel until a
+ * socket is readable, a transport has delayed datagrams due or the next connection is due to send (epoll on Linux,
+ * poll/WSAPoll elsewhere), hands every received datagram to the connection it came from, then lets due connections
+ * send:
+ *
+ *   NetReactor reactor;
+ *   reactor.add_connection(connection);
+ *   while (running) {
+ *       reactor.run_once(100ms);
+ *   }
+ *
+ * Connections are not owned, remove them before destroying them. Transports are kept alive while registered, ones
+ * without a handle to wait on are checked after every wait. Not thread safe, use one reactor per network thread.
+ */
+class NetReactor {
+public:
+    /// Called for datagrams from addresses without a registered connection on the transport they arrived on
+    using UnknownSenderCallback = std::function<void(
+        const std::shared_ptr<Transport>& transport,
+        const Address& from,
+        std::span<const std::byte> packet,
+        ReceiveTime received_at)>;
+
+    NetReactor();
+    NetReactor(const NetReactor& other) = delete;
+    ~NetReactor();
+
+    NetReactor& operator=(const NetReactor& other) = delete;
+
+    /**
+     * @brief Starts receiving from transport, connections using it can then be added.
+     * @return false if its handle could not be waited on
+     */
+    bool add_transport(const std::shared_ptr<Transport>& transport);
+    /// Stops receiving from transport, connections still using it are removed as well
+    void remove_transport(const Transport& transport);
+    /**
+     * @brief Dispatches datagrams from the remote address of connection to it, adding its transport if needed.
+     * @return false if its transport could not be added or another connection has the same transport and remote address
+     */
+    bool add_connection(Connection& connection);
+    void remove_connection(const Connection& connection);
+
+    void set_unknown_sender_callback(UnknownSenderCallback callback) { on_unknown_sender = std::move(callback); }
+
+    /**
+     * @brief Waits up to max_wait for received datagrams or a due connection, then dispatches and sends.
+     * @return Datagrams received
+     */
+    auto run_once(std::chrono::milliseconds max_wait) -> size_t;
+
+    [[nodiscard]]
+    auto transport_count() const -> size_t { return transports.size(); }
+    [[nodiscard]]
+    auto connection_count() const -> size_t { return connections.size(); }
+
+private:
+    static constexpr size_t RECEIVE_BATCH_SIZE = 32;
+
+    struct TransportEntry {
+        std::shared_ptr<Transport> transport;
+        std::unordered_map<Address, Connection*> connections;
+    };
+
+    /// Time until the first connection with queued messages may send or transport wakeup, capped at max_wait
+    auto next_timeout(std::chrono::milliseconds max_wait) const -> std::chrono::milliseconds;
+    /// Fills ready_transports with transports whose handle is readable
+    void wait(std::chrono::milliseconds timeout);
+    /// Adds transports that have nothing to wait on or a wakeup that is due
+    void add_unwatched_ready(ReceiveTime now);
+    auto drain(TransportEntry& entry) -> size_t;
+    bool watch(Transport& transport);
+    void unwatch(Transport& transport);
+
+    std::unordered_map<const Transport*, TransportEntry> transports;
+    std::vector<Connection*> connections;
+    std::vector<const Transport*> ready_transports;
+    UnknownSenderCallback on_unknown_sender;
+
+#if defined(__linux__)
+    int epoll_handle = -1;
+#endif
+
+    std::array<IncomingPacket, RECEIVE_BATCH_SIZE> incoming = {};
+    std::unique_ptr<std::byte[]> receive_storage;
+};
+}
+
+#endif //DUCKLIB_NET_REACTOR_H
@@ -0,0 +1,34 @@
+#ifndef DUCKLIB_PACKET_H
+#define DUCKLIB_PACKET_H
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace ducklib::net {
+/*
+ * Every packet starts with a CRC32C of the protocol id followed by the rest of the packet. The protocol id itself is
+ * never sent, so datagrams from other programs or other protocol versions fail the check and are dropped before any
+ * of their contents are read.
+ *
+ *   [crc32c(protocol_id, payload) : 4 bytes, little endian][payload]
+ */
+
+constexpr uint32_t DEFAULT_PROTOCOL_ID = 0x4b435544; // "DUCK"
+constexpr size_t PACKET_CRC_SIZE = sizeof(uint32_t);
+
+/**
+ * @brief Fills in the CRC at the start of packet, the payload has to be written already.
+ */
+void write_packet_crc(std::span<std::byte> packet, uint32_t protocol_id);
+/**
+ * @brief Checks the CRC of a received packet.
+ * @return false if the packet is too small to have a header or was not sent with protocol_id
+ */
+bool check_packet_crc(std::span<const std::byte> packet, uint32_t protocol_id);
+/// The part of a checked packet that follows the header
+inline std::span<const std::byte> packet_payload(std::span<const std::byte> packet) {
+    return packet.subspan(PACKET_CRC_SIZE);
+}
+}
+
+#endif //DUCKLIB_PACKET_H
@@ -0,0 +1,185 @@
+#ifndef DUCKLIB_PACKET_BUFFER_H
+#define DUCKLIB_PACKET_BUFFER_H
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace ducklib::net {
+/*
+ * Received datagrams land in fixed-size buffers taken from a PacketBufferPool. A PacketRef keeps its buffer out of
+ * the pool, and so does every PacketView made from it, so payloads can be handed to the application as views into the
+ * packet instead of copies:
+ *
+ *   auto packet = socket.receive(from, pool);
+ *   auto reader = NetReadStream(packet.data().data(), packet.size() * 8);
+ *   PacketView chunk;
+ *   serialize_data_view(reader, packet, chunk, chunk_size);
+ *   // packet can go away, chunk keeps the buffer alive until it is released
+ *
+ * Reference counts are not atomic, refs and views have to be released on the thread that owns the pool.
+ */
+
+constexpr uint32_t DEFAULT_PACKET_BUFFER_SIZE = 1500;
+
+/// How hard a pool is being used, a pool with misses is too small for its load
+struct PoolStats {
+    uint32_t block_size = 0;
+    uint32_t capacity = 0; ///< Blocks the pool holds
+    uint32_t in_use = 0;
+    uint32_t peak_in_use = 0;
+    uint64_t acquires = 0;
+    uint64_t misses = 0; ///< Acquires that found no free block, the pool either failed them or had to grow
+};
+
+class PacketBufferPool;
+
+struct PacketBuffer {
+    std::byte* data;
+    uint32_t size;
+    uint32_t ref_count;
+    PacketBufferPool* pool;
+    PacketBuffer* next_free;
+};
+
+struct PacketView;
+
+class PacketRef {
+public:
+    PacketRef() = default;
+    PacketRef(const PacketRef& other);
+    PacketRef(PacketRef&& other) noexcept;
+    ~PacketRef();
+
+    PacketRef& operator=(const PacketRef& other);
+    PacketRef& operator=(PacketRef&& other) noexcept;
+    explicit operator bool() const { return buffer != nullptr; }
+
+    /// The whole buffer, to receive into
+    std::span<std::byte> storage() const;
+    /// The received bytes
+    std::span<const std::byte> data() const { return { buffer->data, buffer->size }; }
+    uint32_t size() const { return buffer->size; }
+    void set_size(uint32_t size);
+    uint32_t use_count() const { return buffer ? buffer->ref_count : 0; }
+    /**
+     * @brief Makes a view of bytes inside this packet that keeps the packet alive.
+     */
+    PacketView view(std::span<const std::byte> bytes) const;
+
+private:
+    friend class PacketBufferPool;
+
+    explicit PacketRef(PacketBuffer* buffer)
+        : buffer(buffer) {}
+
+    void release();
+
+    PacketBuffer* buffer = nullptr;
+};
+
+struct PacketView {
+    PacketRef packet;
+    std::span<const std::byte> bytes;
+};
+
+class PacketBufferPool {
+public:
+    explicit PacketBufferPool(uint32_t buffer_count, uint32_t buffer_size = DEFAULT_PACKET_BUFFER_SIZE);
+    PacketBufferPool(const PacketBufferPool& other) = delete;
+    ~PacketBufferPool();
+
+    PacketBufferPool& operator=(const PacketBufferPool& other) = delete;
+
+    /**
+     * @return An empty ref if every buffer is in use
+     */
+    PacketRef acquire();
+    uint32_t available() const { return available_count; }
+    uint32_t buffer_size() const { return size_per_buffer; }
+    /// Misses are acquires that returned an empty ref
+    PoolStats stats() const;
+
+private:
+    friend class PacketRef;
+
+    void release(PacketBuffer* buffer);
+
+    std::unique_ptr<std::byte[]> storage;
+    std::unique_ptr<PacketBuffer[]> buffers;
+    PacketBuffer* free_list = nullptr;
+    uint32_t buffer_count;
+    uint32_t size_per_buffer;
+    uint32_t available_count;
+    uint32_t peak_in_use = 0;
+    uint64_t acquire_count = 0;
+    uint64_t miss_count = 0;
+};
+
+inline PacketRef::PacketRef(const PacketRef& other)
+    : buffer(other.buffer) {
+    if (buffer) {
+        ++buffer->ref_count;
+    }
+}
+
+inline PacketRef::PacketRef(PacketRef&& other) noexcept
+    : buffer(other.buffer) {
+    other.buffer = nullptr;
+}
+
+inline PacketRef::~PacketRef() {
+    release();
+}
+
+inline PacketRef& PacketRef::operator=(const PacketRef& other) {
+    if (other.buffer) {
+        ++other.buffer->ref_count;
+    }
+
+    release();
+    buffer = other.buffer;
+    return *this;
+}
+
+inline PacketRef& PacketRef::operator=(PacketRef&& other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = other.buffer;
+        other.buffer = nullptr;
+    }
+
+    return *this;
+}
+
+inline std::span<std::byte> PacketRef::storage() const {
+    return { buffer->data, buffer->pool->buffer_size() };
+}
+
+inline void PacketRef::set_size(uint32_t size) {
+    assert(size <= buffer->pool->buffer_size());
+    buffer->size = size;
+}
+
+inline PacketView PacketRef::view(std::span<const std::byte> bytes) const {
+    assert(bytes.empty() || (bytes.data() >= buffer->data && bytes.data() + bytes.size() <= buffer->data + buffer->size));
+    return { *this, bytes };
+}
+
+inline void PacketRef::release() {
+    if (buffer && --buffer->ref_count == 0) {
+        buffer->pool->release(buffer);
+    }
+
+    buffer = nullptr;
+}
+
+struct NetReadStream;
+
+/**
+ * @brief Reads a blob written with serialize_aligned_data as a view into packet, which reader has to be reading.
+ */
+bool serialize_data_view(NetReadStream& stream, const PacketRef& packet, PacketView& view, uint16_t byte_size);
+}
+
+#endif //DUCKLIB_PACKET_BUFFER_H
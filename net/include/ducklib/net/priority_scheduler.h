@@ -0,0 +1,144 @@
+#ifndef DUCKLIB_PRIORITY_SCHEDULER_H
+#define DUCKLIB_PRIORITY_SCHEDULER_H
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ducklib::net {
+/*
+ * Queue where items are taken by accumulated priority instead of strictly by priority. An item gains its level's
+ * weight every tick it waits, so higher levels go first but an item that has waited long enough overtakes them. When
+ * more is queued than gets taken the higher levels age as well, so past max_wait ticks items go strictly oldest first
+ * and nothing is starved for good however loaded the queue is:
+ *
+ *   PriorityScheduler<Message, 3> queue({ 1, 4, 16 }, 128);
+ *   queue.push(std::move(message), priority, tick);
+ *   for (uint32_t level; queue.next_level(tick, level); queue.pop(level)) { send(queue.front(level)); }
+ *
+ * Every level is a FIFO ring. Items of one level all gain at the same pace, so the oldest is always ahead and picking
+ * the next item only compares the front of every level. Nothing is allocated once the rings have grown to the load.
+ */
+template <typename T, size_t Levels>
+class PriorityScheduler {
+public:
+    using Tick = uint32_t;
+
+    /// weights[level] is what an item of that level gains per tick waited
+    PriorityScheduler(const std::array<uint32_t, Levels>& weights, Tick max_wait)
+        : weights(weights), max_wait(max_wait) {
+        assert(std::ranges::all_of(weights, [&](auto weight) { return uint64_t{ weight } * max_wait < OVERDUE; }));
+    }
+
+    /// Levels past the last are taken as the last
+    void push(T item, uint32_t level, Tick now) {
+        levels[std::min<size_t>(level, Levels - 1)].push({ std::move(item), now });
+        ++item_count;
+    }
+
+    /**
+     * @brief Finds the level whose oldest item has accumulated the most priority by now, ties going to the higher
+     * level.
+     * @param skipped_levels Bit n set leaves level n out, e.g. levels whose front did not fit
+     * @return false if every level is empty or skipped
+     */
+    bool next_level(Tick now, uint32_t& level, uint32_t skipped_levels = 0) const {
+        static_assert(Levels <= 32, "Skipped levels are the bits of a uint32_t");
+        auto found = false;
+        auto best = uint64_t{ 0 };
+
+        for (auto i = static_cast<uint32_t>(Levels); i-- > 0;) {
+            if (levels[i].empty() || (skipped_levels >> i & 1) != 0) {
+                continue;
+            }
+
+            // Counted from 1 so an item that has not waited yet still has its weight
+            auto waited = static_cast<Tick>(now - levels[i].front().queued_at);
+            auto accumulated = waited >= max_wait ? OVERDUE + waited : static_cast<uint64_t>(weights[i]) * (waited + 1ULL);
+
+            if (!found || accumulated > best) {
+                found = true;
+                best = accumulated;
+                level = i;
+            }
+        }
+
+        return found;
+    }
+
+    T& front(uint32_t level) { return levels[level].front().item; }
+    const T& front(uint32_t level) const { return levels[level].front().item; }
+
+    /// Removes the oldest item of the level, releasing whatever it holds
+    void pop(uint32_t level) {
+        levels[level].pop();
+        --item_count;
+    }
+
+    [[nodiscard]]
+    bool empty() const { return item_count == 0; }
+    [[nodiscard]]
+    size_t size() const { return item_count; }
+
+private:
+    static constexpr uint64_t OVERDUE = uint64_t{ 1 } << 62; // Above any priority accumulated within max_wait
+
+    struct Entry {
+        T item = {};
+        Tick queued_at = 0;
+    };
+
+    /// Circular buffer over a power of two sized vector, doubled when full
+    class Ring {
+    public:
+        void push(Entry entry) {
+            if (count == slots.size()) {
+                grow();
+            }
+
+            slots[(head + count) & (slots.size() - 1)] = std::move(entry);
+            ++count;
+        }
+
+        Entry& front() { return slots[head]; }
+        const Entry& front() const { return slots[head]; }
+
+        void pop() {
+            assert(count > 0);
+            slots[head] = {};
+            head = (head + 1) & (slots.size() - 1);
+            --count;
+        }
+
+        [[nodiscard]]
+        bool empty() const { return count == 0; }
+
+    private:
+        static constexpr size_t INITIAL_CAPACITY = 16;
+
+        void grow() {
+            std::vector<Entry> grown(slots.empty() ? INITIAL_CAPACITY : slots.size() * 2);
+
+            for (auto i = size_t{ 0 }; i < count; ++i) {
+                grown[i] = std::move(slots[(head + i) & (slots.size() - 1)]);
+            }
+
+            slots = std::move(grown);
+            head = 0;
+        }
+
+        std::vector<Entry> slots;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    std::array<Ring, Levels> levels = {};
+    std::array<uint32_t, Levels> weights;
+    Tick max_wait;
+    size_t item_count = 0;
+};
+}
+
+#endif //DUCKLIB_PRIORITY_SCHEDULER_H
@@ -0,0 +1,130 @@
+#ifndef DUCKLIB_RANGE_CODER_H
+#define DUCKLIB_RANGE_CODER_H
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "serialization.h"
+
+namespace ducklib::net {
+/*
+ * Adaptive binary range coder streams for channels where bandwidth matters more than CPU. They work with the same
+ * serialize functions and schemas as NetWriteStream/NetReadStream, but every value is entropy coded with a probability
+ * model picked by the order of the serialize calls: the first call in a stream uses field model 0, the second field
+ * model 1 and so on.
+ *
+ * Models learn from every value coded with them and have to evolve identically on both ends. Keep one
+ * RangeCoderModels per channel on each side and only share it between streams on reliable ordered channels, otherwise
+ * reset it for every message. Fields with a varying number of serialize calls (varints, optional fields) shift the
+ * models of every field after them, bounded fields compress better.
+ */
+
+constexpr uint32_t MAX_RANGE_FIELD_MODELS = 64;
+
+struct RangeFieldModel {
+    std::array<uint16_t, 256> value_tree; // Values of up to 8 bits, indexed by the bits coded so far
+    std::array<uint16_t, 128> length_tree; // Bit width of wider values
+    std::array<uint16_t, 64> mantissa; // Bits below the leading one of wider values, by position
+};
+
+struct RangeCoderModels {
+    std::array<RangeFieldModel, MAX_RANGE_FIELD_MODELS> fields;
+
+    RangeCoderModels() {
+        reset();
+    }
+
+    void reset();
+};
+
+struct NetRangeWriteStream {
+    std::span<std::byte> buffer;
+    RangeCoderModels& models;
+    uint32_t bits_written = 0; // Bits put in the buffer so far, always whole bytes. The final size after flush_scratch
+    uint64_t low = 0;
+    uint32_t range = 0xffffffff;
+    uint32_t pending_bytes = 1; // Cache byte plus any 0xff bytes waiting on a carry
+    uint32_t next_field = 0;
+    uint8_t cache = 0;
+    bool first_byte = true;
+    bool overflow = false;
+
+    NetRangeWriteStream(std::span<std::byte> buffer, RangeCoderModels& models)
+        : buffer(buffer)
+        , models(models) {}
+
+    template <std::integral T>
+    bool serialize_value(T value, uint8_t bits);
+    bool serialize_data(std::byte* data, uint32_t data_bit_size);
+    bool serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits);
+    void align_to_byte() {} // Coded values do not sit on bit positions
+    /**
+     * @brief Space left in the buffer after the bytes the coder still has to output. Values usually take fewer bits
+     * than their width, so this is a lower bound on what fits.
+     */
+    uint16_t bits_left() const;
+    /**
+     * @brief Outputs the rest of the coder state, after this the stream is complete and bits_written is its size.
+     */
+    bool flush_scratch();
+
+    static constexpr bool can_write() { return true; }
+    static constexpr bool can_read() { return false; }
+
+private:
+    void encode(RangeFieldModel& model, uint64_t value, uint8_t bits);
+    void encode_bit(uint16_t& probability, uint32_t bit);
+    void shift_low();
+    void output_byte(uint8_t byte);
+};
+
+template <std::integral T>
+bool NetRangeWriteStream::serialize_value(T value, uint8_t bits) {
+    assert(bits > 0 && bits <= 64);
+    auto mask = ~0ULL >> (SCRATCH_SIZE_BITS - bits);
+    encode(models.fields[next_field++ % MAX_RANGE_FIELD_MODELS], static_cast<uint64_t>(value) & mask, bits);
+    return !overflow;
+}
+
+struct NetRangeReadStream {
+    std::span<const std::byte> buffer;
+    RangeCoderModels& models;
+    uint32_t bytes_read = 0;
+    uint32_t code = 0;
+    uint32_t range = 0xffffffff;
+    uint32_t next_field = 0;
+    bool corrupt = false;
+
+    NetRangeReadStream(const std::byte* data, uint32_t bit_size, RangeCoderModels& models);
+
+    template <std::integral T>
+    bool serialize_value(T& value, uint8_t bits);
+    bool serialize_data(std::byte* data, uint16_t data_bit_size);
+    bool serialize_packed(uint32_t* values, uint32_t count, uint8_t bits);
+    void align_to_byte() {}
+    /**
+     * @brief How many raw bits are left is not known before decoding them, so this is only 0 after decoding a value
+     * wider than its field. Truncated streams are not detected, the packet CRC and message sizes cover that.
+     */
+    uint16_t bits_left() const;
+
+    static constexpr bool can_write() { return false; }
+    static constexpr bool can_read() { return true; }
+
+private:
+    uint64_t decode(RangeFieldModel& model, uint8_t bits);
+    uint32_t decode_bit(uint16_t& probability);
+    uint8_t input_byte();
+};
+
+template <std::integral T>
+bool NetRangeReadStream::serialize_value(T& value, uint8_t bits) {
+    assert(bits > 0 && bits <= 64);
+    auto decoded = decode(models.fields[next_field++ % MAX_RANGE_FIELD_MODELS], bits);
+    DL_NET_CHECK(!corrupt);
+    value = static_cast<T>(decoded);
+    return true;
+}
+}
+
+#endif //DUCKLIB_RANGE_CODER_H
@@ -0,0 +1,170 @@
+#ifndef DUCKLIB_SCHEMA_H
+#define DUCKLIB_SCHEMA_H
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "serialization.h"
+
+namespace ducklib::net {
+/*
+ * A message declares its fields once and gets a single serialize for every stream type plus a compile time worst
+ * case bit size:
+ *
+ *   struct PlayerInput {
+ *       uint8_t buttons;
+ *       float yaw;
+ *
+ *       using Schema = MessageSchema<
+ *           BoundedIntField<&PlayerInput::buttons, 0, 15>,
+ *           QuantizedFloatField<&PlayerInput::yaw, -180.0f, 180.0f, 0.1f>>;
+ *   };
+ *
+ * Every field type has a static MAX_BITS and a static serialize(stream, message).
+ */
+
+template <auto Member>
+struct MemberTraits;
+
+template <typename ClassT, typename MemberT, MemberT ClassT::* Member>
+struct MemberTraits<Member> {
+    using ClassType = ClassT;
+    using Type = MemberT;
+};
+
+template <auto Member>
+using MemberType = typename MemberTraits<Member>::Type;
+
+template <typename T>
+concept HasSchema = requires {
+    { T::Schema::MAX_BITS } -> std::convertible_to<uint32_t>;
+};
+
+template <typename... Fields>
+struct MessageSchema {
+    static constexpr uint32_t MAX_BITS = (0U + ... + Fields::MAX_BITS);
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return (Fields::serialize(stream, message) && ...);
+    }
+};
+
+template <HasSchema T>
+constexpr uint32_t max_bit_size() {
+    return T::Schema::MAX_BITS;
+}
+
+template <typename StreamType, HasSchema T>
+bool serialize_message(StreamType& stream, T& message) {
+    DL_NET_CHECK(T::Schema::serialize(stream, message));
+    return true;
+}
+
+template <auto Member>
+struct IntField {
+    static constexpr uint32_t MAX_BITS = sizeof(MemberType<Member>) * 8;
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_int(stream, message.*Member);
+    }
+};
+
+template <auto Member, MemberType<Member> Min, MemberType<Member> Max>
+struct BoundedIntField {
+    static_assert(Min < Max);
+    static constexpr uint32_t MAX_BITS = std::bit_width(static_cast<uint64_t>(Max - Min));
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_int(stream, message.*Member, Min, Max);
+    }
+};
+
+template <auto Member, uint8_t GroupBits = 7>
+struct VarintField {
+    static constexpr uint32_t VALUE_BITS = sizeof(MemberType<Member>) * 8;
+    static constexpr uint32_t MAX_BITS = (VALUE_BITS + GroupBits - 1) / GroupBits * (GroupBits + 1);
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_varint(stream, message.*Member, GroupBits);
+    }
+};
+
+template <auto Member>
+struct BoolField {
+    static constexpr uint32_t MAX_BITS = 1;
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_bool(stream, message.*Member);
+    }
+};
+
+template <auto Member>
+struct FloatField {
+    static constexpr uint32_t MAX_BITS = 32;
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_float(stream, message.*Member);
+    }
+};
+
+template <auto Member, float Min, float Max, float Resolution>
+struct QuantizedFloatField {
+    static constexpr uint32_t MAX_BITS = std::bit_width(quantized_float_steps(Min, Max, Resolution));
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_float(stream, message.*Member, Min, Max, Resolution);
+    }
+};
+
+template <auto Member, float Min, float Max, float Resolution>
+struct Vector3Field {
+    static constexpr uint32_t MAX_BITS = 3 * std::bit_width(quantized_float_steps(Min, Max, Resolution));
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_vector3(stream, message.*Member, Min, Max, Resolution);
+    }
+};
+
+template <auto Member, uint8_t ComponentBits = 10>
+struct QuaternionField {
+    static constexpr uint32_t MAX_BITS = 2 + 3 * ComponentBits;
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_quaternion(stream, message.*Member, ComponentBits);
+    }
+};
+
+/// Fixed-size byte array member (std::array<std::byte, N>)
+template <auto Member>
+struct BytesField {
+    static constexpr uint32_t MAX_BITS = std::tuple_size_v<MemberType<Member>> * 8;
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_data(stream, (message.*Member).data(), static_cast<uint16_t>(MAX_BITS));
+    }
+};
+
+/// Member that has its own schema
+template <auto Member>
+struct MessageField {
+    static constexpr uint32_t MAX_BITS = max_bit_size<MemberType<Member>>();
+
+    template <typename StreamType, typename T>
+    static bool serialize(StreamType& stream, T& message) {
+        return serialize_message(stream, message.*Member);
+    }
+};
+}
+
+#endif //DUCKLIB_SCHEMA_H
@@ -0,0 +1,110 @@
+#ifndef DUCKLIB_SEQUENCE_BUFFER_H
+#define DUCKLIB_SEQUENCE_BUFFER_H
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace ducklib::net {
+/// Whether sequence a comes after b, correct across wraparound as long as they are less than half the range apart
+template <std::unsigned_integral Sequence>
+constexpr bool sequence_greater_than(Sequence a, Sequence b) {
+    return static_cast<std::make_signed_t<Sequence>>(static_cast<Sequence>(a - b)) > 0;
+}
+
+template <std::unsigned_integral Sequence>
+constexpr bool sequence_less_than(Sequence a, Sequence b) {
+    return sequence_greater_than(b, a);
+}
+
+/*
+ * Fixed-size map from the last N sequence numbers to entries, stored in a ring indexed by sequence % N. Inserting a
+ * sequence overwrites whatever was N sequences before it, so nothing is allocated after construction and lookups are a
+ * mask and a compare:
+ *
+ *   SequenceBuffer<SentPacket, 256> sent;
+ *   sent.insert(sequence)->sent_at = now;
+ *   if (auto packet = sent.find(acked_sequence)) { ... }
+ *
+ * Sequences older than the newest inserted minus N are refused, their slots already belong to newer ones. Jumping
+ * ahead frees the slots of the skipped sequences, so nothing older than that is found either.
+ */
+template <typename T, size_t N, std::unsigned_integral Sequence = uint32_t>
+class SequenceBuffer {
+public:
+    static_assert(std::has_single_bit(N), "Size must be a power of two so sequence wraparound keeps the slot index");
+
+    /**
+     * @brief Takes the slot for sequence, resetting its entry to a value-initialized T.
+     * @return nullptr if sequence is too old to be held
+     */
+    T* insert(Sequence sequence) {
+        if (has_newest && sequence_less_than(sequence, static_cast<Sequence>(newest - (N - 1)))) {
+            return nullptr;
+        }
+
+        if (!has_newest) {
+            newest = sequence;
+            has_newest = true;
+        } else if (sequence_greater_than(sequence, newest)) {
+            // Skipped sequences never get inserted, whatever their slots held is too old to be found now
+            clear_between(newest, sequence);
+            newest = sequence;
+        }
+
+        auto index = sequence & (N - 1);
+        sequences[index] = sequence;
+        occupied[index] = true;
+        entries[index] = T{};
+        return &entries[index];
+    }
+
+    void remove(Sequence sequence) {
+        if (auto index = sequence & (N - 1); occupied[index] && sequences[index] == sequence) {
+            occupied[index] = false;
+        }
+    }
+
+    /// nullptr if sequence was never inserted or its slot has been taken by a newer one
+    T* find(Sequence sequence) {
+        auto index = sequence & (N - 1);
+        return occupied[index] && sequences[index] == sequence ? &entries[index] : nullptr;
+    }
+
+    const T* find(Sequence sequence) const {
+        return const_cast<SequenceBuffer*>(this)->find(sequence);
+    }
+
+    bool contains(Sequence sequence) const { return find(sequence) != nullptr; }
+
+    /// Newest sequence inserted, only meaningful once empty() is false
+    Sequence newest_sequence() const { return newest; }
+    bool empty() const { return !has_newest; }
+    static constexpr size_t size() { return N; }
+
+private:
+    /// Frees the slots of the sequences after from and before to
+    void clear_between(Sequence from, Sequence to) {
+        auto gap = static_cast<Sequence>(to - from - 1);
+
+        if (gap >= N) {
+            occupied.fill(false);
+            return;
+        }
+
+        for (auto sequence = static_cast<Sequence>(from + 1); sequence != to; ++sequence) {
+            occupied[sequence & (N - 1)] = false;
+        }
+    }
+
+    std::array<T, N> entries = {};
+    std::array<Sequence, N> sequences = {};
+    std::array<bool, N> occupied = {};
+    Sequence newest = 0;
+    bool has_newest = false;
+};
+}
+
+#endif //DUCKLIB_SEQUENCE_BUFFER_H
@@ -1,38 +1,30 @@
 #ifndef DUCKLIB_SERIALIZATION_H
 #define DUCKLIB_SERIALIZATION_H
 #include <cassert>
+#include <cstdint>
 #include <concepts>
 #include <span>
 #include <algorithm>
 #include <cmath>
 #include <bit>
+#include <numbers>
+#include <type_traits>
+
+#include "ducklib/core/math.h"
+#include "byte_order.h"
 
 namespace ducklib::net {
 #define DL_NET_CHECK(expr) \
     do { \
         [[unlikely]] \
-        if (!expr) { \
+        if (!(expr)) { \
             return false; \
         } \
     } while (false)
 
-template <typename T>
-auto host_to_net(T value) -> T {
-    if constexpr (std::endian::native == std::endian::little) {
-        return std::byteswap(value);
-    } else {
-        return value;
-    }
-}
-
 using ScratchType = uint64_t;
 constexpr uint8_t SCRATCH_SIZE_BITS = sizeof(ScratchType) * 8;
 
-template <typename T>
-auto net_to_host(T value) -> T {
-    return host_to_net(value);
-}
-
 struct NetWriteStream {
     std::span<std::byte> buffer;
     uint32_t bits_written = 0; // Not including scratch_bits
@@ -46,6 +38,10 @@ struct NetWriteStream {
     template <std::integral T>
     bool serialize_value(T value, uint8_t bits);
     bool serialize_data(std::byte* data, uint32_t data_bit_size);
+    /**
+     * @brief Writes count values of bits (1-32) each, same bitstream as calling serialize_value for every value.
+     */
+    bool serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits);
     void align_to_byte();
     uint16_t bits_left() const;
     /**
@@ -74,14 +70,14 @@ bool NetWriteStream::serialize_value(T value, uint8_t bits) {
     }
 
     auto remaining_scratch_bits = static_cast<uint8_t>(SCRATCH_SIZE_BITS - scratch_bits);
-    auto mask = ~0ULL >> (SCRATCH_SIZE_BITS - bits);
-    scratch |= (value & mask) << scratch_bits;
+    auto masked_value = static_cast<ScratchType>(value) & (~0ULL >> (SCRATCH_SIZE_BITS - bits));
+    scratch |= masked_value << scratch_bits;
     auto spill_bits = static_cast<uint8_t>(bits < remaining_scratch_bits ? 0 : bits - remaining_scratch_bits);
     scratch_bits += bits - spill_bits;
 
     if (spill_bits > 0) {
         DL_NET_CHECK(flush_scratch());
-        scratch = value >> remaining_scratch_bits;
+        scratch = masked_value >> remaining_scratch_bits;
         scratch_bits = spill_bits;
         return true;
     }
@@ -106,9 +102,16 @@ struct NetReadStream {
     template <std::integral T>
     bool serialize_value(T& value, uint8_t bits);
     bool serialize_data(std::byte* data, uint16_t data_bit_size);
+    bool serialize_packed(uint32_t* values, uint32_t count, uint8_t bits);
+    /**
+     * @brief Returns the next byte_size bytes as a view into the buffer instead of copying them.
+     * @return false if the stream is not byte aligned or the bytes are not there
+     */
+    bool serialize_view(std::span<const std::byte>& view, uint16_t byte_size);
     void align_to_byte();
     uint16_t bits_left() const;
     bool read_scratch(); // Requires bits_read to be up to date but not scratch_bits_consumed
+    void seek(uint32_t position); // Moves the read position forward to position (in bits)
 
     static constexpr bool can_write() { return false; }
     static constexpr bool can_read() { return true; }
@@ -117,6 +120,11 @@ struct NetReadStream {
 template <std::integral T>
 bool NetReadStream::serialize_value(T& value, uint8_t bits) {
     assert(bits > 0);
+
+    [[unlikely]]
+    if (bits > bits_left()) {
+        return false;
+    }
     
     [[unlikely]]
     if (scratch_bits_consumed >= scratch_bits) {
@@ -141,6 +149,75 @@ bool NetReadStream::serialize_value(T& value, uint8_t bits) {
     return true;
 }
 
+/**
+ * @brief Runs serialize functions without a buffer and only counts the bits they would take.
+ * @details Behaves as a writing stream so serialize functions read the values being measured. Alignment is counted
+ * as the worst case (7 bits) since the final position in the packet is not known while measuring.
+ */
+struct NetMeasureStream {
+    uint32_t bits_measured = 0;
+    uint32_t bit_budget = UINT16_MAX;
+
+    NetMeasureStream() = default;
+    explicit NetMeasureStream(uint32_t bit_budget)
+        : bit_budget(bit_budget) {}
+
+    template <std::integral T>
+    bool serialize_value(T value, uint8_t bits);
+    bool serialize_data(std::byte* data, uint32_t data_bit_size);
+    bool serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits);
+    void align_to_byte();
+    uint16_t bits_left() const;
+
+    static constexpr bool can_write() { return true; }
+    static constexpr bool can_read() { return false; }
+};
+
+template <std::integral T>
+bool NetMeasureStream::serialize_value(T, uint8_t bits) {
+    assert(bits > 0);
+
+    [[unlikely]]
+    if (bits > bits_left()) {
+        return false;
+    }
+
+    bits_measured += bits;
+    return true;
+}
+
+inline bool NetMeasureStream::serialize_data(std::byte*, uint32_t data_bit_size) {
+    assert(data_bit_size > 0);
+
+    [[unlikely]]
+    if (data_bit_size > bits_left()) {
+        return false;
+    }
+
+    bits_measured += data_bit_size;
+    return true;
+}
+
+inline bool NetMeasureStream::serialize_packed(const uint32_t*, uint32_t count, uint8_t bits) {
+    assert(bits > 0 && bits <= 32);
+
+    [[unlikely]]
+    if (count * bits > bits_left()) {
+        return false;
+    }
+
+    bits_measured += count * bits;
+    return true;
+}
+
+inline void NetMeasureStream::align_to_byte() {
+    bits_measured += 7;
+}
+
+inline uint16_t NetMeasureStream::bits_left() const {
+    return bits_measured >= bit_budget ? 0 : static_cast<uint16_t>(std::min(bit_budget - bits_measured, 0xffffU));
+}
+
 template <typename StreamType, std::integral T>
 bool serialize_int(StreamType& stream, T& value) {
     DL_NET_CHECK(stream.serialize_value(value, sizeof(T) * 8));
@@ -168,11 +245,362 @@ bool serialize_int(StreamType& stream, T& value, T min, T max) {
     return true;
 }
 
+/**
+ * @brief Serializes every value in [min, max] with the bulk packing kernel. Produces the same bitstream as calling
+ * serialize_int(stream, value, min, max) for each element, and fails without writing if the whole array does not fit.
+ */
+template <typename StreamType, std::integral T>
+bool serialize_int_array(StreamType& stream, std::span<T> values, T min, T max) {
+    assert(min < max);
+    auto bits = static_cast<uint8_t>(std::bit_width(static_cast<uint64_t>(max - min)));
+
+    [[unlikely]]
+    if (values.size() * bits > stream.bits_left()) {
+        return false;
+    }
+
+    [[unlikely]]
+    if (bits > 32) {
+        for (auto& value : values) {
+            DL_NET_CHECK(serialize_int(stream, value, min, max));
+        }
+
+        return true;
+    }
+
+    constexpr size_t CHUNK_SIZE = 64;
+    uint32_t relative_values[CHUNK_SIZE];
+
+    for (size_t offset = 0; offset < values.size(); offset += CHUNK_SIZE) {
+        auto count = static_cast<uint32_t>(std::min(CHUNK_SIZE, values.size() - offset));
+
+        if constexpr (stream.can_write()) {
+            for (auto i = 0U; i < count; ++i) {
+                assert(min <= values[offset + i] && values[offset + i] <= max);
+                relative_values[i] = static_cast<uint32_t>(values[offset + i] - min);
+            }
+        }
+
+        DL_NET_CHECK(stream.serialize_packed(relative_values, count, bits));
+
+        if constexpr (stream.can_read()) {
+            for (auto i = 0U; i < count; ++i) {
+                values[offset + i] = static_cast<T>(relative_values[i] + min);
+                assert(min <= values[offset + i] && values[offset + i] <= max);
+            }
+        }
+    }
+
+    return true;
+}
+
+template <typename StreamType>
+bool serialize_bool(StreamType& stream, bool& value) {
+    DL_NET_CHECK(stream.serialize_value(value, 1));
+    return true;
+}
+
+template <std::integral T>
+auto zigzag_encode(T value) -> std::make_unsigned_t<T> {
+    using UnsignedType = std::make_unsigned_t<T>;
+
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<UnsignedType>(static_cast<UnsignedType>(value) << 1)
+            ^ static_cast<UnsignedType>(value >> (sizeof(T) * 8 - 1));
+    } else {
+        return value;
+    }
+}
+
+template <std::integral T>
+auto zigzag_decode(std::make_unsigned_t<T> value) -> T {
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<T>((value >> 1) ^ (~(value & 1) + 1));
+    } else {
+        return value;
+    }
+}
+
+/**
+ * @brief Writes value in groups of group_bits bits, each followed by a continuation bit. Signed values are zigzag
+ * encoded first so small negative values stay small.
+ */
+template <typename StreamType, std::integral T>
+bool serialize_varint(StreamType& stream, T& value, uint8_t group_bits = 7) {
+    using UnsignedType = std::make_unsigned_t<T>;
+    constexpr auto VALUE_BITS = static_cast<uint32_t>(sizeof(T) * 8);
+    assert(group_bits > 0 && group_bits < VALUE_BITS);
+    const auto group_mask = static_cast<UnsignedType>(~0ULL >> (SCRATCH_SIZE_BITS - group_bits));
+    UnsignedType encoded = 0;
+    UnsignedType decoded = 0;
+
+    if constexpr (stream.can_write()) {
+        encoded = zigzag_encode(value);
+    }
+
+    for (auto shift = 0U; shift < VALUE_BITS; shift += group_bits) {
+        UnsignedType group = 0;
+        bool more = false;
+
+        if constexpr (stream.can_write()) {
+            group = static_cast<UnsignedType>(encoded >> shift) & group_mask;
+            more = shift + group_bits < VALUE_BITS && (encoded >> (shift + group_bits)) != 0;
+        }
+
+        DL_NET_CHECK(stream.serialize_value(group, group_bits));
+        DL_NET_CHECK(serialize_bool(stream, more));
+
+        if constexpr (stream.can_read()) {
+            decoded |= static_cast<UnsignedType>(group << shift);
+        }
+
+        if (!more) {
+            if constexpr (stream.can_read()) {
+                value = zigzag_decode<T>(decoded);
+            }
+
+            return true;
+        }
+    }
+
+    // Continuation bit set on the group holding the top bits
+    return false;
+}
+
 template <typename StreamType>
 bool serialize_data(StreamType& stream, std::byte* data, uint16_t data_bit_size) {
     DL_NET_CHECK(stream.serialize_data(data, data_bit_size));
     return true;
 }
+
+/**
+ * @brief Byte aligned blob, readers over pooled packets can take it as a view with serialize_data_view instead of a
+ * copy (see packet_buffer.h).
+ */
+template <typename StreamType>
+bool serialize_aligned_data(StreamType& stream, std::byte* data, uint16_t byte_size) {
+    stream.align_to_byte();
+
+    if (byte_size > 0) {
+        DL_NET_CHECK(stream.serialize_data(data, static_cast<uint16_t>(byte_size * 8)));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Number of steps serialize_float splits [min, max] into, usable in constant expressions.
+ */
+constexpr uint32_t quantized_float_steps(float min, float max, float resolution) {
+    auto exact_steps = (max - min) / resolution;
+    auto steps = static_cast<uint32_t>(exact_steps);
+    return static_cast<float>(steps) < exact_steps ? steps + 1 : steps;
+}
+
+/**
+ * @brief Step in [0, quantized_float_steps] serialize_float writes for value.
+ */
+inline uint32_t quantized_float_step(float value, float min, float max, float resolution) {
+    assert(min < max && resolution > 0.0f);
+    auto steps = quantized_float_steps(min, max, resolution);
+    auto normalized = std::clamp((value - min) / (max - min), 0.0f, 1.0f);
+    return static_cast<uint32_t>(std::floor(normalized * static_cast<float>(steps) + 0.5f));
+}
+
+/**
+ * @brief Returns the value a reader gets back after serialize_float with the same bounds and resolution.
+ */
+inline float quantize_float(float value, float min, float max, float resolution) {
+    auto steps = quantized_float_steps(min, max, resolution);
+    auto quantized = quantized_float_step(value, min, max, resolution);
+    return min + (max - min) * (static_cast<float>(quantized) / static_cast<float>(steps));
+}
+
+template <typename StreamType>
+bool serialize_float(StreamType& stream, float& value) {
+    uint32_t bits = 0;
+
+    if constexpr (stream.can_write()) {
+        bits = std::bit_cast<uint32_t>(value);
+    }
+
+    DL_NET_CHECK(stream.serialize_value(bits, 32));
+
+    if constexpr (stream.can_read()) {
+        value = std::bit_cast<float>(bits);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Serializes value as an integer step in [min, max] with at most resolution between steps.
+ */
+template <typename StreamType>
+bool serialize_float(StreamType& stream, float& value, float min, float max, float resolution) {
+    assert(min < max && resolution > 0.0f);
+    auto steps = quantized_float_steps(min, max, resolution);
+    uint32_t quantized = 0;
+
+    if constexpr (stream.can_write()) {
+        assert(min <= value && value <= max);
+        quantized = quantized_float_step(value, min, max, resolution);
+    }
+
+    DL_NET_CHECK(serialize_int(stream, quantized, 0U, steps));
+
+    if constexpr (stream.can_read()) {
+        value = min + (max - min) * (static_cast<float>(quantized) / static_cast<float>(steps));
+    }
+
+    return true;
+}
+
+template <typename StreamType>
+bool serialize_vector3(StreamType& stream, Vector3& value, float min, float max, float resolution) {
+    DL_NET_CHECK(serialize_float(stream, value.x, min, max, resolution));
+    DL_NET_CHECK(serialize_float(stream, value.y, min, max, resolution));
+    DL_NET_CHECK(serialize_float(stream, value.z, min, max, resolution));
+    return true;
+}
+
+/**
+ * @brief Smallest-three quaternion compression: 2 bits for the index of the largest component and component_bits
+ * for each of the other three, which are bounded by [-1/sqrt(2), 1/sqrt(2)]. Expects a normalized quaternion.
+ * @details The largest component is always reconstructed as positive, so the result may be -q (same rotation).
+ */
+template <typename StreamType>
+bool serialize_quaternion(StreamType& stream, Quaternion& value, uint8_t component_bits = 10) {
+    assert(component_bits > 1 && component_bits <= 16);
+    constexpr auto component_bound = std::numbers::sqrt2_v<float> / 2.0f;
+    const auto max_quantized = static_cast<float>((1U << component_bits) - 1);
+    uint32_t largest_index = 0;
+    uint32_t quantized[3] = {};
+
+    if constexpr (stream.can_write()) {
+        float components[4] = { value.x, value.y, value.z, value.w };
+
+        for (auto i = 1U; i < 4; ++i) {
+            if (std::abs(components[i]) > std::abs(components[largest_index])) {
+                largest_index = i;
+            }
+        }
+
+        auto sign = components[largest_index] < 0.0f ? -1.0f : 1.0f;
+
+        for (auto i = 0U, j = 0U; i < 4; ++i) {
+            if (i == largest_index) {
+                continue;
+            }
+
+            auto normalized = std::clamp((components[i] * sign + component_bound) / (2.0f * component_bound), 0.0f, 1.0f);
+            quantized[j++] = static_cast<uint32_t>(std::floor(normalized * max_quantized + 0.5f));
+        }
+    }
+
+    DL_NET_CHECK(stream.serialize_value(largest_index, 2));
+    DL_NET_CHECK(stream.serialize_value(quantized[0], component_bits));
+    DL_NET_CHECK(stream.serialize_value(quantized[1], component_bits));
+    DL_NET_CHECK(stream.serialize_value(quantized[2], component_bits));
+
+    if constexpr (stream.can_read()) {
+        float components[4] = {};
+        auto sum_squares = 0.0f;
+
+        for (auto i = 0U, j = 0U; i < 4; ++i) {
+            if (i == largest_index) {
+                continue;
+            }
+
+            components[i] = static_cast<float>(quantized[j++]) / max_quantized * (2.0f * component_bound) - component_bound;
+            sum_squares += components[i] * components[i];
+        }
+
+        components[largest_index] = std::sqrt(std::max(0.0f, 1.0f - sum_squares));
+        value = { components[0], components[1], components[2], components[3] };
+    }
+
+    return true;
+}
+
+/*
+ * Relative serializers write a changed bit per field and, when the field differs from the baseline, how far it moved:
+ * the difference in steps (integers, or quantized steps for floats) as a varint in groups of RELATIVE_GROUP_BITS. An
+ * unchanged field costs one bit and a field that moved by under 8 steps six, the same for every range. A jump across
+ * most of a 32 bit range costs up to 46 bits. The reader must pass the same baseline and bounds, differences that
+ * leave the bounds fail the read.
+ */
+
+constexpr uint8_t RELATIVE_GROUP_BITS = 4;
+
+template <typename StreamType, std::integral T>
+bool serialize_int_relative(StreamType& stream, T& value, T baseline, T min, T max) {
+    static_assert(sizeof(T) <= sizeof(uint32_t), "Differences are taken in 64 bits");
+    bool changed = false;
+    int64_t difference = 0;
+
+    if constexpr (stream.can_write()) {
+        assert(min <= value && value <= max);
+        changed = value != baseline;
+        difference = static_cast<int64_t>(value) - static_cast<int64_t>(baseline);
+    }
+
+    DL_NET_CHECK(serialize_bool(stream, changed));
+
+    if (changed) {
+        DL_NET_CHECK(serialize_varint(stream, difference, RELATIVE_GROUP_BITS));
+    }
+
+    if constexpr (stream.can_read()) {
+        auto read_value = static_cast<int64_t>(baseline) + difference;
+        DL_NET_CHECK(static_cast<int64_t>(min) <= read_value && read_value <= static_cast<int64_t>(max));
+        value = static_cast<T>(read_value);
+    }
+
+    return true;
+}
+
+template <typename StreamType>
+bool serialize_float_relative(StreamType& stream, float& value, float baseline, float min, float max, float resolution) {
+    auto steps = quantized_float_steps(min, max, resolution);
+    auto baseline_step = quantized_float_step(baseline, min, max, resolution);
+    bool changed = false;
+    int64_t difference = 0;
+
+    if constexpr (stream.can_write()) {
+        assert(min <= value && value <= max);
+        difference = static_cast<int64_t>(quantized_float_step(value, min, max, resolution)) - baseline_step;
+        changed = difference != 0;
+    }
+
+    DL_NET_CHECK(serialize_bool(stream, changed));
+
+    if (changed) {
+        DL_NET_CHECK(serialize_varint(stream, difference, RELATIVE_GROUP_BITS));
+    }
+
+    if constexpr (stream.can_read()) {
+        auto step = static_cast<int64_t>(baseline_step) + difference;
+        DL_NET_CHECK(0 <= step && step <= static_cast<int64_t>(steps));
+        value = min + (max - min) * (static_cast<float>(step) / static_cast<float>(steps));
+    }
+
+    return true;
+}
+
+template <typename StreamType>
+bool serialize_vector3_relative(
+    StreamType& stream,
+    Vector3& value,
+    const Vector3& baseline,
+    float min,
+    float max,
+    float resolution) {
+    DL_NET_CHECK(serialize_float_relative(stream, value.x, baseline.x, min, max, resolution));
+    DL_NET_CHECK(serialize_float_relative(stream, value.y, baseline.y, min, max, resolution));
+    DL_NET_CHECK(serialize_float_relative(stream, value.z, baseline.z, min, max, resolution));
+    return true;
+}
 }
 
 #endif //DUCKLIB_SERIALIZATION_H
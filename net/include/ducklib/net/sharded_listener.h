@@ -0,0 +1,104 @@
+#ifndef DUCKLIB_SHARDED_LISTENER_H
+#define DUCKLIB_SHARDED_LISTENER_H
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "connection.h"
+#include "socket.h"
+
+namespace ducklib::net {
+/*
+ * Server socket split into shards, each a socket bound to the same port with SO_REUSEPORT plus a NetReactor on its
+ * own network thread. The kernel spreads senders over the sockets, so packet handling scales with the shard count.
+ *
+ * A sender keeps landing on the same shard, so every Connection lives on the shard that got its first packet and is
+ * only ever touched by that shard's thread. The accept and tick callbacks run on the shard threads, one shard never
+ * sees another's connections:
+ *
+ *   ShardedListener listener(20020);
+ *   listener.start(
+ *       [](uint32_t shard, const Address& from, std::span<const std::byte> packet) { return true; },
+ *       [](uint32_t shard, ShardedListener::ShardConnections& connections) { ... queue messages ... });
+ *
+ * Without SO_REUSEPORT (anything but Linux) there is a single shard.
+ */
+
+struct ShardedListenerConfig {
+    uint32_t shard_count = 0; ///< 0 uses one per hardware thread
+    /// Picks the shard from a hash of the sender address and port with a BPF program instead of the kernel's hash of
+    /// the full address tuple, so the shard a sender lands on is known up front (see steered_shard)
+    bool steer_by_source = true;
+    bool pin_threads = true; ///< Pins the thread of shard i to core i, Linux only
+    uint32_t protocol_id = DEFAULT_PROTOCOL_ID;
+    std::chrono::milliseconds max_wait{ 10 }; ///< Longest a shard sleeps between ticks, also bounds how long stop takes
+};
+
+class ShardedListener {
+public:
+    using ShardConnections = std::unordered_map<Address, std::unique_ptr<Connection>>;
+    /// Decides whether a datagram from an address without a connection opens one, only asked for ones that pass the
+    /// CRC check for the configured protocol id
+    using AcceptCallback = std::function<bool(uint32_t shard, const Address& from, std::span<const std::byte> packet)>;
+    /// Runs after every reactor pass of a shard
+    using TickCallback = std::function<void(uint32_t shard, ShardConnections& connections)>;
+
+    explicit ShardedListener(uint16_t port, const ShardedListenerConfig& config = {});
+    ShardedListener(const ShardedListener& other) = delete;
+    ~ShardedListener();
+
+    ShardedListener& operator=(const ShardedListener& other) = delete;
+
+    /**
+     * @brief Starts one network thread per shard.
+     * @return false if already running or no socket could be bound
+     */
+    bool start(AcceptCallback accept, TickCallback tick = {});
+    /// Joins the network threads, connections are kept until the listener is destroyed
+    void stop();
+    /// Drops the connection after the current tick, call from the callbacks of the shard it is on
+    void disconnect(uint32_t shard, const Address& remote);
+
+    [[nodiscard]]
+    auto get_port() const -> uint16_t { return port; }
+    [[nodiscard]]
+    auto shard_count() const -> uint32_t { return static_cast<uint32_t>(shards.size()); }
+    /// Whether the BPF steering program is attached, otherwise the kernel hashes the full address tuple
+    [[nodiscard]]
+    bool is_steered() const { return steered; }
+    /// Safe to read from any thread
+    [[nodiscard]]
+    auto connection_count(uint32_t shard) const -> size_t;
+    /// Datagrams received by a shard, safe to read from any thread
+    [[nodiscard]]
+    auto received_count(uint32_t shard) const -> uint64_t;
+
+    /// The shard a datagram from sender goes to when the listener is steered
+    static auto steered_shard(const Address& sender, uint32_t shard_count) -> uint32_t;
+
+private:
+    struct Shard;
+
+    bool attach_steering_program();
+    void run_shard(Shard& shard);
+    void accept_connection(
+        Shard& shard,
+        const Address& from,
+        std::span<const std::byte> packet,
+        ReceiveTime received_at);
+
+    ShardedListenerConfig config;
+    uint16_t port = 0;
+    bool steered = false;
+    bool running = false;
+    std::vector<std::unique_ptr<Shard>> shards;
+    AcceptCallback on_accept;
+    TickCallback on_tick;
+};
+}
+
+#endif //DUCKLIB_SHARDED_LISTENER_H
@@ -3,7 +3,12 @@
 
 #include <string>
 #include <cstdint>
+#include <functional>
+#if defined(_WIN32)
 #include <winsock.h>
+#else
+#include <netinet/in.h>
+#endif
 
 namespace ducklib::net {
 constexpr uint16_t MTU = 1200;
@@ -17,12 +22,23 @@ public:
     [[nodiscard]] auto get_port() const -> uint16_t;
     [[nodiscard]] auto get_address() const -> std::string;
     [[nodiscard]] auto as_sockaddr_in() const -> sockaddr_in; // TODO: Consider moving these to NetClient
+    /// Address and port packed into one value, for hashing
+    [[nodiscard]] auto as_key() const -> uint64_t { return static_cast<uint64_t>(addr_v4_int) << 16 | port; }
+
+    bool operator==(const Address& other) const = default;
 
 private:
-    uint32_t addr_v4_int;
-    uint16_t port;
+    uint32_t addr_v4_int = 0;
+    uint16_t port = 0;
 };
 
 inline auto Address::get_port() const -> uint16_t { return port; }
 }
+
+template <>
+struct std::hash<ducklib::net::Address> {
+    size_t operator()(const ducklib::net::Address& address) const noexcept {
+        return std::hash<uint64_t>{}(address.as_key());
+    }
+};
 #endif // SHARED_H
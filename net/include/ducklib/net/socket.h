@@ -2,12 +2,27 @@
 #define SOCKET_H
 
 #include <span>
-#include <winsock2.h>
+#include "packet_buffer.h"
 #include "shared.h"
+#include "transport.h"
+
+#if defined(__linux__)
+#define DL_NET_SOCKET_MMSG 1 // Batches go through sendmmsg/recvmmsg, elsewhere they loop over send/receive
+#define DL_NET_SOCKET_UDP_OFFLOAD 1 // UDP_SEGMENT/UDP_GRO can be enabled, elsewhere enable_gso/enable_gro fail
+#define DL_NET_SOCKET_REUSEPORT 1 // SO_REUSEPORT spreads datagrams over sockets sharing a port, elsewhere it is refused
+#define DL_NET_SOCKET_TIMESTAMPS 1 // Kernel receive timestamps can be enabled, elsewhere enable_timestamps fails
+#endif
 
 namespace ducklib::net
 {
-class Socket
+constexpr size_t MAX_SEGMENTED_SIZE = 65507; // Largest UDP payload over IPv4, bounds GSO sends and GRO receives
+
+struct SocketOptions {
+    /// Lets several sockets bind the same port, the kernel then spreads senders between them (see ShardedListener)
+    bool reuse_port = false;
+};
+
+class Socket : public Transport
 {
 public:
     Socket() = delete;
@@ -16,15 +31,71 @@ public:
     /**
      *\param bindPort Port to bind socket to. 0 = port assigned by OS.
      */
-    explicit Socket(uint16_t bindPort = 0);
-    ~Socket();
+    explicit Socket(uint16_t bindPort = 0, const SocketOptions& options = {});
+    ~Socket() override;
 
     [[nodiscard]]
-    auto get_port() const -> uint16_t;
+    auto get_port() const -> uint16_t override;
+    [[nodiscard]]
+    auto get_handle() const -> SocketHandle override { return socket_handle; }
 
     [[nodiscard]]
-    auto send(Address to, std::span<const std::byte> data) const -> size_t;
-    auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t;
+    auto send(Address to, std::span<const std::byte> data) const -> size_t override;
+    auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t override;
+    /**
+     * @param received_at Kernel receive timestamp if enabled (see enable_timestamps), otherwise when it was read
+     */
+    auto receive(Address& from, std::span<std::byte> receive_buffer, ReceiveTime& received_at) const -> size_t;
+    /**
+     * @brief Receives straight into a buffer from pool.
+     * @return An empty ref if nothing was received or every buffer in the pool is in use
+     */
+    auto receive(Address& from, PacketBufferPool& pool) const -> PacketRef;
+    /**
+     * @brief Sends packets with as few system calls as the platform allows.
+     * @return How many packets from the front of packets were sent
+     */
+    auto send_batch(std::span<const OutgoingPacket> packets) const -> size_t override;
+    /**
+     * @brief Receives up to packets.size() datagrams that are already waiting, each into the buffer of its entry.
+     * @return How many entries from the front of packets were filled
+     */
+    auto receive_batch(std::span<IncomingPacket> packets) const -> size_t override;
+
+    /**
+     * @brief Opts in to UDP generic segmentation offload, send_segmented then hands the kernel up to 64 segments in
+     * one buffer. Needs Linux 4.18.
+     * @return False if the kernel lacks support, send_segmented keeps sending one datagram per segment
+     */
+    auto enable_gso() -> bool;
+    /**
+     * @brief Opts in to UDP generic receive offload, the kernel may then coalesce datagrams from one sender into a
+     * single receive of equally sized segments. Needs Linux 5.0. Once enabled, receive with receive_segmented and a
+     * buffer of MAX_SEGMENTED_SIZE bytes, receive and receive_batch would truncate coalesced datagrams.
+     * @return False if the kernel lacks support, receive_segmented keeps returning one datagram per call
+     */
+    auto enable_gro() -> bool;
+    /**
+     * @brief Sends data to one peer as datagrams of segment_size bytes, the last one can be shorter.
+     * @return Bytes sent, always a whole number of segments unless everything was sent
+     */
+    auto send_segmented(Address to, std::span<const std::byte> data, uint16_t segment_size) const -> size_t;
+    /**
+     * @brief Receives one datagram, or with GRO enabled several coalesced ones. They sit back to back in
+     * receive_buffer, every one segment_size bytes except the last which can be shorter.
+     * @return Bytes received, 0 if nothing was waiting
+     */
+    auto receive_segmented(Address& from, std::span<std::byte> receive_buffer, uint16_t& segment_size) const -> size_t;
+
+    /**
+     * @brief Has the kernel timestamp datagrams as they arrive (SO_TIMESTAMPNS), so receive times leave out how long
+     * they waited in the socket buffer. Needs Linux. The first socket to enable them turns stamping on for the whole
+     * system a few milliseconds later, datagrams before then get stamped when read.
+     * @param hardware Asks for NIC timestamps as well (SO_TIMESTAMPING), used when the NIC has hardware timestamping
+     * turned on and its clock is synced to the system clock (e.g. by phc2sys), software ones otherwise
+     * @return False if the platform lacks support, receive times stay the time of reading
+     */
+    auto enable_timestamps(bool hardware = false) -> bool;
 
     // TODO: Consider adding a Close() function
 
@@ -32,8 +103,13 @@ public:
     auto operator=(Socket&& other) noexcept -> Socket& = delete;
 
 private:
-    SOCKET socket_handle;
+    auto send_segments_batched(Address to, std::span<const std::byte> data, uint16_t segment_size) const -> size_t;
+
+    SocketHandle socket_handle;
     Address address;
+    mutable bool use_gso = false; // Turned off again if the route cannot segment
+    bool use_gro = false;
+    bool use_timestamps = false;
 };
 }
 
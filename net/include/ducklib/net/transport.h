@@ -0,0 +1,69 @@
+#ifndef DUCKLIB_TRANSPORT_H
+#define DUCKLIB_TRANSPORT_H
+#include <chrono>
+#include <optional>
+#include <span>
+#if defined(_WIN32)
+#include <winsock2.h>
+#endif
+#include "shared.h"
+
+namespace ducklib::net {
+#if defined(_WIN32)
+using SocketHandle = SOCKET;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif
+
+struct OutgoingPacket {
+    Address to = {};
+    std::span<const std::byte> data = {};
+};
+
+/// Receive times are on steady_clock, the clock connections keep their timers on
+using ReceiveTime = std::chrono::steady_clock::time_point;
+
+struct IncomingPacket {
+    Address from = {};
+    std::span<std::byte> buffer = {}; ///< Where to receive the datagram, set by the caller
+    size_t size = 0; ///< Received bytes
+    ReceiveTime received_at = {}; ///< Kernel receive timestamp if enabled (see Socket::enable_timestamps), otherwise when read
+};
+
+/*
+ * What a Connection sends and receives datagrams through. Socket is the real one, others wrap a socket
+ * (LinkConditioner) or stand in for one.
+ *
+ * Calls follow Socket: sends return the bytes sent or -1 cast to size_t, receives return 0 when nothing is waiting and
+ * never block.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    [[nodiscard]]
+    virtual auto get_port() const -> uint16_t = 0;
+    /// What to wait on for received datagrams, INVALID_SOCKET_HANDLE if there is nothing to wait on
+    [[nodiscard]]
+    virtual auto get_handle() const -> SocketHandle = 0;
+    /// When the transport has datagrams due that its handle will not signal, e.g. ones it delayed itself
+    [[nodiscard]]
+    virtual auto next_wakeup() const -> std::optional<ReceiveTime> { return std::nullopt; }
+
+    [[nodiscard]]
+    virtual auto send(Address to, std::span<const std::byte> data) const -> size_t = 0;
+    virtual auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t = 0;
+    /**
+     * @return How many packets from the front of packets were sent
+     */
+    virtual auto send_batch(std::span<const OutgoingPacket> packets) const -> size_t = 0;
+    /**
+     * @return How many entries from the front of packets were filled
+     */
+    virtual auto receive_batch(std::span<IncomingPacket> packets) const -> size_t = 0;
+};
+}
+
+#endif //DUCKLIB_TRANSPORT_H
@@ -0,0 +1,161 @@
+#ifndef DUCKLIB_URING_SOCKET_H
+#define DUCKLIB_URING_SOCKET_H
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "socket.h"
+
+#if defined(__linux__)
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+struct msghdr;
+
+namespace ducklib::net {
+/*
+ * Socket driven by io_uring. A multishot receive stays armed on the socket and lands datagrams in a ring of buffers
+ * the kernel picks from, sends are copied into send slots and go to the kernel together with one io_uring_enter per
+ * send_batch.
+ *
+ * It is a Transport, so a Connection or NetReactor can use it in place of a Socket, its handle being the ring itself,
+ * which is readable while completions are waiting. It also has a completion API that hands datagrams to a callback as
+ * views into the receive buffers, which go back to the kernel when the callback returns:
+ *
+ *   auto socket = UringSocket(20020);
+ *   while (running) {
+ *       socket.wait([&](const Address& from, std::span<const std::byte> data) { ... }, 16ms);
+ *       ... socket.send(to, packet) ...
+ *   }
+ *
+ * Kernels without io_uring, multishot receive or provided buffer rings (before 6.0) get a plain Socket underneath,
+ * is_using_uring tells which one it is. Not thread safe.
+ */
+
+struct UringSocketConfig {
+    uint32_t queue_depth = 256; ///< Submission queue entries, sends queued past this submit early
+    uint32_t receive_buffer_count = 256; ///< Power of two
+    uint32_t receive_buffer_size = 2048; ///< Has to fit the datagram plus a header and the sender address
+    uint32_t send_slot_count = 256; ///< Sends in flight at once
+    uint32_t send_slot_size = DEFAULT_PACKET_BUFFER_SIZE;
+};
+
+class UringSocket : public Transport {
+public:
+    using ReceiveCallback = std::function<void(const Address& from, std::span<const std::byte> data)>;
+
+    explicit UringSocket(uint16_t bind_port, const UringSocketConfig& config = {});
+    UringSocket(const UringSocket& other) = delete;
+    ~UringSocket() override;
+
+    UringSocket& operator=(const UringSocket& other) = delete;
+
+    /**
+     * @brief Whether this kernel supports everything UringSocket needs.
+     */
+    static bool is_supported();
+    [[nodiscard]]
+    bool is_using_uring() const { return ring_fd >= 0; }
+
+    [[nodiscard]]
+    auto get_port() const -> uint16_t override { return socket.get_port(); }
+    /// The ring when using io_uring, otherwise the socket underneath
+    [[nodiscard]]
+    auto get_handle() const -> SocketHandle override { return is_using_uring() ? ring_fd : socket.get_handle(); }
+
+    /**
+     * @brief Copies data into a send slot and submits it.
+     * @return data.size() once submitted, -1 cast to size_t if it is larger than a send slot or every slot is in flight
+     */
+    [[nodiscard]]
+    auto send(Address to, std::span<const std::byte> data) const -> size_t override;
+    /**
+     * @brief Copies out the next received datagram, handling completions as needed.
+     * @return Bytes received, 0 if nothing is waiting
+     */
+    auto receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t override;
+    /**
+     * @brief Copies every packet into a send slot and submits them all at once.
+     * @return How many packets from the front of packets were sent
+     */
+    auto send_batch(std::span<const OutgoingPacket> packets) const -> size_t override;
+    /**
+     * @return How many entries from the front of packets were filled
+     */
+    auto receive_batch(std::span<IncomingPacket> packets) const -> size_t override;
+
+    /**
+     * @brief Submits queued sends without waiting for anything.
+     */
+    bool flush() const;
+    /**
+     * @brief Submits queued sends and handles every completion that is ready, calling on_receive for each datagram.
+     * @return Datagrams handed to on_receive
+     */
+    auto poll(const ReceiveCallback& on_receive) const -> size_t;
+    /**
+     * @brief Like poll, but first sleeps until something completes or timeout passes.
+     */
+    auto wait(const ReceiveCallback& on_receive, std::chrono::milliseconds timeout) const -> size_t;
+
+private:
+    struct SendSlot;
+
+    bool setup_ring(const UringSocketConfig& config);
+    void teardown_ring();
+    bool setup_receive_buffers(const UringSocketConfig& config);
+    io_uring_sqe* next_sqe() const;
+    void arm_receive() const;
+    bool submit(uint32_t wait_count, std::chrono::milliseconds timeout) const;
+    /// Copies data into a free send slot and queues it without submitting
+    bool queue_send(Address to, std::span<const std::byte> data) const;
+    /**
+     * @brief Handles up to max_receives receive completions plus any send completions before them.
+     */
+    auto reap(const ReceiveCallback& on_receive, size_t max_receives) const -> size_t;
+    void recycle_receive_buffer(uint16_t buffer_id) const;
+    auto poll_socket(const ReceiveCallback& on_receive, size_t max_receives) const -> size_t;
+
+    Socket socket;
+    int ring_fd = -1;
+
+    // Submission and completion rings shared with the kernel
+    void* ring_memory = nullptr;
+    size_t ring_memory_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    uint32_t* sq_head = nullptr;
+    uint32_t* sq_tail = nullptr;
+    uint32_t* sq_array = nullptr;
+    uint32_t sq_mask = 0;
+    uint32_t sq_entries = 0;
+    mutable uint32_t sq_local_tail = 0; // Entries up to here are filled in, the kernel sees them once sq_tail is moved here
+    mutable uint32_t queued_sqes = 0;
+    uint32_t* cq_head = nullptr;
+    uint32_t* cq_tail = nullptr;
+    uint32_t cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    // Provided receive buffers
+    io_uring_buf_ring* buffer_ring = nullptr;
+    size_t buffer_ring_size = 0;
+    uint32_t buffer_ring_mask = 0;
+    mutable uint16_t buffer_ring_tail = 0;
+    std::unique_ptr<std::byte[]> receive_storage;
+    uint32_t receive_buffer_size = 0;
+    std::unique_ptr<msghdr> receive_message; // Tells the multishot receive how much room the address takes
+    mutable bool receive_armed = false;
+
+    std::unique_ptr<SendSlot[]> send_slots;
+    std::unique_ptr<std::byte[]> send_storage;
+    mutable std::vector<uint32_t> free_send_slots;
+    uint32_t send_slot_size = 0;
+    uint32_t send_slot_total = 0;
+};
+}
+#endif
+
+#endif //DUCKLIB_URING_SOCKET_H
@@ -0,0 +1,111 @@
+#include "ducklib/net/congestion_control.h"
+
+#include <algorithm>
+
+#include "ducklib/net/shared.h"
+
+namespace ducklib::net {
+namespace {
+constexpr std::chrono::duration<double> BURST_TIME = std::chrono::milliseconds(5);
+constexpr double MIN_BURST = 2.0 * MTU; // A full packet always fits, and one more so they can go out back to back
+constexpr uint32_t BACKOFF_NUMERATOR = 3; // Of 4
+constexpr uint32_t PROBE_DIVISOR = 16; // Probing raises the rate by 1/16 a round
+constexpr uint32_t MIN_PROBE = 1024;
+}
+
+void TokenBucket::set_rate(uint32_t new_rate, Clock::time_point now) {
+    refill(now);
+    auto was_unlimited = bytes_per_second == 0;
+    bytes_per_second = new_rate;
+    burst = std::max(MIN_BURST, new_rate * BURST_TIME.count());
+    tokens = was_unlimited ? burst : std::min(tokens, burst);
+    updated_at = std::max(updated_at, now);
+}
+
+auto TokenBucket::next_send_time() const -> Clock::time_point {
+    if (bytes_per_second == 0 || tokens >= 0.0) {
+        return updated_at;
+    }
+
+    auto debt = std::chrono::duration<double>(-tokens / bytes_per_second);
+    return updated_at + std::chrono::ceil<Clock::duration>(debt);
+}
+
+void TokenBucket::consume(uint32_t bytes, Clock::time_point now) {
+    refill(now);
+    tokens -= bytes;
+}
+
+void TokenBucket::refill(Clock::time_point now) {
+    // Receive timestamps can be a little older than the last send
+    if (now <= updated_at) {
+        return;
+    }
+
+    auto elapsed = std::chrono::duration<double>(now - updated_at).count();
+    tokens = std::min(burst, tokens + elapsed * bytes_per_second);
+    updated_at = now;
+}
+
+void CongestionController::on_packet_sent(uint32_t bytes) {
+    round_bytes += bytes;
+}
+
+void CongestionController::on_rtt_sample(std::chrono::microseconds rtt, Clock::time_point now) {
+    if (now - window_start >= BASE_RTT_WINDOW) {
+        previous_min_rtt = window_min_rtt;
+        window_min_rtt = std::chrono::microseconds::max();
+        window_start = now;
+    }
+
+    window_min_rtt = std::min(window_min_rtt, rtt);
+    auto delay = rtt - base_rtt();
+    queueing_delay = sampled ? (7 * queueing_delay + delay) / 8 : delay;
+    sampled = true;
+    adjust(now);
+}
+
+void CongestionController::on_packet_lost(Clock::time_point now) {
+    round_lost = true;
+    adjust(now);
+}
+
+auto CongestionController::rate() const -> uint32_t {
+    return enabled ? std::min(current_rate, ceiling()) : budget;
+}
+
+void CongestionController::set_budget(uint32_t bytes_per_second) {
+    budget = bytes_per_second;
+    current_rate = std::min(current_rate, ceiling());
+}
+
+auto CongestionController::base_rtt() const -> std::chrono::microseconds {
+    return std::min(window_min_rtt, previous_min_rtt);
+}
+
+void CongestionController::adjust(Clock::time_point now) {
+    auto round = sampled ? std::max(MIN_ROUND, base_rtt()) : MIN_ROUND;
+    auto elapsed = now - round_start;
+
+    if (elapsed < round) {
+        return;
+    }
+
+    auto target = std::max(DELAY_TARGET, sampled ? base_rtt() / 2 : std::chrono::microseconds::zero());
+
+    if (round_lost || queueing_delay > target) {
+        current_rate = std::max(MIN_RATE, current_rate / 4 * BACKOFF_NUMERATOR);
+    } else {
+        // Only a path that was kept busy tells anything about whether it could take more
+        auto round_capacity = current_rate * std::chrono::duration<double>(elapsed).count();
+
+        if (static_cast<double>(round_bytes) * 2.0 >= round_capacity) {
+            current_rate = std::min(ceiling(), current_rate + std::max(current_rate / PROBE_DIVISOR, MIN_PROBE));
+        }
+    }
+
+    round_start = now;
+    round_bytes = 0;
+    round_lost = false;
+}
+}
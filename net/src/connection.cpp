@@ -1,60 +1,479 @@
+#include <algorithm>
 #include <array>
+#include <bit>
 
 #include "ducklib/net/connection.h"
 #include "ducklib/net/serialization.h"
 
 namespace ducklib::net {
-Connection::Connection(std::string_view ip, uint16_t port, const std::shared_ptr<Socket>& socket)
-    : socket(socket), remote_address(Address(ip, port)) {}
+Connection::Connection(
+    std::string_view ip,
+    uint16_t port,
+    const std::shared_ptr<Transport>& transport,
+    uint32_t protocol_id)
+    : remote_address(Address(ip, port)), transport(transport), protocol_id(protocol_id) {
+    pacer.set_rate(congestion.rate(), Clock::now());
+    publish_stats();
+}
 
-Connection::Connection(std::string_view ip, uint16_t port)
-    : socket(std::make_shared<Socket>(Socket(0))), remote_address(Address(ip, port)) {}
+Connection::Connection(std::string_view ip, uint16_t port, uint32_t protocol_id)
+    : remote_address(Address(ip, port)), transport(std::make_shared<Socket>(Socket(0))), protocol_id(protocol_id) {
+    pacer.set_rate(congestion.rate(), Clock::now());
+    publish_stats();
+}
+
+Connection::Connection(const Address& remote_address, const std::shared_ptr<Transport>& transport, uint32_t protocol_id)
+    : remote_address(remote_address), transport(transport), protocol_id(protocol_id) {
+    pacer.set_rate(congestion.rate(), Clock::now());
+    publish_stats();
+}
 
 MessageIdType Connection::send_reliable(
     const std::byte* message_data,
-    uint16_t message_bit_size,
+    uint32_t message_bit_size,
     uint8_t type,
     bool ordered,
     uint8_t priority) {
+    auto byte_size = (message_bit_size + 7) / 8;
+    auto data = message_pool->acquire(byte_size);
+    memcpy(data.data(), message_data, byte_size);
+
+    if (message_bit_size > MAX_MESSAGE_BITS) {
+        assert(message_bit_size <= MAX_FRAGMENTED_MESSAGE_SIZE * 8 && "Message is too large even for slices");
+        fragment_sender.queue(std::move(data), message_bit_size, type);
+        return channel_message_counter[type]++;
+    }
+
+    return queue_message(
+        std::move(data),
+        static_cast<uint16_t>(message_bit_size),
+        type,
+        priority,
+        ordered ? RELIABLE_ORDERED : RELIABLE);
+}
+
+void Connection::set_message_pool(const std::shared_ptr<MessagePool>& pool) {
+    assert(message_send_queue.empty() && pending_messages.empty() && !fragment_sender.is_sending()
+        && !fragment_receiver.is_receiving() && "Queued messages still use the previous pool");
+    message_pool = pool;
+}
+
+void Connection::set_bandwidth_budget(uint32_t bytes_per_second) {
+    congestion.set_budget(bytes_per_second);
+    pacer.set_rate(congestion.rate(), Clock::now());
+}
+
+void Connection::set_congestion_control(bool enabled) {
+    congestion.set_enabled(enabled);
+    pacer.set_rate(congestion.rate(), Clock::now());
+}
+
+void Connection::acknowledge_packet(PacketIdType packet_id) {
+    for (auto& baseline : sent_baselines) {
+        if (baseline.sent && baseline.packet_id == packet_id) {
+            baseline.acked = true;
+        }
+    }
+}
+
+bool Connection::is_packet_acked(PacketIdType packet_id) const {
+    auto sent = sent_packets.find(packet_id);
+    return sent != nullptr && sent->acked;
+}
+
+MessageIdType Connection::queue_message(
+    MessageBuffer message_data,
+    uint16_t message_bit_size,
+    uint8_t type,
+    uint8_t priority,
+    uint8_t delivery_mode,
+    uint8_t baseline_slot) {
     auto packet_id = channel_message_counter[type]++;
-    auto byte_size = static_cast<uint16_t>(std::ceil(message_bit_size / 8.0));
     PacketMessage message = {
-        std::make_unique<std::byte[]>(byte_size),
+        std::move(message_data),
         message_bit_size,
         packet_id,
         type,
-        priority,
-        ordered ? RELIABLE_ORDERED : RELIABLE
+        delivery_mode,
+        baseline_slot
     };
-    memcpy(message.data.get(), message_data, byte_size);
-    message_send_queue.push(std::move(message));
+    // Every packet sent is a tick of the scheduler
+    message_send_queue.push(std::move(message), priority, next_packet_id);
     return packet_id;
 }
 
-void Connection::send_message_packet() {
-    auto& message = message_send_queue.top();
+uint8_t Connection::find_acked_baseline(uint8_t type) const {
+    auto found = NO_BASELINE_SLOT;
+
+    for (auto i = 0U; i < sent_baselines.size(); ++i) {
+        auto& baseline = sent_baselines[i];
+
+        // By message id, a later packet can carry older state when a delta of higher priority overtook it
+        if (baseline.acked && baseline.type == type
+            && (found == NO_BASELINE_SLOT
+                || sequence_greater_than(baseline.message_id, sent_baselines[found].message_id))) {
+            found = static_cast<uint8_t>(i);
+        }
+    }
+
+    return found;
+}
+
+uint8_t Connection::find_received_baseline(PacketIdType packet_id, MessageIdType message_id, uint8_t type) const {
+    for (auto i = 0U; i < received_baselines.size(); ++i) {
+        auto& baseline = received_baselines[i];
+
+        if (baseline.sent && baseline.type == type && baseline.packet_id == packet_id
+            && baseline.message_id == message_id) {
+            return static_cast<uint8_t>(i);
+        }
+    }
+
+    return NO_BASELINE_SLOT;
+}
+
+PacketIdType Connection::send_message_packet(Clock::time_point now) {
     std::array<std::byte, MTU> packet;
-    NetWriteStream writer(packet);
-    PacketContents contents = {};
+    auto writer = NetWriteStream(std::span(packet).subspan(PACKET_CRC_SIZE));
+    auto packet_id = next_packet_id++;
+    auto header = make_header(packet_id, now);
+    // Sequences only grow, so the newest one always has a slot
+    auto& sent = *sent_packets.insert(packet_id);
 
-    while (!message_send_queue.empty() && writer.bits_left() >= message.data_bit_size) {
-        message_send_queue.pop();
+    [[maybe_unused]] auto header_written = serialize(writer, header);
+    assert(header_written && "Packet header does not fit in a packet");
+    ack_pending = false;
 
-        // TODO: Write packet header
+    // A slice leaves room for small messages only. When the next message is too large for that it gets every other
+    // packet, neither can hold up the other.
+    uint8_t slice_index = 0;
+    auto has_slice = fragment_sender.next_slice(now, rtt.retransmission_timeout(), slice_index);
 
-        // TODO: Write message header (ID, channel, size, data)
-        // Should channel be used by different subsystems to identify type of message? I guess it basically is, and 256 different ones should be enough for anything
+    uint32_t level = 0;
 
-        // TODO: Track packet contents
+    if (has_slice && !slice_deferred && message_send_queue.next_level(packet_id, level)
+        && message_send_queue.front(level).data_bit_size + MAX_MESSAGE_HEADER_BITS + MAX_SLICE_BITS > writer.bits_left()) {
+        has_slice = false;
+        slice_deferred = true;
+    } else {
+        slice_deferred = false;
     }
+
+    if (has_slice) {
+        auto [slice_header, slice_data] = fragment_sender.slice(slice_index);
+        auto delivery_mode = SLICE;
+        [[maybe_unused]] auto slice_written = serialize_int(writer, delivery_mode, UNRELIABLE, SLICE)
+            && serialize(writer, slice_header)
+            && serialize_aligned_data(
+                writer,
+                const_cast<std::byte*>(slice_data.data()),
+                static_cast<uint16_t>(slice_data.size()));
+        assert(slice_written && "Slice does not fit in a packet");
+
+        fragment_sender.on_slice_sent(slice_index, now);
+        sent.has_slice = true;
+        sent.slice_index = slice_index;
+        sent.fragment_id = slice_header.fragment_id;
+    }
+
+    // Levels whose oldest message did not fit, smaller messages of other levels may still fill the packet
+    auto full_levels = uint32_t{ 0 };
+
+    while (sent.message_count < MAX_MESSAGES_PER_PACKET && message_send_queue.next_level(packet_id, level, full_levels)) {
+        auto& message = message_send_queue.front(level);
+
+        // The header has a fixed worst case size, so only messages close to the packet limit need measuring
+        if (message.data_bit_size + MAX_MESSAGE_HEADER_BITS > writer.bits_left()) {
+            NetMeasureStream measure(writer.bits_left());
+
+            if (!serialize(measure, message)) {
+                full_levels |= 1U << level;
+                continue;
+            }
+        }
+
+        serialize(writer, message);
+
+        // The baseline slot may have been reused by a newer delta message before this one got sent
+        if (message.baseline_slot != NO_BASELINE_SLOT) {
+            auto& baseline = sent_baselines[message.baseline_slot];
+
+            if (baseline.type == message.type && baseline.message_id == message.id) {
+                baseline.packet_id = packet_id;
+                baseline.sent = true;
+            }
+        }
+
+        sent.messages[sent.message_count++] = { message.id, message.type };
+        message_send_queue.pop(level);
+    }
+
+    writer.flush_scratch();
+    auto packet_size = PACKET_CRC_SIZE + writer.bits_written / 8;
+    write_packet_crc(std::span(packet).first(packet_size), protocol_id);
+
+    // Send failures are logged by the transport
+    [[maybe_unused]] auto sent_bytes = transport->send(remote_address, std::span(packet).first(packet_size));
+
+    sent.sent_at = now;
+    sent.size = static_cast<uint16_t>(packet_size);
+    sent_bandwidth.add(static_cast<uint32_t>(packet_size), now);
+    congestion.on_packet_sent(static_cast<uint32_t>(packet_size));
+    pacer.consume(static_cast<uint32_t>(packet_size), now);
+    ++totals.packets_sent;
+    publish_stats();
+    return packet_id;
+}
+
+bool Connection::update(Clock::time_point now) {
+    if (!has_pending_sends() || now < next_send_time()) {
+        sent_bandwidth.advance(now);
+        received_bandwidth.advance(now);
+        acked_bandwidth.advance(now);
+        publish_stats();
+        return false;
+    }
+
+    send_message_packet(now);
+    last_send_time = now;
+    return true;
+}
+
+auto Connection::next_send_time() const -> Clock::time_point {
+    auto next = std::max(last_send_time + send_interval, pacer.next_send_time());
+
+    if (message_send_queue.empty() && !ack_pending && fragment_sender.is_sending()) {
+        next = std::max(next, fragment_sender.next_send_time(rtt.retransmission_timeout()));
+    }
+
+    return next;
 }
 
-void Connection::serialize(NetWriteStream& writer, PacketMessage& message) {
-    serialize_int(writer, message.delivery_mode, UNRELIABLE, RELIABLE_ORDERED);
+bool Connection::receive_packet(std::span<const std::byte> packet, Clock::time_point received_at) {
+    DL_NET_CHECK(check_packet_crc(packet, protocol_id));
+
+    auto payload = packet_payload(packet);
+    auto reader = NetReadStream(payload.data(), static_cast<uint32_t>(payload.size() * 8));
+    PacketHeader header;
+    DL_NET_CHECK(serialize(reader, header));
+    DL_NET_CHECK(!received_packets.contains(header.sequence));
+    DL_NET_CHECK(received_packets.insert(header.sequence));
+
+    if (header.sequence == received_packets.newest_sequence()) {
+        newest_received_at = received_at;
+    }
+
+    received_bandwidth.add(static_cast<uint32_t>(packet.size()), received_at);
+    ++totals.packets_received;
+
+    if (header.has_ack) {
+        process_acks(header, received_at);
+        pacer.set_rate(congestion.rate(), received_at);
+    }
+
+    // Packets that are only a header carry nothing to ack, acking them too would keep both ends sending forever
+    ack_pending = ack_pending || reader.bits_left() >= 8;
+
+    // Flushing pads the last byte, anything shorter than a byte is padding
+    auto messages_read = true;
+
+    while (messages_read && reader.bits_left() >= 8) {
+        messages_read = read_message(reader, header.sequence);
+    }
+
+    publish_stats();
+    return messages_read;
+}
+
+bool Connection::read_message(NetReadStream& reader, PacketIdType packet_id) {
+    uint8_t delivery_mode = 0;
+    DL_NET_CHECK(serialize_int(reader, delivery_mode, UNRELIABLE, SLICE));
+
+    if (delivery_mode == SLICE) {
+        SliceHeader header;
+        std::span<const std::byte> data;
+        DL_NET_CHECK(serialize(reader, header));
+        DL_NET_CHECK(header.slice_index < slice_count(header.bit_size));
+        reader.align_to_byte();
+        DL_NET_CHECK(reader.serialize_view(
+            data,
+            static_cast<uint16_t>(slice_byte_size(header.bit_size, header.slice_index))));
+        DL_NET_CHECK(fragment_receiver.receive(header, data, *message_pool));
+
+        if (fragment_receiver.is_complete()) {
+            auto type = fragment_receiver.message_type();
+            auto bit_size = fragment_receiver.message_bit_size();
+            auto message = fragment_receiver.take_message();
+
+            if (on_message) {
+                on_message({ packet_id, type, { message.data(), (bit_size + 7) / 8 }, bit_size });
+            }
+        }
+
+        return true;
+    }
+
+    uint8_t type = 0;
+    MessageIdType id = 0;
+    uint16_t bit_size = 0;
+    std::array<std::byte, MTU> data;
+    DL_NET_CHECK(serialize_int(reader, type));
+
+    if (delivery_mode == RELIABLE_ORDERED) {
+        DL_NET_CHECK(serialize_int(reader, id));
+    }
+
+    DL_NET_CHECK(serialize_int(reader, bit_size, static_cast<uint16_t>(0), static_cast<uint16_t>(MTU * 8)));
+
+    if (bit_size > 0) {
+        DL_NET_CHECK(serialize_data(reader, data.data(), bit_size));
+    }
+
+    if (on_message) {
+        on_message({ packet_id, type, std::span(data).first((bit_size + 7) / 8), bit_size });
+    }
+
+    return true;
+}
+
+Connection::PacketHeader Connection::make_header(PacketIdType sequence, Clock::time_point now) const {
+    auto header = PacketHeader{ .sequence = sequence, .has_ack = !received_packets.empty() };
+
+    if (header.has_ack) {
+        header.ack = received_packets.newest_sequence();
+        auto delay = std::max(now - newest_received_at, Clock::duration::zero()) / ACK_DELAY_UNIT;
+        header.ack_delay = static_cast<uint16_t>(std::min<decltype(delay)>(delay, UINT16_MAX));
+
+        for (auto i = 0U; i < NUM_ACK_BITS; ++i) {
+            if (received_packets.contains(header.ack - 1 - i)) {
+                header.ack_trail |= AckTrailType{ 1 } << i;
+            }
+        }
+    }
+
+    return header;
+}
+
+void Connection::process_acks(const PacketHeader& header, Clock::time_point received_at) {
+    auto ack = header.ack;
+
+    // Acks for packets never sent can only come from a broken or hostile remote
+    if (!sequence_less_than(ack, next_packet_id)) {
+        return;
+    }
+
+    // Only the newest ack is a round trip sample, the trail was acked before and is only repeated here. Resends have
+    // to wait for however long the remote holds acks, so the RTT keeps that time. Congestion control gets the sample
+    // without it, a remote that sends rarely would otherwise look like a queue building up on the path.
+    if (auto sent = sent_packets.find(ack); sent != nullptr && !sent->acked && received_at > sent->sent_at) {
+        auto sample = std::chrono::duration_cast<std::chrono::microseconds>(received_at - sent->sent_at);
+        auto ack_delay = header.ack_delay * ACK_DELAY_UNIT;
+        rtt.add_sample(sample);
+        congestion.on_rtt_sample(ack_delay < sample ? sample - ack_delay : sample, received_at);
+    }
+
+    on_packet_acked(ack, received_at);
+
+    for (auto bits = header.ack_trail; bits != 0; bits &= bits - 1) {
+        on_packet_acked(ack - 1 - static_cast<PacketIdType>(std::countr_zero(bits)), received_at);
+    }
+
+    if (!has_newest_ack || sequence_greater_than(ack, newest_ack)) {
+        newest_ack = ack;
+        has_newest_ack = true;
+        detect_lost_packets(received_at);
+    }
+}
+
+void Connection::on_packet_acked(PacketIdType packet_id, Clock::time_point received_at) {
+    auto sent = sent_packets.find(packet_id);
+
+    // Every packet is acked by up to NUM_ACK_BITS + 1 packets, only the first counts. Ones already counted as lost
+    // stay lost.
+    if (sent == nullptr || sent->acked || sequence_less_than(packet_id, next_undecided)) {
+        return;
+    }
+
+    sent->acked = true;
+    acknowledge_packet(packet_id);
+
+    if (sent->has_slice) {
+        fragment_sender.on_slice_acked(sent->fragment_id, sent->slice_index);
+    }
+    acked_bandwidth.add(sent->size, received_at);
+    loss.add(false);
+    ++totals.packets_acked;
+}
+
+void Connection::detect_lost_packets(Clock::time_point now) {
+    // Older packets have lost their slots, whether they arrived is no longer known
+    auto oldest_tracked = static_cast<PacketIdType>(next_packet_id - MAX_TRACKED_PACKETS);
+
+    if (sequence_less_than(next_undecided, oldest_tracked)) {
+        next_undecided = oldest_tracked;
+    }
+
+    // The remote acks NUM_ACK_BITS packets behind its newest, anything older that is not acked by now never will be
+    auto ack_horizon = static_cast<PacketIdType>(newest_ack - NUM_ACK_BITS);
+
+    while (sequence_less_than(next_undecided, ack_horizon)) {
+        if (auto sent = sent_packets.find(next_undecided); sent != nullptr && !sent->acked) {
+            loss.add(true);
+            congestion.on_packet_lost(now);
+            ++totals.packets_lost;
+        }
+
+        ++next_undecided;
+    }
+}
+
+void Connection::publish_stats() {
+    auto stats = totals;
+    stats.rtt = rtt.smoothed();
+    stats.rtt_variance = rtt.variance();
+    stats.retransmission_timeout = rtt.retransmission_timeout();
+    stats.packet_loss = loss.loss_percent();
+    stats.sent_kbps = sent_bandwidth.kbps();
+    stats.received_kbps = received_bandwidth.kbps();
+    stats.acked_kbps = acked_bandwidth.kbps();
+    stats.send_rate_kbps = static_cast<float>(congestion.rate()) * 8.0f / 1000.0f;
+    published_stats.publish(stats);
+}
+
+template <typename StreamType>
+bool Connection::serialize(StreamType& stream, PacketHeader& header) {
+    DL_NET_CHECK(serialize_int(stream, header.sequence));
+    DL_NET_CHECK(serialize_bool(stream, header.has_ack));
+
+    if (header.has_ack) {
+        DL_NET_CHECK(serialize_int(stream, header.ack));
+        DL_NET_CHECK(serialize_int(stream, header.ack_delay));
+        DL_NET_CHECK(serialize_int(stream, header.ack_trail));
+    }
+
+    return true;
+}
+
+template <typename StreamType>
+bool Connection::serialize(StreamType& stream, SliceHeader& header) {
+    DL_NET_CHECK(serialize_int(stream, header.type));
+    DL_NET_CHECK(serialize_int(stream, header.fragment_id));
+    DL_NET_CHECK(serialize_int(stream, header.slice_index));
+    DL_NET_CHECK(serialize_int(stream, header.bit_size, 1U, MAX_FRAGMENTED_MESSAGE_SIZE * 8));
+    return true;
+}
+
+template <typename StreamType>
+bool Connection::serialize(StreamType& stream, PacketMessage& message) {
+    DL_NET_CHECK(serialize_int(stream, message.delivery_mode, UNRELIABLE, SLICE));
+    DL_NET_CHECK(serialize_int(stream, message.type));
     if (message.delivery_mode == RELIABLE_ORDERED) {
-        serialize_int(writer, message.id, static_cast<PacketIdType>(0), static_cast<PacketIdType>(2));
+        DL_NET_CHECK(serialize_int(stream, message.id));
+    }
+    DL_NET_CHECK(serialize_int(stream, message.data_bit_size, static_cast<uint16_t>(0), static_cast<uint16_t>(MTU * 8)));
+    if (message.data_bit_size > 0) {
+        DL_NET_CHECK(serialize_data(stream, message.data.data(), message.data_bit_size));
     }
-    serialize_int(writer, message.data_bit_size, static_cast<uint16_t>(0), MTU);
-    serialize_data(writer, message.data.get(), message.data_bit_size);
+    return true;
 }
 }
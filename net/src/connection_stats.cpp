@@ -0,0 +1,68 @@
+#include "ducklib/net/connection_stats.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace ducklib::net {
+namespace {
+constexpr float BANDWIDTH_SMOOTHING = 0.25f; // Weight of the newest interval
+constexpr std::chrono::microseconds CLOCK_GRANULARITY{ 1000 }; // G in RFC 6298
+}
+
+void RttEstimator::add_sample(std::chrono::microseconds rtt) {
+    // RFC 6298 2.2 and 2.3 with alpha = 1/8 and beta = 1/4
+    if (!sampled) {
+        smoothed_rtt = rtt;
+        rtt_variance = rtt / 2;
+        sampled = true;
+        return;
+    }
+
+    auto error = smoothed_rtt > rtt ? smoothed_rtt - rtt : rtt - smoothed_rtt;
+    rtt_variance = (3 * rtt_variance + error) / 4;
+    smoothed_rtt = (7 * smoothed_rtt + rtt) / 8;
+}
+
+auto RttEstimator::retransmission_timeout() const -> std::chrono::microseconds {
+    if (!sampled) {
+        return INITIAL_TIMEOUT;
+    }
+
+    return std::clamp(smoothed_rtt + std::max(CLOCK_GRANULARITY, 4 * rtt_variance), MIN_TIMEOUT, MAX_TIMEOUT);
+}
+
+void LossWindow::add(bool lost) {
+    lost_bits = lost_bits << 1 | static_cast<uint64_t>(lost);
+    count = std::min(count + 1, WINDOW);
+}
+
+float LossWindow::loss_percent() const {
+    static_assert(WINDOW == 64, "Window is the bits of one uint64_t");
+    return count == 0 ? 0.0f : 100.0f * static_cast<float>(std::popcount(lost_bits)) / static_cast<float>(count);
+}
+
+void BandwidthMeter::add(uint32_t bytes, std::chrono::steady_clock::time_point now) {
+    advance(now);
+    interval_bytes += bytes;
+}
+
+void BandwidthMeter::advance(std::chrono::steady_clock::time_point now) {
+    if (!started) {
+        interval_start = now;
+        started = true;
+        return;
+    }
+
+    auto elapsed = now - interval_start;
+
+    if (elapsed < INTERVAL) {
+        return;
+    }
+
+    auto kbps = static_cast<float>(interval_bytes * 8) / 1000.0f / std::chrono::duration<float>(elapsed).count();
+    smoothed_kbps = measured ? smoothed_kbps + BANDWIDTH_SMOOTHING * (kbps - smoothed_kbps) : kbps;
+    measured = true;
+    interval_bytes = 0;
+    interval_start = now;
+}
+}
@@ -0,0 +1,159 @@
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "ducklib/net/crc32c.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DL_NET_CRC32C_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) || defined(_M_ARM64)
+#define DL_NET_CRC32C_ARM 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#endif
+
+#if defined(DL_NET_CRC32C_X86) && !defined(_MSC_VER)
+#define DL_NET_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define DL_NET_TARGET_SSE42
+#endif
+
+namespace ducklib::net {
+namespace {
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82f63b78; // Reflected 0x1edc6f41
+
+using SliceTables = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr SliceTables make_slice_tables() {
+    SliceTables tables = {};
+
+    for (auto i = 0U; i < 256; ++i) {
+        auto crc = i;
+        for (auto bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+
+    // tables[n][i] is the CRC of byte i followed by n zero bytes
+    for (auto i = 0U; i < 256; ++i) {
+        for (auto n = 1U; n < tables.size(); ++n) {
+            auto previous = tables[n - 1][i];
+            tables[n][i] = (previous >> 8) ^ tables[0][previous & 0xff];
+        }
+    }
+
+    return tables;
+}
+
+constexpr auto SLICE_TABLES = make_slice_tables();
+static_assert(SLICE_TABLES[0][128] == CRC32C_POLYNOMIAL);
+
+uint64_t load_le64(const std::byte* source) {
+    uint64_t word;
+    memcpy(&word, source, sizeof(word));
+
+    if constexpr (std::endian::native == std::endian::big) {
+        word = std::byteswap(word);
+    }
+
+    return word;
+}
+
+#if defined(DL_NET_CRC32C_X86)
+bool cpu_has_sse42() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+DL_NET_TARGET_SSE42
+uint32_t crc32c_hardware(const std::byte* data, size_t size, uint32_t crc) {
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc64 = crc;
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        crc64 = _mm_crc32_u64(crc64, load_le64(data));
+    }
+    crc = static_cast<uint32_t>(crc64);
+#else
+    for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), data += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+#endif
+
+    for (; size > 0; --size, ++data) {
+        crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+    }
+
+    return crc;
+}
+#elif defined(DL_NET_CRC32C_ARM)
+uint32_t crc32c_hardware(const std::byte* data, size_t size, uint32_t crc) {
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        crc = __crc32cd(crc, load_le64(data));
+    }
+
+    for (; size > 0; --size, ++data) {
+        crc = __crc32cb(crc, static_cast<uint8_t>(*data));
+    }
+
+    return crc;
+}
+#endif
+
+uint32_t crc32c_slice_by_8(const std::byte* data, size_t size, uint32_t crc) {
+    const auto& t = SLICE_TABLES;
+
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        auto word = load_le64(data) ^ crc;
+        crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff]
+            ^ t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+    }
+
+    for (; size > 0; --size, ++data) {
+        crc = (crc >> 8) ^ t[0][(crc ^ static_cast<uint8_t>(*data)) & 0xff];
+    }
+
+    return crc;
+}
+}
+
+uint32_t crc32c(std::span<const std::byte> data, uint32_t crc) {
+#if defined(DL_NET_CRC32C_X86) || defined(DL_NET_CRC32C_ARM)
+    [[likely]]
+    if (crc32c_hardware_available()) {
+        return ~crc32c_hardware(data.data(), data.size(), ~crc);
+    }
+#endif
+
+    return crc32c_software(data, crc);
+}
+
+uint32_t crc32c_software(std::span<const std::byte> data, uint32_t crc) {
+    return ~crc32c_slice_by_8(data.data(), data.size(), ~crc);
+}
+
+bool crc32c_hardware_available() {
+#if defined(DL_NET_CRC32C_X86)
+    static const bool available = cpu_has_sse42();
+    return available;
+#elif defined(DL_NET_CRC32C_ARM)
+    return true;
+#else
+    return false;
+#endif
+}
+}
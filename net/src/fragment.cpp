@@ -0,0 +1,121 @@
+#include "ducklib/net/fragment.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "ducklib/net/sequence_buffer.h"
+#include "ducklib/net/serialization.h"
+
+namespace ducklib::net {
+void FragmentSender::queue(MessageBuffer data, uint32_t bit_size, uint8_t type) {
+    assert(bit_size > 0 && bit_size <= MAX_FRAGMENTED_MESSAGE_SIZE * 8);
+    messages.push_back({ std::move(data), bit_size, type });
+}
+
+auto FragmentSender::slice(uint8_t slice_index) const -> std::pair<SliceHeader, std::span<const std::byte>> {
+    assert(is_sending());
+    auto& message = messages.front();
+    assert(slice_index < slice_count(message.bit_size));
+
+    auto header = SliceHeader{ fragment_id, message.type, message.bit_size, slice_index };
+    auto data = std::span<const std::byte>(
+        message.data.data() + slice_index * SLICE_SIZE,
+        slice_byte_size(message.bit_size, slice_index));
+    return { header, data };
+}
+
+bool FragmentSender::next_slice(Clock::time_point now, Clock::duration resend_timeout, uint8_t& slice_index) const {
+    if (!is_sending()) {
+        return false;
+    }
+
+    auto count = slice_count(messages.front().bit_size);
+
+    for (auto i = 0U; i < count; ++i) {
+        if (!acked[i] && (sent_at[i] == Clock::time_point{} || now - sent_at[i] >= resend_timeout)) {
+            slice_index = static_cast<uint8_t>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+auto FragmentSender::next_send_time(Clock::duration resend_timeout) const -> Clock::time_point {
+    assert(is_sending());
+    auto count = slice_count(messages.front().bit_size);
+    auto next = Clock::time_point::max();
+
+    for (auto i = 0U; i < count; ++i) {
+        if (!acked[i]) {
+            next = std::min(next, sent_at[i] == Clock::time_point{} ? sent_at[i] : sent_at[i] + resend_timeout);
+        }
+    }
+
+    return next;
+}
+
+void FragmentSender::on_slice_sent(uint8_t slice_index, Clock::time_point now) {
+    sent_at[slice_index] = now;
+}
+
+void FragmentSender::on_slice_acked(FragmentIdType acked_fragment_id, uint8_t slice_index) {
+    if (!is_sending() || acked_fragment_id != fragment_id || acked[slice_index]) {
+        return;
+    }
+
+    acked[slice_index] = true;
+
+    if (++acked_count < slice_count(messages.front().bit_size)) {
+        return;
+    }
+
+    messages.pop_front();
+    ++fragment_id;
+    acked_count = 0;
+    acked.reset();
+    sent_at.fill({});
+}
+
+bool FragmentReceiver::receive(const SliceHeader& header, std::span<const std::byte> data, MessagePool& pool) {
+    if (has_completed && !sequence_greater_than(header.fragment_id, completed_id)) {
+        return true;
+    }
+
+    if (receiving && sequence_less_than(header.fragment_id, fragment_id)) {
+        return true;
+    }
+
+    if (!receiving || header.fragment_id != fragment_id) {
+        DL_NET_CHECK(header.bit_size > 0 && header.bit_size <= MAX_FRAGMENTED_MESSAGE_SIZE * 8);
+        buffer = pool.acquire((header.bit_size + 7) / 8);
+        fragment_id = header.fragment_id;
+        type = header.type;
+        bit_size = header.bit_size;
+        received_count = 0;
+        received.reset();
+        receiving = true;
+    }
+
+    DL_NET_CHECK(header.type == type && header.bit_size == bit_size);
+    DL_NET_CHECK(header.slice_index < slice_count(bit_size));
+    DL_NET_CHECK(data.size() == slice_byte_size(bit_size, header.slice_index));
+
+    if (received[header.slice_index]) {
+        return true;
+    }
+
+    memcpy(buffer.data() + header.slice_index * SLICE_SIZE, data.data(), data.size());
+    received[header.slice_index] = true;
+    ++received_count;
+    return true;
+}
+
+MessageBuffer FragmentReceiver::take_message() {
+    assert(is_complete());
+    receiving = false;
+    has_completed = true;
+    completed_id = fragment_id;
+    return std::move(buffer);
+}
+}
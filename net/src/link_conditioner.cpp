@@ -0,0 +1,211 @@
+#include "ducklib/net/link_conditioner.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace ducklib::net {
+namespace {
+/// Heap comparison putting the earliest release, then the earliest submitted, on top
+struct ReleasesLater {
+    template <typename Packet>
+    bool operator()(const Packet& a, const Packet& b) const {
+        return a.release_at != b.release_at ? a.release_at > b.release_at : a.sequence > b.sequence;
+    }
+};
+
+constexpr uint64_t SPLITMIX_INCREMENT = 0x9e3779b97f4a7c15;
+}
+
+LinkConditioner::LinkConditioner(std::shared_ptr<Transport> inner, LinkConditionerConfig config)
+    : inner(std::move(inner))
+    , clock(std::move(config.clock))
+    , rng_state(config.seed)
+    , receive_storage(std::make_unique<std::byte[]>(RECEIVE_BATCH_SIZE * MTU)) {
+    assert(this->inner && "Link conditioner needs a transport to wrap");
+    send_link.profile = config.send;
+    receive_link.profile = config.receive;
+
+    for (auto i = 0U; i < incoming.size(); ++i) {
+        incoming[i].buffer = { receive_storage.get() + i * MTU, MTU };
+    }
+}
+
+auto LinkConditioner::next_wakeup() const -> std::optional<ReceiveTime> {
+    auto wakeup = std::optional<ReceiveTime>();
+
+    for (auto link : { &send_link, &receive_link }) {
+        if (!link->queue.empty() && (!wakeup || link->queue.front().release_at < *wakeup)) {
+            wakeup = link->queue.front().release_at;
+        }
+    }
+
+    return wakeup;
+}
+
+auto LinkConditioner::send(Address to, std::span<const std::byte> data) const -> size_t {
+    auto time = now();
+    submit(send_link, to, data, time);
+    flush(time);
+    return data.size();
+}
+
+auto LinkConditioner::receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t {
+    auto packet = IncomingPacket{ .buffer = receive_buffer };
+
+    if (receive_batch({ &packet, 1 }) == 0) {
+        return 0;
+    }
+
+    from = packet.from;
+    return packet.size;
+}
+
+auto LinkConditioner::send_batch(std::span<const OutgoingPacket> packets) const -> size_t {
+    auto time = now();
+
+    for (auto& packet : packets) {
+        submit(send_link, packet.to, packet.data, time);
+    }
+
+    flush(time);
+    return packets.size();
+}
+
+auto LinkConditioner::receive_batch(std::span<IncomingPacket> packets) const -> size_t {
+    auto time = now();
+    auto count = size_t{ 0 };
+
+    flush(time);
+    pull(time);
+
+    while (count < packets.size() && !receive_link.queue.empty() && receive_link.queue.front().release_at <= time) {
+        auto delayed = pop(receive_link);
+        auto& packet = packets[count++];
+        // Truncated like a datagram received into too small a buffer
+        packet.size = std::min<size_t>(delayed.size, packet.buffer.size());
+        packet.from = delayed.address;
+        packet.received_at = delayed.release_at;
+        memcpy(packet.buffer.data(), delayed.data.data(), packet.size);
+        ++receive_link.stats.delivered;
+    }
+
+    return count;
+}
+
+auto LinkConditioner::flush() const -> size_t {
+    return flush(now());
+}
+
+auto LinkConditioner::now() const -> ReceiveTime {
+    return clock ? clock() : std::chrono::steady_clock::now();
+}
+
+void LinkConditioner::submit(Link& link, const Address& address, std::span<const std::byte> data, ReceiveTime now) const {
+    auto& profile = link.profile;
+    auto chance = [this](float probability) { return probability > 0.0f && random() < probability; };
+
+    link.in_burst = link.in_burst ? !chance(profile.burst_exit) : chance(profile.burst_enter);
+
+    if (chance(link.in_burst ? profile.burst_loss : profile.loss)) {
+        ++link.stats.dropped;
+        link.stats.burst_dropped += link.in_burst;
+        return;
+    }
+
+    auto departs_at = now;
+
+    if (profile.bandwidth > 0) {
+        auto starts_at = std::max(now, link.free_at);
+        auto backlog = static_cast<uint64_t>(std::chrono::duration<double>(starts_at - now).count() * profile.bandwidth);
+
+        if (profile.queue_limit > 0 && backlog + data.size() > profile.queue_limit) {
+            ++link.stats.overflowed;
+            return;
+        }
+
+        link.free_at = starts_at + std::chrono::nanoseconds(data.size() * 1'000'000'000ULL / profile.bandwidth);
+        departs_at = link.free_at;
+    }
+
+    auto copies = 1;
+
+    if (chance(profile.duplicate)) {
+        ++copies;
+        ++link.stats.duplicated;
+    }
+
+    for (auto i = 0; i < copies; ++i) {
+        auto delay = profile.latency;
+
+        if (profile.jitter.count() > 0) {
+            delay += std::chrono::microseconds(static_cast<int64_t>(random() * static_cast<double>(profile.jitter.count() + 1)));
+        }
+
+        if (chance(profile.reorder)) {
+            delay += profile.reorder_delay;
+            ++link.stats.reordered;
+        }
+
+        enqueue(link, address, data, departs_at + delay);
+    }
+}
+
+void LinkConditioner::enqueue(Link& link, const Address& address, std::span<const std::byte> data, ReceiveTime release_at) const {
+    auto size = static_cast<uint32_t>(data.size());
+    auto buffer = pool.acquire(size);
+    memcpy(buffer.data(), data.data(), size);
+    link.queue.push_back({ release_at, next_sequence++, address, std::move(buffer), size });
+    std::ranges::push_heap(link.queue, ReleasesLater());
+}
+
+auto LinkConditioner::pop(Link& link) const -> DelayedPacket {
+    std::ranges::pop_heap(link.queue, ReleasesLater());
+    auto packet = std::move(link.queue.back());
+    link.queue.pop_back();
+    return packet;
+}
+
+auto LinkConditioner::flush(ReceiveTime now) const -> size_t {
+    auto sent = size_t{ 0 };
+
+    while (!send_link.queue.empty() && send_link.queue.front().release_at <= now) {
+        auto packet = pop(send_link);
+
+        // A failed send is one more lost packet as far as the other end can tell
+        if (inner->send(packet.address, { packet.data.data(), packet.size }) == packet.size) {
+            ++sent;
+        }
+
+        ++send_link.stats.delivered;
+    }
+
+    return sent;
+}
+
+void LinkConditioner::pull(ReceiveTime now) const {
+    while (true) {
+        auto count = inner->receive_batch(incoming);
+
+        // Delayed from when the inner transport got them, which can be well before this pull. Its receive times are on
+        // steady_clock, which a clock of our own has nothing to do with.
+        for (auto i = 0U; i < count; ++i) {
+            auto received_at = clock ? now : std::min(incoming[i].received_at, now);
+            submit(receive_link, incoming[i].from, incoming[i].buffer.first(incoming[i].size), received_at);
+        }
+
+        if (count < incoming.size()) {
+            return;
+        }
+    }
+}
+
+auto LinkConditioner::random() const -> double {
+    // splitmix64, small and the same everywhere unlike the standard distributions
+    auto z = rng_state += SPLITMIX_INCREMENT;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+    return static_cast<double>(z >> 11) * 0x1.0p-53;
+}
+}
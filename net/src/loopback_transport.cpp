@@ -0,0 +1,151 @@
+#include "ducklib/net/loopback_transport.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+namespace ducklib::net {
+namespace {
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/// Ports the pairs appear to use, only for telling ends apart in logs and tests
+std::atomic<uint16_t> next_loopback_port = 0;
+
+uint16_t take_port() {
+    auto port = uint16_t{ 0 };
+
+    while (port == 0) {
+        port = ++next_loopback_port;
+    }
+
+    return port;
+}
+}
+
+struct LoopbackTransport::Ring {
+    struct Slot {
+        uint32_t size;
+        std::array<std::byte, MTU> data;
+    };
+
+    explicit Ring(uint32_t capacity)
+        : mask(capacity - 1)
+        , slots(std::make_unique<Slot[]>(capacity)) {}
+
+    // Free running, slot index is the counter masked. Each counter is written by one side only and read by the other.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> head = 0; // Next to read, written by the receiving end
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> tail = 0; // Next to write, written by the sending end
+    alignas(CACHE_LINE_SIZE) uint32_t mask;
+    std::unique_ptr<Slot[]> slots;
+};
+
+auto LoopbackTransport::make_pair(uint32_t capacity)
+    -> std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>> {
+    assert(capacity > 0);
+    capacity = std::bit_ceil(capacity);
+
+    auto first_inbox = std::make_shared<Ring>(capacity);
+    auto second_inbox = std::make_shared<Ring>(capacity);
+    auto first_address = Address("127.0.0.1", take_port());
+    auto second_address = Address("127.0.0.1", take_port());
+
+    return {
+        std::shared_ptr<LoopbackTransport>(new LoopbackTransport(first_address, second_address, first_inbox, second_inbox)),
+        std::shared_ptr<LoopbackTransport>(new LoopbackTransport(second_address, first_address, second_inbox, first_inbox))
+    };
+}
+
+LoopbackTransport::LoopbackTransport(
+    const Address& address,
+    const Address& peer_address,
+    std::shared_ptr<Ring> inbox,
+    std::shared_ptr<Ring> outbox)
+    : address(address)
+    , peer_address(peer_address)
+    , inbox(std::move(inbox))
+    , outbox(std::move(outbox)) {}
+
+LoopbackTransport::~LoopbackTransport() = default;
+
+auto LoopbackTransport::next_wakeup() const -> std::optional<ReceiveTime> {
+    if (inbox->tail.load(std::memory_order_acquire) != inbox->head.load(std::memory_order_relaxed)) {
+        return ReceiveTime();
+    }
+
+    return std::nullopt;
+}
+
+auto LoopbackTransport::send(Address to, std::span<const std::byte> data) const -> size_t {
+    auto packet = OutgoingPacket{ to, data };
+    return send_batch({ &packet, 1 }) == 1 ? data.size() : static_cast<size_t>(-1);
+}
+
+auto LoopbackTransport::receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t {
+    auto packet = IncomingPacket{ .buffer = receive_buffer };
+
+    if (receive_batch({ &packet, 1 }) == 0) {
+        return 0;
+    }
+
+    from = packet.from;
+    return packet.size;
+}
+
+auto LoopbackTransport::send_batch(std::span<const OutgoingPacket> packets) const -> size_t {
+    auto& ring = *outbox;
+    auto tail = ring.tail.load(std::memory_order_relaxed);
+    auto free = static_cast<uint32_t>(ring.mask + 1 - (tail - ring.head.load(std::memory_order_acquire)));
+    auto sent = size_t{ 0 };
+
+    for (; sent < packets.size(); ++sent) {
+        auto& packet = packets[sent];
+
+        if (packet.to != peer_address || packet.data.size() > MTU) {
+            break;
+        }
+
+        if (free == 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        auto& slot = ring.slots[tail & ring.mask];
+        slot.size = static_cast<uint32_t>(packet.data.size());
+        memcpy(slot.data.data(), packet.data.data(), packet.data.size());
+        ++tail;
+        --free;
+    }
+
+    // Published once for the whole batch
+    ring.tail.store(tail, std::memory_order_release);
+    return sent;
+}
+
+auto LoopbackTransport::receive_batch(std::span<IncomingPacket> packets) const -> size_t {
+    auto& ring = *inbox;
+    auto head = ring.head.load(std::memory_order_relaxed);
+    auto waiting = ring.tail.load(std::memory_order_acquire) - head;
+    auto count = std::min<size_t>(waiting, packets.size());
+
+    if (count == 0) {
+        return 0;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto i = 0U; i < count; ++i) {
+        auto& slot = ring.slots[head++ & ring.mask];
+        auto& packet = packets[i];
+        // Truncated like a datagram received into too small a buffer
+        packet.size = std::min<size_t>(slot.size, packet.buffer.size());
+        packet.from = peer_address;
+        packet.received_at = now;
+        memcpy(packet.buffer.data(), slot.data.data(), packet.size);
+    }
+
+    ring.head.store(head, std::memory_order_release);
+    return count;
+}
+}
@@ -0,0 +1,88 @@
+#include "ducklib/net/message_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ducklib::net {
+MessagePool::MessagePool(uint32_t blocks_per_slab)
+    : blocks_per_slab(blocks_per_slab) {
+    assert(blocks_per_slab > 0);
+
+    for (auto i = 0U; i < SIZE_CLASSES.size(); ++i) {
+        class_stats[i].block_size = SIZE_CLASSES[i];
+    }
+}
+
+MessagePool::~MessagePool() {
+    [[maybe_unused]] auto in_use = std::ranges::any_of(class_stats, [](const PoolStats& stats) { return stats.in_use > 0; });
+    assert(!in_use && "Message buffers outlived their pool");
+}
+
+MessageBuffer MessagePool::acquire(uint32_t byte_size) {
+    [[unlikely]]
+    if (byte_size > SIZE_CLASSES.back()) {
+        ++oversize_acquires;
+        return MessageBuffer(new std::byte[byte_size], byte_size, this);
+    }
+
+    auto index = class_index(byte_size);
+    auto& size_class = classes[index];
+    auto& stats = class_stats[index];
+
+    [[unlikely]]
+    if (size_class.free_list == nullptr) {
+        allocate_slab(index);
+    }
+
+    auto block = size_class.free_list;
+    memcpy(&size_class.free_list, block, sizeof(std::byte*));
+    ++stats.acquires;
+    stats.peak_in_use = std::max(stats.peak_in_use, ++stats.in_use);
+
+    return MessageBuffer(block, SIZE_CLASSES[index], this);
+}
+
+size_t MessagePool::reserved_bytes() const {
+    auto total = size_t{ 0 };
+
+    for (auto& stats : class_stats) {
+        total += static_cast<size_t>(stats.capacity) * stats.block_size;
+    }
+
+    return total;
+}
+
+uint32_t MessagePool::class_index(uint32_t byte_size) {
+    return static_cast<uint32_t>(std::ranges::lower_bound(SIZE_CLASSES, byte_size) - SIZE_CLASSES.begin());
+}
+
+void MessagePool::allocate_slab(uint32_t index) {
+    auto block_size = SIZE_CLASSES[index];
+    auto& size_class = classes[index];
+    auto& slab = size_class.slabs.emplace_back(std::make_unique<std::byte[]>(static_cast<size_t>(block_size) * blocks_per_slab));
+
+    // Threaded back to front so blocks are handed out in address order
+    for (auto i = blocks_per_slab; i-- > 0;) {
+        auto block = slab.get() + static_cast<size_t>(i) * block_size;
+        memcpy(block, &size_class.free_list, sizeof(std::byte*));
+        size_class.free_list = block;
+    }
+
+    class_stats[index].capacity += blocks_per_slab;
+    ++class_stats[index].misses;
+}
+
+void MessagePool::release(std::byte* block, uint32_t block_size) {
+    [[unlikely]]
+    if (block_size > SIZE_CLASSES.back()) {
+        delete[] block;
+        return;
+    }
+
+    auto index = class_index(block_size);
+    auto& size_class = classes[index];
+    memcpy(block, &size_class.free_list, sizeof(std::byte*));
+    size_class.free_list = block;
+    --class_stats[index].in_use;
+}
+}
@@ -0,0 +1,264 @@
+#include "ducklib/net/net_reactor.h"
+
+#include <algorithm>
+#include <cassert>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <thread>
+#else
+#include <poll.h>
+#endif
+
+namespace ducklib::net {
+namespace {
+#if defined(__linux__)
+constexpr int MAX_EPOLL_EVENTS = 64;
+#endif
+}
+
+NetReactor::NetReactor()
+    : receive_storage(std::make_unique<std::byte[]>(RECEIVE_BATCH_SIZE * MTU)) {
+#if defined(__linux__)
+    epoll_handle = epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll_handle >= 0 && "Failed to create epoll instance");
+#endif
+}
+
+NetReactor::~NetReactor() {
+#if defined(__linux__)
+    if (epoll_handle >= 0) {
+        close(epoll_handle);
+    }
+#endif
+}
+
+bool NetReactor::add_transport(const std::shared_ptr<Transport>& transport) {
+    if (transports.contains(transport.get())) {
+        return true;
+    }
+
+    DL_NET_CHECK(watch(*transport));
+    transports[transport.get()].transport = transport;
+    return true;
+}
+
+void NetReactor::remove_transport(const Transport& transport) {
+    auto entry = transports.find(&transport);
+
+    if (entry == transports.end()) {
+        return;
+    }
+
+    std::erase_if(connections, [&](const Connection* connection) {
+        return connection->get_transport().get() == &transport;
+    });
+    unwatch(*entry->second.transport);
+    transports.erase(entry);
+}
+
+bool NetReactor::add_connection(Connection& connection) {
+    DL_NET_CHECK(add_transport(connection.get_transport()));
+    auto& entry = transports[connection.get_transport().get()];
+    DL_NET_CHECK(entry.connections.emplace(connection.get_remote_address(), &connection).second);
+    connections.push_back(&connection);
+    return true;
+}
+
+void NetReactor::remove_connection(const Connection& connection) {
+    auto entry = transports.find(connection.get_transport().get());
+
+    if (entry != transports.end()) {
+        auto registered = entry->second.connections.find(connection.get_remote_address());
+
+        if (registered != entry->second.connections.end() && registered->second == &connection) {
+            entry->second.connections.erase(registered);
+        }
+    }
+
+    std::erase(connections, &connection);
+}
+
+auto NetReactor::run_once(std::chrono::milliseconds max_wait) -> size_t {
+    auto received = size_t{ 0 };
+
+    wait(next_timeout(max_wait));
+    add_unwatched_ready(Connection::Clock::now());
+
+    for (auto transport : ready_transports) {
+        // A receive callback may have removed the transport since it was reported
+        if (auto entry = transports.find(transport); entry != transports.end()) {
+            received += drain(entry->second);
+        }
+    }
+
+    auto now = Connection::Clock::now();
+
+    for (auto connection : connections) {
+        connection->update(now);
+    }
+
+    return received;
+}
+
+auto NetReactor::next_timeout(std::chrono::milliseconds max_wait) const -> std::chrono::milliseconds {
+    auto timeout = max_wait;
+    auto now = Connection::Clock::now();
+    auto wait_until = [&](Connection::Clock::time_point time) {
+        auto until = time - now;
+
+        if (until <= Connection::Clock::duration::zero()) {
+            timeout = std::chrono::milliseconds::zero();
+        } else {
+            // Rounded up, waking before it is due would only spin
+            timeout = std::min(timeout, std::chrono::ceil<std::chrono::milliseconds>(until));
+        }
+    };
+
+    for (auto connection : connections) {
+        if (connection->has_pending_sends()) {
+            wait_until(connection->next_send_time());
+        }
+    }
+
+    for (auto& [key, entry] : transports) {
+        if (auto wakeup = entry.transport->next_wakeup()) {
+            wait_until(*wakeup);
+        }
+    }
+
+    return timeout;
+}
+
+void NetReactor::add_unwatched_ready(ReceiveTime now) {
+    for (auto& [key, entry] : transports) {
+        auto wakeup = entry.transport->next_wakeup();
+        auto due = entry.transport->get_handle() == INVALID_SOCKET_HANDLE || (wakeup && *wakeup <= now);
+
+        if (due && std::ranges::find(ready_transports, key) == ready_transports.end()) {
+            ready_transports.push_back(key);
+        }
+    }
+}
+
+auto NetReactor::drain(TransportEntry& entry) -> size_t {
+    // Held so a callback removing the transport does not destroy it mid receive
+    auto transport = entry.transport;
+    auto received = size_t{ 0 };
+
+    for (auto i = 0U; i < incoming.size(); ++i) {
+        incoming[i].buffer = { receive_storage.get() + i * MTU, MTU };
+    }
+
+    while (true) {
+        auto count = transport->receive_batch(incoming);
+
+        for (auto i = 0U; i < count; ++i) {
+            auto& packet = incoming[i];
+            auto data = std::span<const std::byte>(packet.buffer.first(packet.size));
+            auto connection = entry.connections.find(packet.from);
+
+            if (connection != entry.connections.end()) {
+                // Dropped packets are not the reactor's concern
+                connection->second->receive_packet(data, packet.received_at);
+            } else if (on_unknown_sender) {
+                on_unknown_sender(transport, packet.from, data, packet.received_at);
+
+                // The rest of the batch has nowhere to go once the callback removed the transport
+                if (!transports.contains(transport.get())) {
+                    return received + i + 1;
+                }
+            }
+        }
+
+        received += count;
+
+        if (count < incoming.size()) {
+            return received;
+        }
+    }
+}
+
+#if defined(__linux__)
+bool NetReactor::watch(Transport& transport) {
+    auto handle = transport.get_handle();
+
+    if (handle == INVALID_SOCKET_HANDLE) {
+        return true;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &transport;
+    return epoll_ctl(epoll_handle, EPOLL_CTL_ADD, handle, &event) == 0;
+}
+
+void NetReactor::unwatch(Transport& transport) {
+    if (auto handle = transport.get_handle(); handle != INVALID_SOCKET_HANDLE) {
+        epoll_ctl(epoll_handle, EPOLL_CTL_DEL, handle, nullptr);
+    }
+}
+
+void NetReactor::wait(std::chrono::milliseconds timeout) {
+    std::array<epoll_event, MAX_EPOLL_EVENTS> events;
+    ready_transports.clear();
+
+    auto count = epoll_wait(epoll_handle, events.data(), MAX_EPOLL_EVENTS, static_cast<int>(timeout.count()));
+
+    // Interrupted by a signal, the caller comes back soon enough
+    for (auto i = 0; i < count; ++i) {
+        ready_transports.push_back(static_cast<const Transport*>(events[i].data.ptr));
+    }
+}
+#else
+bool NetReactor::watch(Transport&) {
+    return true;
+}
+
+void NetReactor::unwatch(Transport&) {}
+
+void NetReactor::wait(std::chrono::milliseconds timeout) {
+#if defined(_WIN32)
+    using PollEntry = WSAPOLLFD;
+#else
+    using PollEntry = pollfd;
+#endif
+    // Without epoll the set is rebuilt each wait, fine for the handful of sockets a client has
+    std::vector<PollEntry> entries;
+    std::vector<const Transport*> polled;
+    entries.reserve(transports.size());
+    polled.reserve(transports.size());
+    ready_transports.clear();
+
+    for (auto& [key, entry] : transports) {
+        if (auto handle = entry.transport->get_handle(); handle != INVALID_SOCKET_HANDLE) {
+            entries.push_back({ handle, POLLIN, 0 });
+            polled.push_back(key);
+        }
+    }
+
+#if defined(_WIN32)
+    // WSAPoll fails on an empty set instead of sleeping
+    if (entries.empty()) {
+        std::this_thread::sleep_for(timeout);
+        return;
+    }
+
+    auto count = WSAPoll(entries.data(), static_cast<ULONG>(entries.size()), static_cast<INT>(timeout.count()));
+#else
+    auto count = poll(entries.data(), entries.size(), static_cast<int>(timeout.count()));
+#endif
+
+    if (count <= 0) {
+        return;
+    }
+
+    for (auto i = 0U; i < entries.size(); ++i) {
+        if (entries[i].revents & POLLIN) {
+            ready_transports.push_back(polled[i]);
+        }
+    }
+}
+#endif
+}
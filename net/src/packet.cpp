@@ -0,0 +1,40 @@
+#include <cassert>
+
+#include "ducklib/net/crc32c.h"
+#include "ducklib/net/packet.h"
+
+namespace ducklib::net {
+namespace {
+uint32_t packet_crc(std::span<const std::byte> payload, uint32_t protocol_id) {
+    std::byte salt[sizeof(protocol_id)];
+    for (auto i = 0U; i < sizeof(protocol_id); ++i) {
+        salt[i] = static_cast<std::byte>(protocol_id >> (i * 8));
+    }
+
+    return crc32c(payload, crc32c(salt));
+}
+}
+
+void write_packet_crc(std::span<std::byte> packet, uint32_t protocol_id) {
+    assert(packet.size() >= PACKET_CRC_SIZE);
+    auto crc = packet_crc(packet.subspan(PACKET_CRC_SIZE), protocol_id);
+
+    for (auto i = 0U; i < PACKET_CRC_SIZE; ++i) {
+        packet[i] = static_cast<std::byte>(crc >> (i * 8));
+    }
+}
+
+bool check_packet_crc(std::span<const std::byte> packet, uint32_t protocol_id) {
+    [[unlikely]]
+    if (packet.size() < PACKET_CRC_SIZE) {
+        return false;
+    }
+
+    uint32_t received_crc = 0;
+    for (auto i = 0U; i < PACKET_CRC_SIZE; ++i) {
+        received_crc |= static_cast<uint32_t>(packet[i]) << (i * 8);
+    }
+
+    return received_crc == packet_crc(packet.subspan(PACKET_CRC_SIZE), protocol_id);
+}
+}
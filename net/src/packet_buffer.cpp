@@ -0,0 +1,60 @@
+#include "ducklib/net/packet_buffer.h"
+#include "ducklib/net/serialization.h"
+
+#include <algorithm>
+
+namespace ducklib::net {
+PacketBufferPool::PacketBufferPool(uint32_t buffer_count, uint32_t buffer_size)
+    : storage(std::make_unique<std::byte[]>(static_cast<size_t>(buffer_count) * buffer_size))
+    , buffers(std::make_unique<PacketBuffer[]>(buffer_count))
+    , buffer_count(buffer_count)
+    , size_per_buffer(buffer_size)
+    , available_count(buffer_count) {
+    for (auto i = buffer_count; i-- > 0;) {
+        buffers[i] = { storage.get() + static_cast<size_t>(i) * buffer_size, 0, 0, this, free_list };
+        free_list = &buffers[i];
+    }
+}
+
+PacketBufferPool::~PacketBufferPool() {
+    assert(available_count == buffer_count && "Packet refs or views outlived their pool");
+}
+
+PacketRef PacketBufferPool::acquire() {
+    ++acquire_count;
+
+    [[unlikely]]
+    if (free_list == nullptr) {
+        ++miss_count;
+        return {};
+    }
+
+    auto buffer = free_list;
+    free_list = buffer->next_free;
+    buffer->next_free = nullptr;
+    buffer->size = 0;
+    buffer->ref_count = 1;
+    --available_count;
+    peak_in_use = std::max(peak_in_use, buffer_count - available_count);
+
+    return PacketRef(buffer);
+}
+
+PoolStats PacketBufferPool::stats() const {
+    return { size_per_buffer, buffer_count, buffer_count - available_count, peak_in_use, acquire_count, miss_count };
+}
+
+void PacketBufferPool::release(PacketBuffer* buffer) {
+    buffer->next_free = free_list;
+    free_list = buffer;
+    ++available_count;
+}
+
+bool serialize_data_view(NetReadStream& stream, const PacketRef& packet, PacketView& view, uint16_t byte_size) {
+    std::span<const std::byte> bytes;
+    stream.align_to_byte();
+    DL_NET_CHECK(stream.serialize_view(bytes, byte_size));
+    view = packet.view(bytes);
+    return true;
+}
+}
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <bit>
+
+#include "ducklib/net/range_coder.h"
+
+namespace ducklib::net {
+namespace {
+constexpr uint32_t PROBABILITY_BITS = 11;
+constexpr uint16_t PROBABILITY_ONE = 1 << PROBABILITY_BITS;
+constexpr uint32_t ADAPTATION_SHIFT = 5;
+constexpr uint32_t TOP_VALUE = 1U << 24;
+constexpr uint32_t TREE_BITS = 8; // Values up to this width are coded whole with value_tree
+constexpr uint32_t LENGTH_BITS = 7;
+constexpr uint32_t CODE_BYTES = sizeof(uint32_t);
+}
+
+void RangeCoderModels::reset() {
+    for (auto& field : fields) {
+        field.value_tree.fill(PROBABILITY_ONE / 2);
+        field.length_tree.fill(PROBABILITY_ONE / 2);
+        field.mantissa.fill(PROBABILITY_ONE / 2);
+    }
+}
+
+/// Narrow values are coded MSB first down a binary tree so the model learns their whole distribution. Wider ones are
+/// coded as their bit width followed by the bits below the leading one, which favours small magnitudes.
+void NetRangeWriteStream::encode(RangeFieldModel& model, uint64_t value, uint8_t bits) {
+    if (bits <= TREE_BITS) {
+        auto node = 1U;
+
+        for (auto i = bits; i-- > 0;) {
+            auto bit = static_cast<uint32_t>(value >> i) & 1;
+            encode_bit(model.value_tree[node], bit);
+            node = (node << 1) | bit;
+        }
+
+        return;
+    }
+
+    auto length = static_cast<uint32_t>(std::bit_width(value));
+    auto node = 1U;
+
+    for (auto i = LENGTH_BITS; i-- > 0;) {
+        auto bit = (length >> i) & 1;
+        encode_bit(model.length_tree[node], bit);
+        node = (node << 1) | bit;
+    }
+
+    for (auto i = length > 0 ? length - 1 : 0; i-- > 0;) {
+        encode_bit(model.mantissa[i], static_cast<uint32_t>(value >> i) & 1);
+    }
+}
+
+void NetRangeWriteStream::encode_bit(uint16_t& probability, uint32_t bit) {
+    auto bound = (range >> PROBABILITY_BITS) * probability;
+
+    if (bit == 0) {
+        range = bound;
+        probability += (PROBABILITY_ONE - probability) >> ADAPTATION_SHIFT;
+    } else {
+        low += bound;
+        range -= bound;
+        probability -= probability >> ADAPTATION_SHIFT;
+    }
+
+    while (range < TOP_VALUE) {
+        range <<= 8;
+        shift_low();
+    }
+}
+
+/// Holds back the top byte of low while it can still change from a carry, along with any 0xff bytes after it
+void NetRangeWriteStream::shift_low() {
+    if (static_cast<uint32_t>(low) < 0xff000000 || (low >> 32) != 0) {
+        auto carry = static_cast<uint8_t>(low >> 32);
+        auto byte = cache;
+
+        do {
+            output_byte(static_cast<uint8_t>(byte + carry));
+            byte = 0xff;
+        } while (--pending_bytes != 0);
+
+        cache = static_cast<uint8_t>(low >> 24);
+    }
+
+    ++pending_bytes;
+    low = (low & 0x00ffffff) << 8;
+}
+
+void NetRangeWriteStream::output_byte(uint8_t byte) {
+    // The first byte is always 0, the reader starts without it
+    if (first_byte) {
+        first_byte = false;
+        return;
+    }
+
+    [[unlikely]]
+    if (bits_written / 8 >= buffer.size()) {
+        overflow = true;
+        return;
+    }
+
+    buffer[bits_written / 8] = static_cast<std::byte>(byte);
+    bits_written += 8;
+}
+
+bool NetRangeWriteStream::serialize_data(std::byte* data, uint32_t data_bit_size) {
+    assert(data_bit_size > 0);
+    auto& model = models.fields[next_field++ % MAX_RANGE_FIELD_MODELS];
+    auto whole_byte_count = data_bit_size >> 3;
+
+    for (auto i = 0U; i < whole_byte_count; ++i) {
+        encode(model, static_cast<uint8_t>(data[i]), 8);
+    }
+
+    auto tail_bits = data_bit_size & 0x7;
+    if (tail_bits > 0) {
+        auto tail = static_cast<uint8_t>(data[whole_byte_count]) & ((1U << tail_bits) - 1);
+        encode(model, tail, static_cast<uint8_t>(tail_bits));
+    }
+
+    return !overflow;
+}
+
+bool NetRangeWriteStream::serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits) {
+    assert(bits > 0 && bits <= 32);
+    auto& model = models.fields[next_field++ % MAX_RANGE_FIELD_MODELS];
+
+    for (auto i = 0U; i < count; ++i) {
+        encode(model, values[i], bits);
+    }
+
+    return !overflow;
+}
+
+uint16_t NetRangeWriteStream::bits_left() const {
+    auto reserved_bytes = bits_written / 8 + pending_bytes + CODE_BYTES;
+    auto left_bytes = buffer.size() > reserved_bytes ? buffer.size() - reserved_bytes : 0;
+    return static_cast<uint16_t>(std::min<size_t>(left_bytes * 8, UINT16_MAX));
+}
+
+/// Picks the value in [low, low + range) with the most trailing zero bytes and outputs it without them, the reader
+/// pads the end of the stream with zeros.
+bool NetRangeWriteStream::flush_scratch() {
+    auto byte_count = 1U;
+    auto value = low;
+
+    for (; byte_count < CODE_BYTES; ++byte_count) {
+        auto zero_mask = ~0ULL >> (SCRATCH_SIZE_BITS - (CODE_BYTES - byte_count) * 8);
+        value = (low + zero_mask) & ~zero_mask;
+
+        if (value < low + range) {
+            break;
+        }
+    }
+
+    if (byte_count == CODE_BYTES) {
+        value = low;
+    }
+
+    low = value;
+    for (auto i = 0U; i <= byte_count || pending_bytes > 1; ++i) {
+        shift_low();
+    }
+
+    while (bits_written > 0 && buffer[bits_written / 8 - 1] == std::byte{ 0 }) {
+        bits_written -= 8;
+    }
+
+    return !overflow;
+}
+
+NetRangeReadStream::NetRangeReadStream(const std::byte* data, uint32_t bit_size, RangeCoderModels& models)
+    : buffer(data, (bit_size + 7) / 8)
+    , models(models) {
+    for (auto i = 0U; i < CODE_BYTES; ++i) {
+        code = (code << 8) | input_byte();
+    }
+}
+
+uint64_t NetRangeReadStream::decode(RangeFieldModel& model, uint8_t bits) {
+    if (bits <= TREE_BITS) {
+        auto node = 1U;
+
+        for (auto i = 0U; i < bits; ++i) {
+            node = (node << 1) | decode_bit(model.value_tree[node]);
+        }
+
+        return node - (1U << bits);
+    }
+
+    auto node = 1U;
+    for (auto i = 0U; i < LENGTH_BITS; ++i) {
+        node = (node << 1) | decode_bit(model.length_tree[node]);
+    }
+
+    auto length = node - (1U << LENGTH_BITS);
+
+    // Only a corrupt stream decodes to more bits than the field has
+    [[unlikely]]
+    if (length > bits) {
+        corrupt = true;
+        return 0;
+    }
+
+    if (length == 0) {
+        return 0;
+    }
+
+    auto value = uint64_t{ 1 };
+    for (auto i = length - 1; i-- > 0;) {
+        value = (value << 1) | decode_bit(model.mantissa[i]);
+    }
+
+    return value;
+}
+
+uint32_t NetRangeReadStream::decode_bit(uint16_t& probability) {
+    auto bound = (range >> PROBABILITY_BITS) * probability;
+    uint32_t bit;
+
+    if (code < bound) {
+        range = bound;
+        probability += (PROBABILITY_ONE - probability) >> ADAPTATION_SHIFT;
+        bit = 0;
+    } else {
+        code -= bound;
+        range -= bound;
+        probability -= probability >> ADAPTATION_SHIFT;
+        bit = 1;
+    }
+
+    while (range < TOP_VALUE) {
+        range <<= 8;
+        code = (code << 8) | input_byte();
+    }
+
+    return bit;
+}
+
+/// The writer leaves out trailing zero bytes
+uint8_t NetRangeReadStream::input_byte() {
+    if (bytes_read >= buffer.size()) {
+        return 0;
+    }
+
+    return static_cast<uint8_t>(buffer[bytes_read++]);
+}
+
+bool NetRangeReadStream::serialize_data(std::byte* data, uint16_t data_bit_size) {
+    assert(data_bit_size > 0);
+    auto& model = models.fields[next_field++ % MAX_RANGE_FIELD_MODELS];
+    auto whole_byte_count = static_cast<uint32_t>(data_bit_size >> 3);
+
+    for (auto i = 0U; i < whole_byte_count; ++i) {
+        data[i] = static_cast<std::byte>(decode(model, 8));
+    }
+
+    auto tail_bits = data_bit_size & 0x7;
+    if (tail_bits > 0) {
+        data[whole_byte_count] = static_cast<std::byte>(decode(model, static_cast<uint8_t>(tail_bits)));
+    }
+
+    return !corrupt;
+}
+
+bool NetRangeReadStream::serialize_packed(uint32_t* values, uint32_t count, uint8_t bits) {
+    assert(bits > 0 && bits <= 32);
+    auto& model = models.fields[next_field++ % MAX_RANGE_FIELD_MODELS];
+
+    for (auto i = 0U; i < count; ++i) {
+        values[i] = static_cast<uint32_t>(decode(model, bits));
+    }
+
+    return !corrupt;
+}
+
+uint16_t NetRangeReadStream::bits_left() const {
+    return corrupt ? 0 : UINT16_MAX;
+}
+}
@@ -1,64 +1,222 @@
+#include <bit>
 #include <cassert>
+#include <cstring>
 
 #include "ducklib/net/serialization.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DL_NET_SSE2 1
+#include <emmintrin.h>
+#endif
+
 namespace ducklib::net {
+namespace {
+ScratchType low_bits_mask(uint32_t bit_count) {
+    return bit_count >= SCRATCH_SIZE_BITS ? ~0ULL : (1ULL << bit_count) - 1;
+}
+
+ScratchType load_word(const std::byte* source) {
+    ScratchType word;
+    memcpy(&word, source, sizeof(word));
+
+    if constexpr (std::endian::native == std::endian::big) {
+        word = std::byteswap(word);
+    }
+
+    return word;
+}
+
+void store_word(std::byte* destination, ScratchType word) {
+    if constexpr (std::endian::native == std::endian::big) {
+        word = std::byteswap(word);
+    }
+
+    memcpy(destination, &word, sizeof(word));
+}
+
+/// Loads the bytes covering bit_count bits (1-64) and masks off everything above them
+ScratchType load_partial_word(const std::byte* source, uint32_t bit_count) {
+    auto byte_count = (bit_count + 7) >> 3;
+    ScratchType word = 0;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        memcpy(&word, source, byte_count);
+    } else {
+        for (auto i = 0U; i < byte_count; ++i) {
+            word |= static_cast<ScratchType>(static_cast<uint8_t>(source[i])) << (i * 8);
+        }
+    }
+
+    return word & low_bits_mask(bit_count);
+}
+
+/// Stores the bytes covering bit_count bits (0-64), the last byte is written whole
+void store_partial_word(std::byte* destination, ScratchType word, uint32_t bit_count) {
+    auto byte_count = (bit_count + 7) >> 3;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        memcpy(destination, &word, byte_count);
+    } else {
+        for (auto i = 0U; i < byte_count; ++i) {
+            destination[i] = static_cast<std::byte>((word >> (i * 8)) & 0xff);
+        }
+    }
+}
+
+/// Packs four values of bits (1-16) each into the low 4 * bits bits of a word, first value lowest
+ScratchType pack_four(const uint32_t* values, uint8_t bits) {
+#ifdef DL_NET_SSE2
+    auto value_mask = _mm_set1_epi32(static_cast<int>(low_bits_mask(bits)));
+    auto lanes = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)), value_mask);
+    auto even = _mm_and_si128(lanes, _mm_set_epi32(0, -1, 0, -1));
+    auto odd = _mm_srli_epi64(lanes, 32);
+    auto pairs = _mm_or_si128(even, _mm_sll_epi64(odd, _mm_cvtsi32_si128(bits)));
+    auto quad = _mm_or_si128(pairs, _mm_sll_epi64(_mm_srli_si128(pairs, 8), _mm_cvtsi32_si128(bits * 2)));
+    ScratchType chunk;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(&chunk), quad);
+    return chunk;
+#else
+    auto mask = low_bits_mask(bits);
+    return (values[0] & mask)
+        | ((values[1] & mask) << bits)
+        | ((values[2] & mask) << (bits * 2))
+        | ((values[3] & mask) << (bits * 3));
+#endif
+}
+
+void unpack_four(ScratchType chunk, uint8_t bits, uint32_t* values) {
+#ifdef DL_NET_SSE2
+    auto lanes = _mm_set_epi64x(static_cast<long long>(chunk >> (bits * 2)), static_cast<long long>(chunk));
+    auto mask = _mm_set1_epi64x(static_cast<long long>(low_bits_mask(bits)));
+    auto even = _mm_and_si128(lanes, mask);
+    auto odd = _mm_and_si128(_mm_srl_epi64(lanes, _mm_cvtsi32_si128(bits)), mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_or_si128(even, _mm_slli_epi64(odd, 32)));
+#else
+    auto mask = low_bits_mask(bits);
+    values[0] = static_cast<uint32_t>(chunk & mask);
+    values[1] = static_cast<uint32_t>((chunk >> bits) & mask);
+    values[2] = static_cast<uint32_t>((chunk >> (bits * 2)) & mask);
+    values[3] = static_cast<uint32_t>((chunk >> (bits * 3)) & mask);
+#endif
+}
+}
+
+/// Data is moved a 64-bit word at a time. When the stream is byte aligned the scratch is committed and the body is
+/// copied with memcpy, otherwise every data word is funnel-shifted across the scratch and stored as a whole word.
 bool NetWriteStream::serialize_data(std::byte* data, uint32_t data_bit_size) {
     assert(data_bit_size > 0);
 
+    [[unlikely]]
     if (data_bit_size > bits_left()) {
         return false;
     }
-    
-    uint8_t remaining_scratch_bits = SCRATCH_SIZE_BITS - scratch_bits;
-
-    // First part
-    if (data_bit_size <= remaining_scratch_bits) {
-        // Put all bits in a new scratch value so it can be shifted and put into the real scratch value
-        auto full_byte_count = data_bit_size >> 3;
-        ScratchType temp_scratch = 0;
-        memcpy(&temp_scratch, data, full_byte_count);
-        auto tail_byte_bits = (data_bit_size - full_byte_count * 8);
-        auto tail_byte_mask = tail_byte_bits > 0 ? ~0ULL >> (SCRATCH_SIZE_BITS - tail_byte_bits) : 0;
-        temp_scratch |= (static_cast<uint8_t>(data[full_byte_count]) & tail_byte_mask) << (full_byte_count * 8);
-        scratch |= temp_scratch << scratch_bits;
-        scratch_bits += data_bit_size;
+
+    [[unlikely]]
+    if (scratch_bits == SCRATCH_SIZE_BITS) {
+        DL_NET_CHECK(flush_scratch());
+    }
+
+    // Small payloads go straight into the scratch
+    if (data_bit_size <= static_cast<uint32_t>(SCRATCH_SIZE_BITS - scratch_bits)) {
+        scratch |= load_partial_word(data, data_bit_size) << scratch_bits;
+        scratch_bits += static_cast<uint8_t>(data_bit_size);
         return true;
     }
-    
-    auto head_tail_bits = -scratch_bits & 0x7;
-    auto head_mask = head_tail_bits > 0 ? ~0ULL >> (SCRATCH_SIZE_BITS - head_tail_bits) : 0;
-    scratch |= (static_cast<uint8_t>(*data) & head_mask) << scratch_bits;
-    scratch_bits += head_tail_bits;
-    flush_scratch();
-    auto bits_to_write = data_bit_size - head_tail_bits;
-
-    // Middle part
-    const auto whole_data_bytes_left = bits_to_write >> 3;
-    auto data_bytes_written = 0U;
-    auto bytes_written = bits_written >> 3;
-    const auto data_bit_offset = head_tail_bits;
-    if (data_bit_offset == 0) {
-        memcpy(&buffer[bytes_written], &data[data_bytes_written], whole_data_bytes_left);
-    } else {
-        const auto rev_data_offset = 8 - data_bit_offset;
 
-        for (auto i = data_bytes_written; i < data_bytes_written + whole_data_bytes_left; ++i) {
-            buffer[bytes_written++] = (data[i] >> data_bit_offset) | (data[i+1] << rev_data_offset);
+    // Byte aligned: commit the scratch and copy whole bytes into the buffer
+    if ((scratch_bits & 0x7) == 0) {
+        DL_NET_CHECK(flush_scratch());
+        auto whole_byte_count = data_bit_size >> 3;
+        memcpy(buffer.data() + (bits_written >> 3), data, whole_byte_count);
+        bits_written += whole_byte_count << 3;
+
+        auto tail_bits = data_bit_size & 0x7;
+        if (tail_bits > 0) {
+            scratch = static_cast<uint8_t>(data[whole_byte_count]) & low_bits_mask(tail_bits);
+            scratch_bits = static_cast<uint8_t>(tail_bits);
         }
+
+        return true;
     }
 
-    bits_to_write -= whole_data_bytes_left << 3;
-    data_bytes_written += whole_data_bytes_left;
+    // Misaligned: scratch_bits stays the same while whole words pass through it
+    const auto offset = scratch_bits;
+    const auto word_count = data_bit_size / SCRATCH_SIZE_BITS;
+    auto destination = buffer.data() + (bits_written >> 3);
 
-    // Last part
-    if (bits_to_write > 0) {
-        auto mask = ~0ULL >> (SCRATCH_SIZE_BITS - bits_to_write);
-        scratch = (static_cast<uint8_t>(data[data_bytes_written]) >> data_bit_offset) & mask;
-        scratch_bits = (uint8_t)bits_to_write;
+    for (auto i = 0U; i < word_count; ++i) {
+        auto word = load_word(data + i * sizeof(ScratchType));
+        store_word(destination + i * sizeof(ScratchType), scratch | (word << offset));
+        scratch = word >> (SCRATCH_SIZE_BITS - offset);
+    }
+
+    bits_written += word_count * SCRATCH_SIZE_BITS;
+    auto tail_bits = data_bit_size - word_count * SCRATCH_SIZE_BITS;
+
+    if (tail_bits > 0) {
+        auto tail = load_partial_word(data + word_count * sizeof(ScratchType), tail_bits);
+        scratch |= tail << offset;
+
+        if (offset + tail_bits >= SCRATCH_SIZE_BITS) {
+            store_word(destination + word_count * sizeof(ScratchType), scratch);
+            bits_written += SCRATCH_SIZE_BITS;
+            scratch = tail >> (SCRATCH_SIZE_BITS - offset);
+            scratch_bits = static_cast<uint8_t>(offset + tail_bits - SCRATCH_SIZE_BITS);
+        } else {
+            scratch_bits = static_cast<uint8_t>(offset + tail_bits);
+        }
+    }
+
+    return true;
+}
+
+/// Values are combined into chunks of up to 64 bits (four at a time up to 16 bits, two at a time above that) so the
+/// scratch is only touched once per chunk, and capacity is checked once for the whole array.
+bool NetWriteStream::serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits) {
+    assert(bits > 0 && bits <= 32);
+
+    [[unlikely]]
+    if (count * bits > bits_left()) {
+        return false;
+    }
+
+    [[unlikely]]
+    if (scratch_bits == SCRATCH_SIZE_BITS) {
+        DL_NET_CHECK(flush_scratch());
+    }
+
+    // Keeps scratch_bits below SCRATCH_SIZE_BITS by storing the scratch as soon as it fills up
+    auto append = [this](ScratchType chunk, uint32_t chunk_bits) {
+        scratch |= chunk << scratch_bits;
+        auto total_bits = scratch_bits + chunk_bits;
+
+        if (total_bits >= SCRATCH_SIZE_BITS) {
+            store_word(buffer.data() + (bits_written >> 3), scratch);
+            bits_written += SCRATCH_SIZE_BITS;
+            scratch = scratch_bits > 0 ? chunk >> (SCRATCH_SIZE_BITS - scratch_bits) : 0;
+            scratch_bits = static_cast<uint8_t>(total_bits - SCRATCH_SIZE_BITS);
+        } else {
+            scratch_bits = static_cast<uint8_t>(total_bits);
+        }
+    };
+
+    auto mask = low_bits_mask(bits);
+    auto i = 0U;
+
+    if (bits <= 16) {
+        for (; i + 4 <= count; i += 4) {
+            append(pack_four(values + i, bits), bits * 4U);
+        }
+    } else {
+        for (; i + 2 <= count; i += 2) {
+            append((values[i] & mask) | ((values[i + 1] & mask) << bits), bits * 2U);
+        }
+    }
+
+    for (; i < count; ++i) {
+        append(values[i] & mask, bits);
     }
 
-    bits_written += data_bit_size;
     return true;
 }
 
@@ -82,81 +240,134 @@ bool NetWriteStream::flush_scratch() {
 
     [[likely]]
     if (scratch_bytes == sizeof(scratch)) {
-        for (auto i = 0U; i < sizeof(scratch); ++i) {
-            buffer[bytes_written++] = static_cast<std::byte>((scratch >> (i * 8)) & 0xff);
-        }
-        bits_written += SCRATCH_SIZE_BITS;
+        store_word(buffer.data() + bytes_written, scratch);
     } else {
-        for (auto i = 0; i < scratch_bytes; ++i) {
-            buffer[bytes_written++] = static_cast<std::byte>((scratch >> (i * 8)) & 0xff);
-        }
-        bits_written += scratch_bytes * 8;
+        store_partial_word(buffer.data() + bytes_written, scratch, scratch_bytes * 8);
     }
 
+    bits_written += scratch_bytes * 8;
     scratch_bits = 0;
     scratch = 0;
     return true;
 }
 
-/// head, body, and tail terms are used for the first, middle, and last part of the functionality
+/// Payloads that are already in the scratch are taken from it, anything larger is read word by word straight from
+/// the buffer and the scratch is reloaded at the new position afterwards.
 bool NetReadStream::serialize_data(std::byte* data, uint16_t data_bit_size) {
     assert(data_bit_size > 0);
-    
+
+    [[unlikely]]
     if (data_bit_size > bits_left()) {
         return false;
     }
-    
-    // First part (to consume scratch and reach a byte boundary in the read buffer (data))
-    auto head_scratch_bits = std::min(data_bit_size, static_cast<uint16_t>(scratch_bits - scratch_bits_consumed));
-    auto head_scratch_byte_count = head_scratch_bits >> 3;
-
-    for (auto i = 0; i < head_scratch_byte_count; ++i) {
-        data[i] = static_cast<std::byte>((scratch >> (scratch_bits_consumed + i * 8)) & 0xff);
-    }
-    
-    auto head_byte_bits_copied = head_scratch_byte_count * 8;
-    scratch_bits_consumed += head_byte_bits_copied;
-    auto trailing_scratch_bits = head_scratch_bits - head_byte_bits_copied;
-    auto trailing_scratch_mask = trailing_scratch_bits > 0 ? ~0ULL >> (SCRATCH_SIZE_BITS - trailing_scratch_bits) : 0;
-    data[head_scratch_byte_count] = static_cast<std::byte>((scratch >> scratch_bits_consumed) & trailing_scratch_mask);
-    scratch_bits_consumed += trailing_scratch_bits;
-    
-    auto head_bits_written = head_byte_bits_copied + trailing_scratch_bits;
-    auto buffer_offset_bits = std::min((8 - (head_bits_written & 0x7)) & 0x7, data_bit_size - head_bits_written); // TODO: Reconsider min???
-    auto align_mask = static_cast<std::byte>(~0U) >> (8 - buffer_offset_bits);
-    data[head_scratch_byte_count] |= (buffer[bits_read >> 3] & align_mask) << (8 - buffer_offset_bits);
-    bits_read += buffer_offset_bits;
-    
-    auto bits_copied = head_byte_bits_copied + trailing_scratch_bits + buffer_offset_bits;
-    
-    // Middle part (just loop bytes)
-    auto middle_bits = data_bit_size - bits_copied;
-    auto middle_bytes = middle_bits >> 3;
-    auto start_dest_byte = bits_copied >> 3;
-    auto start_src_byte = bits_read >> 3;
-    
-    if (buffer_offset_bits == 0) {
-        memcpy(&data[start_dest_byte], &buffer[start_src_byte], middle_bytes);
+
+    auto scratch_bits_remaining = static_cast<uint32_t>(scratch_bits - scratch_bits_consumed);
+
+    if (data_bit_size <= scratch_bits_remaining) {
+        auto value = (scratch >> scratch_bits_consumed) & low_bits_mask(data_bit_size);
+        store_partial_word(data, value, data_bit_size);
+        scratch_bits_consumed += static_cast<uint8_t>(data_bit_size);
+        return true;
+    }
+
+    auto position = bits_read - scratch_bits_remaining;
+    auto source = buffer.data() + (position >> 3);
+    auto offset = position & 0x7;
+
+    if (offset == 0) {
+        auto whole_byte_count = data_bit_size >> 3;
+        memcpy(data, source, whole_byte_count);
+
+        auto tail_bits = data_bit_size & 0x7U;
+        if (tail_bits > 0) {
+            data[whole_byte_count] = static_cast<std::byte>(
+                static_cast<uint8_t>(source[whole_byte_count]) & low_bits_mask(tail_bits));
+        }
+    } else {
+        // Every output word spans 9 source bytes, the 9th is always part of the payload
+        const auto word_count = static_cast<uint32_t>(data_bit_size / SCRATCH_SIZE_BITS);
+
+        for (auto i = 0U; i < word_count; ++i) {
+            auto word_source = source + i * sizeof(ScratchType);
+            auto low = load_word(word_source);
+            auto high = static_cast<ScratchType>(static_cast<uint8_t>(word_source[sizeof(ScratchType)]));
+            store_word(data + i * sizeof(ScratchType), (low >> offset) | (high << (SCRATCH_SIZE_BITS - offset)));
+        }
+
+        auto tail_bits = data_bit_size - word_count * SCRATCH_SIZE_BITS;
+
+        if (tail_bits > 0) {
+            auto tail_source = source + word_count * sizeof(ScratchType);
+            auto tail_span_bits = offset + tail_bits;
+            auto tail = load_partial_word(tail_source, std::min(tail_span_bits, static_cast<uint32_t>(SCRATCH_SIZE_BITS)))
+                >> offset;
+
+            if (tail_span_bits > SCRATCH_SIZE_BITS) {
+                tail |= static_cast<ScratchType>(static_cast<uint8_t>(tail_source[sizeof(ScratchType)]))
+                    << (SCRATCH_SIZE_BITS - offset);
+            }
+
+            store_partial_word(data + word_count * sizeof(ScratchType), tail & low_bits_mask(tail_bits), tail_bits);
+        }
+    }
+
+    seek(position + data_bit_size);
+    return true;
+}
+
+bool NetReadStream::serialize_view(std::span<const std::byte>& view, uint16_t byte_size) {
+    auto position = bits_read - (scratch_bits - scratch_bits_consumed);
+    DL_NET_CHECK((position & 0x7) == 0);
+    DL_NET_CHECK(byte_size * 8U <= bits_left());
+
+    view = buffer.subspan(position >> 3, byte_size);
+    seek(position + byte_size * 8U);
+    return true;
+}
+
+bool NetReadStream::serialize_packed(uint32_t* values, uint32_t count, uint8_t bits) {
+    assert(bits > 0 && bits <= 32);
+
+    [[unlikely]]
+    if (count * bits > bits_left()) {
+        return false;
+    }
+
+    // Capacity is already checked, so refilling the scratch always succeeds
+    auto take = [this](uint32_t chunk_bits) {
+        auto scratch_bits_remaining = static_cast<uint32_t>(scratch_bits - scratch_bits_consumed);
+
+        if (chunk_bits <= scratch_bits_remaining) {
+            auto chunk = (scratch >> scratch_bits_consumed) & low_bits_mask(chunk_bits);
+            scratch_bits_consumed += static_cast<uint8_t>(chunk_bits);
+            return chunk;
+        }
+
+        auto low = scratch_bits_remaining > 0 ? scratch >> scratch_bits_consumed : 0;
+        read_scratch();
+        auto chunk = (low | (scratch << scratch_bits_remaining)) & low_bits_mask(chunk_bits);
+        scratch_bits_consumed = static_cast<uint8_t>(chunk_bits - scratch_bits_remaining);
+        return chunk;
+    };
+
+    auto mask = low_bits_mask(bits);
+    auto i = 0U;
+
+    if (bits <= 16) {
+        for (; i + 4 <= count; i += 4) {
+            unpack_four(take(bits * 4U), bits, values + i);
+        }
     } else {
-        auto low_offset = buffer_offset_bits;
-        auto high_offset = 8 - buffer_offset_bits;
-        auto low_mask = static_cast<std::byte>(~0U) >> (8 - high_offset);
-        auto high_mask = static_cast<std::byte>(~0U) >> (8 - low_offset);
-
-        for (auto i = 0; i < middle_bytes; ++i) {
-            data[start_dest_byte + i] = ((buffer[start_src_byte + i] >> low_offset) & low_mask)
-                | ((buffer[start_src_byte + i + 1] & high_mask) << high_offset);
+        for (; i + 2 <= count; i += 2) {
+            auto chunk = take(bits * 2U);
+            values[i] = static_cast<uint32_t>(chunk & mask);
+            values[i + 1] = static_cast<uint32_t>((chunk >> bits) & mask);
         }
     }
-    
-    bits_read += middle_bits;
-    bits_copied += middle_bits;
-    
-    // Last part (read leftovers)
-    auto last_bits = data_bit_size - bits_copied;
-    auto last_mask = static_cast<std::byte>(~0U >> (8 - last_bits));
-    data[bits_read >> 3] |= (buffer[bits_copied >> 3] >> (8 - last_bits)) & last_mask;
-    bits_read += last_bits;
+
+    for (; i < count; ++i) {
+        values[i] = static_cast<uint32_t>(take(bits));
+    }
 
     return true;
 }
@@ -167,7 +378,23 @@ void NetReadStream::align_to_byte() {
 }
 
 uint16_t NetReadStream::bits_left() const {
-    return uint16_t((bit_size - bits_read) + (scratch_bits - scratch_bits_consumed));
+    // Aligning in the last partial scratch can move past the end of the packet
+    auto left = static_cast<int32_t>(bit_size - bits_read) + scratch_bits - scratch_bits_consumed;
+    return static_cast<uint16_t>(std::max(left, 0));
+}
+
+/// Reloads the scratch from the byte containing the new position
+void NetReadStream::seek(uint32_t position) {
+    assert(position <= bit_size);
+    bits_read = position & ~0x7U;
+    scratch = 0;
+    scratch_bits = 0;
+    scratch_bits_consumed = 0;
+
+    if (bits_read < bit_size) {
+        read_scratch();
+        scratch_bits_consumed = static_cast<uint8_t>(position & 0x7);
+    }
 }
 
 bool NetReadStream::read_scratch() {
@@ -176,23 +403,16 @@ bool NetReadStream::read_scratch() {
     }
 
     assert((bits_read & 0x7) == 0 && "Bits read should be a multiple of 8 when reading a new scratch");
-    auto total_bytes_read = bits_read >> 3;
+    auto source = buffer.data() + (bits_read >> 3);
     auto bits_to_read = std::min(bit_size - bits_read, static_cast<uint32_t>(SCRATCH_SIZE_BITS));
-    auto bytes_to_read = bits_to_read >> 3;
-    scratch = 0;
-    
-    for (auto i = 0U; i < bytes_to_read; ++i) {
-        scratch |= static_cast<ScratchType>(static_cast<uint8_t>(buffer[total_bytes_read + i])) << (8 * i);
-    }
-    
-    total_bytes_read += bytes_to_read;
-    auto trailing_bits = bits_to_read - bytes_to_read * 8;
-    
-    if (trailing_bits) {
-        auto tail_mask = ~0ULL >> (SCRATCH_SIZE_BITS - trailing_bits);
-        scratch |= (static_cast<uint8_t>(buffer[total_bytes_read]) & tail_mask) << (bytes_to_read * 8U);
-    }
-    
+
+    [[likely]]
+    if (bits_to_read == SCRATCH_SIZE_BITS) {
+        scratch = load_word(source);
+    } else {
+        scratch = load_partial_word(source, bits_to_read);
+    }
+
     bits_read += bits_to_read;
     scratch_bits = (uint8_t)bits_to_read;
     scratch_bits_consumed = 0;
@@ -0,0 +1,223 @@
+#include "ducklib/net/sharded_listener.h"
+#include "ducklib/net/net_reactor.h"
+#include "ducklib/net/packet.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+#if defined(DL_NET_SOCKET_REUSEPORT)
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+namespace ducklib::net {
+namespace {
+constexpr uint32_t STEERING_HASH_MULTIPLIER = 0x9e3779b1; // 2^32 / golden ratio, spreads nearby addresses and ports
+}
+
+struct ShardedListener::Shard {
+    uint32_t index = 0;
+    std::shared_ptr<Socket> socket;
+    NetReactor reactor;
+    std::shared_ptr<MessagePool> message_pool = std::make_shared<MessagePool>(); // Shared by the shard's connections
+    ShardConnections connections; // Destroyed before the reactor that points at them
+    std::vector<Address> pending_disconnects;
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::atomic<size_t> connection_count = 0;
+    std::atomic<uint64_t> received_count = 0;
+};
+
+ShardedListener::ShardedListener(uint16_t port, const ShardedListenerConfig& config)
+    : config(config)
+    , port(port) {
+    auto shard_count = config.shard_count != 0 ? config.shard_count : std::max(std::thread::hardware_concurrency(), 1U);
+#if !defined(DL_NET_SOCKET_REUSEPORT)
+    shard_count = 1;
+#endif
+    auto options = SocketOptions{ .reuse_port = shard_count > 1 };
+
+    for (auto i = 0U; i < shard_count; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->index = i;
+        shard->socket = std::make_shared<Socket>(this->port, options);
+
+        // The first socket picks the port when asked for any, the rest have to join it. Shards that failed to bind
+        // are left out, shard_count tells how many there are.
+        if (shard->socket->get_port() == 0 || (this->port != 0 && shard->socket->get_port() != this->port)) {
+            break;
+        }
+
+        this->port = shard->socket->get_port();
+        shard->reactor.add_transport(shard->socket);
+        shard->reactor.set_unknown_sender_callback(
+            [this, shard = shard.get()](
+                const std::shared_ptr<Transport>&,
+                const Address& from,
+                std::span<const std::byte> packet,
+                ReceiveTime received_at) { accept_connection(*shard, from, packet, received_at); });
+        shards.push_back(std::move(shard));
+    }
+
+    if (config.steer_by_source && shards.size() > 1) {
+        steered = attach_steering_program();
+    }
+}
+
+ShardedListener::~ShardedListener() {
+    stop();
+}
+
+bool ShardedListener::start(AcceptCallback accept, TickCallback tick) {
+    DL_NET_CHECK(!running && !shards.empty());
+    on_accept = std::move(accept);
+    on_tick = std::move(tick);
+    running = true;
+
+    for (auto& shard : shards) {
+        shard->running.store(true, std::memory_order_relaxed);
+        shard->thread = std::thread([this, shard = shard.get()] { run_shard(*shard); });
+
+#if defined(DL_NET_SOCKET_REUSEPORT)
+        if (config.pin_threads) {
+            auto core_count = std::max(std::thread::hardware_concurrency(), 1U);
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(shard->index % core_count, &cpus);
+
+            // Fails for cores outside the process affinity mask, unpinned still works, the scheduler just moves it around
+            pthread_setaffinity_np(shard->thread.native_handle(), sizeof(cpus), &cpus);
+        }
+#endif
+    }
+
+    return true;
+}
+
+void ShardedListener::stop() {
+    if (!running) {
+        return;
+    }
+
+    for (auto& shard : shards) {
+        shard->running.store(false, std::memory_order_relaxed);
+    }
+
+    for (auto& shard : shards) {
+        shard->thread.join();
+    }
+
+    running = false;
+}
+
+void ShardedListener::disconnect(uint32_t shard, const Address& remote) {
+    assert(shard < shards.size());
+    shards[shard]->pending_disconnects.push_back(remote);
+}
+
+auto ShardedListener::connection_count(uint32_t shard) const -> size_t {
+    assert(shard < shards.size());
+    return shards[shard]->connection_count.load(std::memory_order_relaxed);
+}
+
+auto ShardedListener::received_count(uint32_t shard) const -> uint64_t {
+    assert(shard < shards.size());
+    return shards[shard]->received_count.load(std::memory_order_relaxed);
+}
+
+auto ShardedListener::steered_shard(const Address& sender, uint32_t shard_count) -> uint32_t {
+    // Same arithmetic as the steering program, on the address and port as the kernel reads them
+    auto address = ntohl(sender.as_sockaddr_in().sin_addr.s_addr);
+    auto hash = ((address ^ sender.get_port()) * STEERING_HASH_MULTIPLIER) >> 16;
+    return hash % shard_count;
+}
+
+void ShardedListener::run_shard(Shard& shard) {
+    while (shard.running.load(std::memory_order_relaxed)) {
+        auto received = shard.reactor.run_once(config.max_wait);
+
+        if (received > 0) {
+            shard.received_count.fetch_add(received, std::memory_order_relaxed);
+        }
+
+        if (on_tick) {
+            on_tick(shard.index, shard.connections);
+        }
+
+        for (auto& remote : shard.pending_disconnects) {
+            if (auto connection = shard.connections.find(remote); connection != shard.connections.end()) {
+                shard.reactor.remove_connection(*connection->second);
+                shard.connections.erase(connection);
+            }
+        }
+
+        shard.pending_disconnects.clear();
+        shard.connection_count.store(shard.connections.size(), std::memory_order_relaxed);
+    }
+}
+
+void ShardedListener::accept_connection(
+    Shard& shard,
+    const Address& from,
+    std::span<const std::byte> packet,
+    ReceiveTime received_at) {
+    // Stray datagrams and other protocols do not get to open connections
+    if (!check_packet_crc(packet, config.protocol_id)) {
+        return;
+    }
+
+    if (!on_accept || !on_accept(shard.index, from, packet)) {
+        return;
+    }
+
+    auto connection = std::make_unique<Connection>(from, shard.socket, config.protocol_id);
+    connection->set_message_pool(shard.message_pool);
+
+    if (!shard.reactor.add_connection(*connection)) {
+        return;
+    }
+
+    connection->receive_packet(packet, received_at);
+    shard.connections.emplace(from, std::move(connection));
+}
+
+#if defined(DL_NET_SOCKET_REUSEPORT)
+bool ShardedListener::attach_steering_program() {
+    // The program runs with the packet data past the UDP header, SKF_NET_OFF reaches back to the IP header. It
+    // returns the index of the socket in the reuseport group, which is the order the shards were bound in.
+    std::array<sock_filter, 10> code = { {
+        { BPF_LDX | BPF_B | BPF_MSH, 0, 0, static_cast<uint32_t>(SKF_NET_OFF) }, // X = IP header length
+        { BPF_LD | BPF_H | BPF_IND, 0, 0, static_cast<uint32_t>(SKF_NET_OFF) }, // A = UDP source port
+        { BPF_ST, 0, 0, 0 }, // M[0] = A
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_NET_OFF + 12) }, // A = IPv4 source address
+        { BPF_LDX | BPF_MEM, 0, 0, 0 }, // X = M[0]
+        { BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0 },
+        { BPF_ALU | BPF_MUL | BPF_K, 0, 0, STEERING_HASH_MULTIPLIER },
+        { BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16 },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(shards.size()) },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    } };
+    sock_fprog program = { static_cast<unsigned short>(code.size()), code.data() };
+
+    // Without it the kernel hash is used, senders still stay on their shard
+    return setsockopt(shards[0]->socket->get_handle(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+}
+#else
+bool ShardedListener::attach_steering_program() {
+    return false;
+}
+#endif
+}
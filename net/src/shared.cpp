@@ -1,10 +1,15 @@
-﻿#include <winsock2.h>
-#include <string>
+﻿#if defined(_WIN32)
+#include <winsock2.h>
 #include <WS2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+#include <bit>
+#include <string>
 #include <cassert>
 #include <format>
 
-#include "ducklib/net/Shared.h"
+#include "ducklib/net/shared.h"
 
 #include <stdexcept>
 
@@ -12,12 +17,12 @@
 namespace ducklib::net {
 Address::Address(std::string_view address, uint16_t port) {
     this->port = port;
-    IN_ADDR in_ddr;
+    in_addr in_ddr;
 
     if (inet_pton(AF_INET, address.data(), &in_ddr) != 1)
         throw std::runtime_error("Failed to parse address");
 
-    addr_v4_int = in_ddr.S_un.S_addr;
+    addr_v4_int = in_ddr.s_addr;
 }
 
 Address::Address(const sockaddr_in& sock_addr) {
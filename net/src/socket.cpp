@@ -1,120 +1,127 @@
-﻿#include "ducklib/net/Socket.h"
-#include "ducklib/net/Net.h"
-
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <exception>
-#include <WS2tcpip.h>
 
-namespace ducklib::net {
-Socket::Socket(Socket&& other) noexcept
-    : socket_handle(INVALID_SOCKET)
-    , address("127.0.0.1", 0) {
-    auto temp_socket = other.socket_handle;
-    auto temp_address = other.address;
-    other.socket_handle = socket_handle;
-    other.address = address;
-    socket_handle = temp_socket;
-    address = temp_address;
-}
+#include "ducklib/net/socket.h"
+#include "ducklib/net/net.h"
 
-Socket::Socket(uint16_t bindPort)
-    : socket_handle(INVALID_SOCKET) {
-    // Create socket and set options
-    socket_handle = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+namespace ducklib::net {
+auto Socket::receive(Address& from, PacketBufferPool& pool) const -> PacketRef {
+    auto packet = pool.acquire();
 
-    if (socket_handle == INVALID_SOCKET)
-        net_log_error("Failed to create socket");
+    [[unlikely]]
+    if (!packet) {
+        net_log_error("No free packet buffers to receive into");
+        return {};
+    }
 
-    // Bind socket
-    sockaddr_in socketAddress{};
+    auto received_bytes = receive(from, packet.storage());
 
-    socketAddress.sin_addr.s_addr = INADDR_ANY;
-    socketAddress.sin_port = htons(bindPort);
-    socketAddress.sin_family = AF_INET;
+    // Errors come back as -1 cast to size_t
+    if (received_bytes == 0 || received_bytes > packet.storage().size()) {
+        return {};
+    }
 
-    if (bind(socket_handle, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) < 0)
-        net_log_error("Failed to bind socket");
+    packet.set_size(static_cast<uint32_t>(received_bytes));
+    return packet;
+}
 
-    // Get which port was bound
-    sockaddr_in boundSocketAddress{};
-    int boundSocketAddressSize = sizeof boundSocketAddress;
-    int boundNameResult = getsockname(
-        socket_handle,
-        reinterpret_cast<sockaddr*>(&boundSocketAddress),
-        &boundSocketAddressSize);
+#if !defined(DL_NET_SOCKET_MMSG)
+auto Socket::send_batch(std::span<const OutgoingPacket> packets) const -> size_t {
+    auto sent_count = size_t{ 0 };
 
-    if (boundNameResult != 0)
-        net_log_error("Failed to get bound address of socket (%d)", WSAGetLastError());
+    for (const auto& packet : packets) {
+        if (send(packet.to, packet.data) != packet.data.size()) {
+            break;
+        }
 
-    this->address = Address(boundSocketAddress);
+        ++sent_count;
+    }
 
-    // Set non-blocking mode
-    DWORD nonBlockFlag = 1;
-    if (ioctlsocket(socket_handle, FIONBIO, &nonBlockFlag) != 0)
-        net_log_error("Failed to set non-blocking mode on socket");
+    return sent_count;
 }
 
-Socket::~Socket() {
-    if (socket_handle != INVALID_SOCKET) {
-        closesocket(socket_handle);
+auto Socket::receive_batch(std::span<IncomingPacket> packets) const -> size_t {
+    auto received_count = size_t{ 0 };
+
+    for (auto& packet : packets) {
+        auto received_bytes = receive(packet.from, packet.buffer);
+
+        if (received_bytes == 0 || received_bytes > packet.buffer.size()) {
+            break;
+        }
+
+        packet.size = received_bytes;
+        packet.received_at = std::chrono::steady_clock::now();
+        ++received_count;
     }
-    
-    socket_handle = INVALID_SOCKET;
+
+    return received_count;
 }
+#endif
 
-auto Socket::get_port() const -> uint16_t {
-    assert(socket_handle != INVALID_SOCKET);
+/// Sends segments with send_batch, for platforms and routes without segmentation offload
+auto Socket::send_segments_batched(Address to, std::span<const std::byte> data, uint16_t segment_size) const -> size_t {
+    assert(segment_size > 0);
+    constexpr size_t BATCH_SIZE = 64;
+    std::array<OutgoingPacket, BATCH_SIZE> packets;
+    auto sent_bytes = size_t{ 0 };
 
-    return address.get_port();
-}
+    while (sent_bytes < data.size()) {
+        auto count = size_t{ 0 };
+
+        for (auto offset = sent_bytes; offset < data.size() && count < BATCH_SIZE; offset += segment_size) {
+            packets[count++] = { to, data.subspan(offset, std::min<size_t>(segment_size, data.size() - offset)) };
+        }
 
-auto Socket::send(Address to, std::span<const std::byte> data) const -> size_t {
-    assert(socket_handle != INVALID_SOCKET);
+        auto sent_count = send_batch(std::span(packets).first(count));
 
-    auto socketAddress = to.as_sockaddr_in();
-    auto sent_bytes = sendto(
-        socket_handle,
-        reinterpret_cast<const char*>(data.data()),
-        static_cast<int>(data.size()),
-        0,
-        reinterpret_cast<sockaddr*>(&socketAddress),
-        sizeof(socketAddress));
+        for (auto i = size_t{ 0 }; i < sent_count; ++i) {
+            sent_bytes += packets[i].data.size();
+        }
 
-    if (sent_bytes == SOCKET_ERROR) {
-        net_log_error("Failed to send data over socket");
+        if (sent_count < count) {
+            break;
+        }
     }
 
     return sent_bytes;
 }
 
-auto Socket::receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t {
-    assert(socket_handle != INVALID_SOCKET);
-    assert(&from);
+#if !defined(DL_NET_SOCKET_TIMESTAMPS)
+auto Socket::enable_timestamps(bool) -> bool {
+    return false;
+}
 
-    sockaddr_in socketAddress{};
-    int socketAddressSize = sizeof(socketAddress);
-    HRESULT received_bytes = recvfrom(
-        socket_handle,
-        reinterpret_cast<char*>(receive_buffer.data()),
-        static_cast<int>(receive_buffer.size()),
-        0,
-        reinterpret_cast<sockaddr*>(&socketAddress),
-        &socketAddressSize);
+auto Socket::receive(Address& from, std::span<std::byte> receive_buffer, ReceiveTime& received_at) const -> size_t {
+    auto received_bytes = receive(from, receive_buffer);
+    received_at = std::chrono::steady_clock::now();
+    return received_bytes;
+}
+#endif
 
-    // TODO: Check socket address size value?
+#if !defined(DL_NET_SOCKET_UDP_OFFLOAD)
+auto Socket::enable_gso() -> bool {
+    return false;
+}
 
-    // TODO: Propagate this out to the caller
-    if (received_bytes == SOCKET_ERROR) {
-        int errorCode = WSAGetLastError();
+auto Socket::enable_gro() -> bool {
+    return false;
+}
 
-        if (errorCode == WSAEWOULDBLOCK)
-            return 0;
+auto Socket::send_segmented(Address to, std::span<const std::byte> data, uint16_t segment_size) const -> size_t {
+    return send_segments_batched(to, data, segment_size);
+}
 
-        net_log_error("Failed to receive data over socket");
-    }
+auto Socket::receive_segmented(Address& from, std::span<std::byte> receive_buffer, uint16_t& segment_size) const -> size_t {
+    auto received_bytes = receive(from, receive_buffer);
 
-    new(&from) Address(socketAddress);
+    if (received_bytes > receive_buffer.size()) {
+        return 0;
+    }
 
+    segment_size = static_cast<uint16_t>(received_bytes);
     return received_bytes;
 }
+#endif
 }
@@ -0,0 +1,499 @@
+#include "ducklib/net/socket.h"
+#include "ducklib/net/net.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#if defined(DL_NET_SOCKET_UDP_OFFLOAD)
+#include <netinet/udp.h>
+
+// Older libc headers lack the offload options even when the kernel has them
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+#include <ctime>
+#include <linux/net_tstamp.h>
+#endif
+
+namespace ducklib::net {
+namespace {
+constexpr size_t SOCKET_ERROR_RESULT = static_cast<size_t>(-1);
+#if defined(DL_NET_SOCKET_MMSG)
+constexpr size_t MAX_MMSG_BATCH = 64; // Messages per sendmmsg/recvmmsg call, bounds the stack arrays below
+#endif
+#if defined(DL_NET_SOCKET_UDP_OFFLOAD)
+constexpr size_t MAX_GSO_SEGMENTS = 64; // UDP_MAX_SEGMENTS of older kernels
+#endif
+
+bool would_block(int error_code) {
+    return error_code == EAGAIN || error_code == EWOULDBLOCK;
+}
+
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+// Room for scm_timestamping, which holds three timespecs, SO_TIMESTAMPNS sends one
+using TimestampControl = std::array<std::byte, CMSG_SPACE(3 * sizeof(timespec))>;
+
+/// Kernel timestamps are CLOCK_REALTIME, they go onto steady_clock by how long before now they were taken
+struct ClockPair {
+    std::chrono::system_clock::time_point system_now = std::chrono::system_clock::now();
+    ReceiveTime steady_now = std::chrono::steady_clock::now();
+};
+
+ReceiveTime read_timestamp(msghdr& message, const ClockPair& now) {
+    for (auto header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        timespec stamp = {};
+
+        if (header->cmsg_level != SOL_SOCKET) {
+            continue;
+        } else if (header->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&stamp, CMSG_DATA(header), sizeof(stamp));
+        } else if (header->cmsg_type == SCM_TIMESTAMPING) {
+            // Software, a deprecated one and raw hardware, the hardware one is zero unless the NIC stamped it
+            std::array<timespec, 3> stamps;
+            memcpy(stamps.data(), CMSG_DATA(header), sizeof(stamps));
+            stamp = stamps[2].tv_sec != 0 || stamps[2].tv_nsec != 0 ? stamps[2] : stamps[0];
+        } else {
+            continue;
+        }
+
+        auto kernel_time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(stamp.tv_sec) + std::chrono::nanoseconds(stamp.tv_nsec)));
+        return now.steady_now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(now.system_now - kernel_time);
+    }
+
+    return now.steady_now;
+}
+#endif
+}
+
+Socket::Socket(Socket&& other) noexcept
+    : socket_handle(INVALID_SOCKET_HANDLE)
+    , address("127.0.0.1", 0) {
+    std::swap(socket_handle, other.socket_handle);
+    std::swap(address, other.address);
+    std::swap(use_gso, other.use_gso);
+    std::swap(use_gro, other.use_gro);
+    std::swap(use_timestamps, other.use_timestamps);
+}
+
+Socket::Socket(uint16_t bindPort, const SocketOptions& options)
+    : socket_handle(INVALID_SOCKET_HANDLE) {
+    socket_handle = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (socket_handle == INVALID_SOCKET_HANDLE)
+        net_log_error("Failed to create socket (%d)", errno);
+
+    if (options.reuse_port) {
+#if defined(DL_NET_SOCKET_REUSEPORT)
+        int enable = 1;
+        if (setsockopt(socket_handle, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+            net_log_error("Failed to enable port reuse on socket (%d)", errno);
+#else
+        // Other BSD stacks accept SO_REUSEPORT but deliver everything to one socket
+        net_log_error("Port reuse is not supported on this platform");
+#endif
+    }
+
+    sockaddr_in socketAddress{};
+
+    socketAddress.sin_addr.s_addr = INADDR_ANY;
+    socketAddress.sin_port = htons(bindPort);
+    socketAddress.sin_family = AF_INET;
+
+    if (bind(socket_handle, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) < 0)
+        net_log_error("Failed to bind socket (%d)", errno);
+
+    sockaddr_in boundSocketAddress{};
+    socklen_t boundSocketAddressSize = sizeof boundSocketAddress;
+
+    if (getsockname(socket_handle, reinterpret_cast<sockaddr*>(&boundSocketAddress), &boundSocketAddressSize) != 0)
+        net_log_error("Failed to get bound address of socket (%d)", errno);
+
+    this->address = Address(boundSocketAddress);
+
+    auto flags = fcntl(socket_handle, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket_handle, F_SETFL, flags | O_NONBLOCK) != 0)
+        net_log_error("Failed to set non-blocking mode on socket (%d)", errno);
+}
+
+Socket::~Socket() {
+    if (socket_handle != INVALID_SOCKET_HANDLE) {
+        close(socket_handle);
+    }
+
+    socket_handle = INVALID_SOCKET_HANDLE;
+}
+
+auto Socket::get_port() const -> uint16_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    return address.get_port();
+}
+
+auto Socket::send(Address to, std::span<const std::byte> data) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    auto socketAddress = to.as_sockaddr_in();
+    auto sent_bytes = sendto(
+        socket_handle,
+        data.data(),
+        data.size(),
+        0,
+        reinterpret_cast<sockaddr*>(&socketAddress),
+        sizeof(socketAddress));
+
+    if (sent_bytes < 0) {
+        net_log_error("Failed to send data over socket (%d)", errno);
+        return SOCKET_ERROR_RESULT;
+    }
+
+    return static_cast<size_t>(sent_bytes);
+}
+
+auto Socket::receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    // recvmsg rather than recvfrom, only its flags tell a datagram that did not fit from one that filled the buffer
+    sockaddr_in socketAddress{};
+    iovec vector = { receive_buffer.data(), receive_buffer.size() };
+    msghdr message = {};
+    message.msg_name = &socketAddress;
+    message.msg_namelen = sizeof(socketAddress);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    auto received_bytes = recvmsg(socket_handle, &message, 0);
+
+    if (received_bytes < 0) {
+        if (would_block(errno))
+            return 0;
+
+        net_log_error("Failed to receive data over socket (%d)", errno);
+        return SOCKET_ERROR_RESULT;
+    }
+
+    [[unlikely]]
+    if ((message.msg_flags & MSG_TRUNC) != 0) {
+        net_log_error("Dropped a datagram larger than the receive buffer");
+        return 0;
+    }
+
+    from = Address(socketAddress);
+
+    return static_cast<size_t>(received_bytes);
+}
+
+#if defined(DL_NET_SOCKET_MMSG)
+auto Socket::send_batch(std::span<const OutgoingPacket> packets) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    std::array<mmsghdr, MAX_MMSG_BATCH> headers;
+    std::array<iovec, MAX_MMSG_BATCH> vectors;
+    std::array<sockaddr_in, MAX_MMSG_BATCH> addresses;
+    auto sent_count = size_t{ 0 };
+
+    while (sent_count < packets.size()) {
+        auto batch = packets.subspan(sent_count, std::min(packets.size() - sent_count, MAX_MMSG_BATCH));
+
+        for (auto i = 0U; i < batch.size(); ++i) {
+            addresses[i] = batch[i].to.as_sockaddr_in();
+            vectors[i] = { const_cast<std::byte*>(batch[i].data.data()), batch[i].data.size() };
+            headers[i] = {};
+            headers[i].msg_hdr.msg_name = &addresses[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        auto result = sendmmsg(socket_handle, headers.data(), static_cast<unsigned int>(batch.size()), 0);
+
+        if (result < 0) {
+            if (!would_block(errno))
+                net_log_error("Failed to send batch over socket (%d)", errno);
+
+            break;
+        }
+
+        sent_count += static_cast<size_t>(result);
+
+        // A short count means the socket buffer filled up
+        if (static_cast<size_t>(result) < batch.size()) {
+            break;
+        }
+    }
+
+    return sent_count;
+}
+
+auto Socket::receive_batch(std::span<IncomingPacket> packets) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    std::array<mmsghdr, MAX_MMSG_BATCH> headers;
+    std::array<iovec, MAX_MMSG_BATCH> vectors;
+    std::array<sockaddr_in, MAX_MMSG_BATCH> addresses;
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+    alignas(cmsghdr) std::array<TimestampControl, MAX_MMSG_BATCH> controls;
+#endif
+    auto received_count = size_t{ 0 };
+
+    while (received_count < packets.size()) {
+        auto batch = packets.subspan(received_count, std::min(packets.size() - received_count, MAX_MMSG_BATCH));
+
+        for (auto i = 0U; i < batch.size(); ++i) {
+            vectors[i] = { batch[i].buffer.data(), batch[i].buffer.size() };
+            headers[i] = {};
+            headers[i].msg_hdr.msg_name = &addresses[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+            if (use_timestamps) {
+                headers[i].msg_hdr.msg_control = controls[i].data();
+                headers[i].msg_hdr.msg_controllen = controls[i].size();
+            }
+#endif
+        }
+
+        auto result = recvmmsg(socket_handle, headers.data(), static_cast<unsigned int>(batch.size()), MSG_DONTWAIT, nullptr);
+
+        if (result < 0) {
+            if (!would_block(errno))
+                net_log_error("Failed to receive batch over socket (%d)", errno);
+
+            break;
+        }
+
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+        ClockPair now;
+#else
+        auto now = std::chrono::steady_clock::now();
+#endif
+
+        // Truncated datagrams are dropped like in receive, the ones after them move down over their slots
+        auto kept = size_t{ 0 };
+
+        for (auto i = 0; i < result; ++i) {
+            [[unlikely]]
+            if ((headers[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+                net_log_error("Dropped a datagram larger than the receive buffer");
+                continue;
+            }
+
+            auto& packet = batch[kept];
+
+            if (kept != static_cast<size_t>(i)) {
+                std::swap(packet.buffer, batch[i].buffer);
+            }
+
+            packet.from = Address(addresses[i]);
+            packet.size = headers[i].msg_len;
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+            packet.received_at = use_timestamps ? read_timestamp(headers[i].msg_hdr, now) : now.steady_now;
+#else
+            packet.received_at = now;
+#endif
+            ++kept;
+        }
+
+        received_count += kept;
+
+        // Nothing more is waiting
+        if (static_cast<size_t>(result) < batch.size()) {
+            break;
+        }
+    }
+
+    return received_count;
+}
+#endif
+
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+auto Socket::enable_timestamps(bool hardware) -> bool {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    if (hardware) {
+        // Software stamps are requested too, they fill in when the NIC does not stamp
+        int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+            | SOF_TIMESTAMPING_SOFTWARE;
+        use_timestamps = setsockopt(socket_handle, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+    } else {
+        int enable = 1;
+        use_timestamps = setsockopt(socket_handle, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0;
+    }
+
+    return use_timestamps;
+}
+
+auto Socket::receive(Address& from, std::span<std::byte> receive_buffer, ReceiveTime& received_at) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    if (!use_timestamps) {
+        auto received_bytes = receive(from, receive_buffer);
+        received_at = std::chrono::steady_clock::now();
+        return received_bytes;
+    }
+
+    sockaddr_in socketAddress{};
+    iovec vector = { receive_buffer.data(), receive_buffer.size() };
+    alignas(cmsghdr) TimestampControl control;
+    msghdr message = {};
+    message.msg_name = &socketAddress;
+    message.msg_namelen = sizeof(socketAddress);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    auto received_bytes = recvmsg(socket_handle, &message, 0);
+
+    if (received_bytes < 0) {
+        if (would_block(errno))
+            return 0;
+
+        net_log_error("Failed to receive data over socket (%d)", errno);
+        return SOCKET_ERROR_RESULT;
+    }
+
+    [[unlikely]]
+    if ((message.msg_flags & MSG_TRUNC) != 0) {
+        net_log_error("Dropped a datagram larger than the receive buffer");
+        return 0;
+    }
+
+    from = Address(socketAddress);
+    received_at = read_timestamp(message, {});
+
+    return static_cast<size_t>(received_bytes);
+}
+#endif
+
+#if defined(DL_NET_SOCKET_UDP_OFFLOAD)
+auto Socket::enable_gso() -> bool {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    // A segment size of 0 leaves sends unsegmented, it only probes for support. Sizes go with each send instead.
+    int segment_size = 0;
+    use_gso = setsockopt(socket_handle, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0;
+
+    return use_gso;
+}
+
+auto Socket::enable_gro() -> bool {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    int enable = 1;
+    use_gro = setsockopt(socket_handle, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+
+    return use_gro;
+}
+
+auto Socket::send_segmented(Address to, std::span<const std::byte> data, uint16_t segment_size) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+    assert(segment_size > 0);
+
+    if (!use_gso || data.size() <= segment_size) {
+        return send_segments_batched(to, data, segment_size);
+    }
+
+    auto socketAddress = to.as_sockaddr_in();
+    auto max_send_size = std::min(MAX_GSO_SEGMENTS, MAX_SEGMENTED_SIZE / segment_size) * segment_size;
+    alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(uint16_t))> control;
+    auto sent_bytes = size_t{ 0 };
+
+    while (sent_bytes < data.size()) {
+        auto chunk = data.subspan(sent_bytes, std::min(max_send_size, data.size() - sent_bytes));
+        iovec vector = { const_cast<std::byte*>(chunk.data()), chunk.size() };
+        msghdr message = {};
+        message.msg_name = &socketAddress;
+        message.msg_namelen = sizeof(socketAddress);
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        auto header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_UDP;
+        header->cmsg_type = UDP_SEGMENT;
+        header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(header), &segment_size, sizeof(segment_size));
+
+        auto result = sendmsg(socket_handle, &message, 0);
+
+        if (result < 0) {
+            // EIO means the route cannot segment (no checksum offload), stop trying for this socket
+            if (errno == EIO) {
+                use_gso = false;
+                return sent_bytes + send_segments_batched(to, data.subspan(sent_bytes), segment_size);
+            }
+
+            if (!would_block(errno))
+                net_log_error("Failed to send segmented data over socket (%d)", errno);
+
+            break;
+        }
+
+        sent_bytes += chunk.size();
+    }
+
+    return sent_bytes;
+}
+
+auto Socket::receive_segmented(Address& from, std::span<std::byte> receive_buffer, uint16_t& segment_size) const -> size_t {
+    assert(socket_handle != INVALID_SOCKET_HANDLE);
+
+    sockaddr_in socketAddress{};
+    iovec vector = { receive_buffer.data(), receive_buffer.size() };
+    alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(int))> control;
+    msghdr message = {};
+    message.msg_name = &socketAddress;
+    message.msg_namelen = sizeof(socketAddress);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    auto received_bytes = recvmsg(socket_handle, &message, 0);
+
+    if (received_bytes < 0) {
+        if (!would_block(errno))
+            net_log_error("Failed to receive segmented data over socket (%d)", errno);
+
+        return 0;
+    }
+
+    [[unlikely]]
+    if ((message.msg_flags & MSG_TRUNC) != 0) {
+        net_log_error("Dropped a datagram larger than the receive buffer");
+        return 0;
+    }
+
+    segment_size = static_cast<uint16_t>(received_bytes);
+
+    for (auto header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_UDP && header->cmsg_type == UDP_GRO) {
+            int coalesced_size;
+            memcpy(&coalesced_size, CMSG_DATA(header), sizeof(coalesced_size));
+            segment_size = static_cast<uint16_t>(coalesced_size);
+        }
+    }
+
+    from = Address(socketAddress);
+
+    return static_cast<size_t>(received_bytes);
+}
+#endif
+}
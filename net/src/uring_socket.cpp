@@ -0,0 +1,559 @@
+#include "ducklib/net/uring_socket.h"
+#include "ducklib/net/net.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ducklib::net {
+namespace {
+constexpr uint64_t RECEIVE_USER_DATA = UINT64_MAX; // Send completions carry their slot index instead
+constexpr uint16_t RECEIVE_BUFFER_GROUP = 0;
+constexpr size_t SOCKET_ERROR_RESULT = static_cast<size_t>(-1);
+constexpr auto DRAIN_TIMEOUT = std::chrono::milliseconds(10);
+constexpr auto DRAIN_ATTEMPTS = 100;
+
+// No liburing, the three system calls are all it needs
+int io_uring_setup(uint32_t entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(int ring_fd, uint32_t opcode, const void* arg, uint32_t arg_count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, arg_count));
+}
+
+template <typename T>
+T load_acquire(const T* value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void store_release(T* target, T value) {
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+template <typename T>
+T* offset_pointer(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<std::byte*>(base) + offset);
+}
+}
+
+struct UringSocket::SendSlot {
+    msghdr message;
+    iovec vector;
+    sockaddr_in address;
+};
+
+UringSocket::UringSocket(uint16_t bind_port, const UringSocketConfig& config)
+    : socket(bind_port)
+    , receive_buffer_size(config.receive_buffer_size) {
+    if (!setup_ring(config)) {
+        teardown_ring();
+        receive_storage = std::make_unique<std::byte[]>(receive_buffer_size);
+        return;
+    }
+
+    // Kernels without multishot receive reject it straight away
+    arm_receive();
+    submit(0, {});
+    reap([](const Address&, std::span<const std::byte>) {}, 0);
+
+    if (!receive_armed) {
+        teardown_ring();
+        receive_storage = std::make_unique<std::byte[]>(receive_buffer_size);
+    }
+}
+
+UringSocket::~UringSocket() {
+    if (!is_using_uring()) {
+        return;
+    }
+
+    // The kernel may still read from send slots until their completions arrive
+    auto drop_receives = [](const Address&, std::span<const std::byte>) {};
+    for (auto i = 0; i < DRAIN_ATTEMPTS && free_send_slots.size() < send_slot_total; ++i) {
+        submit(1, DRAIN_TIMEOUT);
+        reap(drop_receives, SIZE_MAX);
+    }
+
+    teardown_ring();
+}
+
+bool UringSocket::is_supported() {
+    static const bool supported = UringSocket(0, { 4, 4, 2048, 4 }).is_using_uring();
+    return supported;
+}
+
+bool UringSocket::setup_ring(const UringSocketConfig& config) {
+    assert(std::has_single_bit(config.receive_buffer_count));
+
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE;
+    // Every receive buffer can complete while every send slot is in flight
+    params.cq_entries = std::bit_ceil(config.receive_buffer_count + config.send_slot_count + 1);
+    ring_fd = io_uring_setup(config.queue_depth, &params);
+
+    if (ring_fd < 0) {
+        net_log_error("Failed to set up io_uring (%d)", errno);
+        return false;
+    }
+
+    // Waiting with a timeout needs IORING_ENTER_EXT_ARG (5.11)
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_EXT_ARG) == 0) {
+        return false;
+    }
+
+    auto sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    auto cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring_memory_size = std::max(sq_size, cq_size);
+    ring_memory = mmap(nullptr, ring_memory_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+
+    if (ring_memory == MAP_FAILED) {
+        ring_memory = nullptr;
+        return false;
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes_memory = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+    if (sqes_memory == MAP_FAILED) {
+        return false;
+    }
+
+    sqes = static_cast<io_uring_sqe*>(sqes_memory);
+    sq_head = offset_pointer<uint32_t>(ring_memory, params.sq_off.head);
+    sq_tail = offset_pointer<uint32_t>(ring_memory, params.sq_off.tail);
+    sq_array = offset_pointer<uint32_t>(ring_memory, params.sq_off.array);
+    sq_mask = *offset_pointer<uint32_t>(ring_memory, params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+    cq_head = offset_pointer<uint32_t>(ring_memory, params.cq_off.head);
+    cq_tail = offset_pointer<uint32_t>(ring_memory, params.cq_off.tail);
+    cq_mask = *offset_pointer<uint32_t>(ring_memory, params.cq_off.ring_mask);
+    cqes = offset_pointer<io_uring_cqe>(ring_memory, params.cq_off.cqes);
+
+    send_slot_size = config.send_slot_size;
+    send_slot_total = config.send_slot_count;
+    send_slots = std::make_unique<SendSlot[]>(config.send_slot_count);
+    send_storage = std::make_unique<std::byte[]>(static_cast<size_t>(config.send_slot_count) * send_slot_size);
+    free_send_slots.reserve(config.send_slot_count);
+
+    for (auto i = config.send_slot_count; i-- > 0;) {
+        free_send_slots.push_back(i);
+    }
+
+    return setup_receive_buffers(config);
+}
+
+bool UringSocket::setup_receive_buffers(const UringSocketConfig& config) {
+    // The kernel wants the ring page aligned
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    buffer_ring_size = (config.receive_buffer_count * sizeof(io_uring_buf) + page_size - 1) / page_size * page_size;
+    buffer_ring = static_cast<io_uring_buf_ring*>(std::aligned_alloc(page_size, buffer_ring_size));
+
+    if (buffer_ring == nullptr) {
+        return false;
+    }
+
+    memset(buffer_ring, 0, buffer_ring_size);
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+    registration.ring_entries = config.receive_buffer_count;
+    registration.bgid = RECEIVE_BUFFER_GROUP;
+
+    // Provided buffer rings need 5.19
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        net_log_error("Failed to register receive buffers with io_uring (%d)", errno);
+        std::free(buffer_ring);
+        buffer_ring = nullptr;
+        return false;
+    }
+
+    buffer_ring_mask = config.receive_buffer_count - 1;
+    receive_storage = std::make_unique<std::byte[]>(static_cast<size_t>(config.receive_buffer_count) * receive_buffer_size);
+
+    for (auto i = 0U; i < config.receive_buffer_count; ++i) {
+        recycle_receive_buffer(static_cast<uint16_t>(i));
+    }
+
+    receive_message = std::make_unique<msghdr>();
+    receive_message->msg_namelen = sizeof(sockaddr_in);
+
+    return true;
+}
+
+void UringSocket::teardown_ring() {
+    // Closing the ring cancels the multishot receive
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+
+    if (buffer_ring != nullptr) {
+        std::free(buffer_ring);
+        buffer_ring = nullptr;
+    }
+
+    if (sqes != nullptr) {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+
+    if (ring_memory != nullptr) {
+        munmap(ring_memory, ring_memory_size);
+        ring_memory = nullptr;
+    }
+
+    receive_armed = false;
+}
+
+io_uring_sqe* UringSocket::next_sqe() const {
+    if (sq_local_tail - load_acquire(sq_head) >= sq_entries) {
+        submit(0, {});
+
+        [[unlikely]]
+        if (sq_local_tail - load_acquire(sq_head) >= sq_entries) {
+            return nullptr;
+        }
+    }
+
+    auto index = sq_local_tail & sq_mask;
+    auto sqe = &sqes[index];
+    *sqe = {};
+    sq_array[index] = index;
+    ++sq_local_tail;
+    ++queued_sqes;
+
+    return sqe;
+}
+
+void UringSocket::arm_receive() const {
+    auto sqe = next_sqe();
+
+    if (sqe == nullptr) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket.get_handle();
+    sqe->addr = reinterpret_cast<uint64_t>(receive_message.get());
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECEIVE_BUFFER_GROUP;
+    sqe->user_data = RECEIVE_USER_DATA;
+    receive_armed = true;
+}
+
+bool UringSocket::submit(uint32_t wait_count, std::chrono::milliseconds timeout) const {
+    store_release(sq_tail, sq_local_tail);
+
+    __kernel_timespec timespec = {};
+    io_uring_getevents_arg arg = {};
+    auto flags = 0U;
+
+    if (wait_count > 0) {
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        timespec.tv_sec = seconds.count();
+        timespec.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - seconds).count();
+        arg.ts = reinterpret_cast<uint64_t>(&timespec);
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    auto submitted = io_uring_enter(ring_fd, queued_sqes, wait_count, flags, wait_count > 0 ? &arg : nullptr, sizeof(arg));
+
+    if (submitted < 0) {
+        // Timing out or being interrupted while waiting is not a failure
+        if (errno == ETIME || errno == EINTR) {
+            return true;
+        }
+
+        if (errno != EAGAIN && errno != EBUSY) {
+            net_log_error("Failed to submit to io_uring (%d)", errno);
+        }
+
+        return false;
+    }
+
+    queued_sqes -= std::min(queued_sqes, static_cast<uint32_t>(submitted));
+
+    return true;
+}
+
+auto UringSocket::reap(const ReceiveCallback& on_receive, size_t max_receives) const -> size_t {
+    auto receive_count = size_t{ 0 };
+
+    // Every completion is taken off the queue before it is handled, on_receive may send and reap again
+    for (auto head = *cq_head; head != load_acquire(cq_tail); head = *cq_head) {
+        auto cqe = cqes[head & cq_mask];
+        auto is_receive = cqe.user_data == RECEIVE_USER_DATA && cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+
+        if (is_receive && receive_count == max_receives) {
+            break;
+        }
+
+        store_release(cq_head, head + 1);
+
+        if (cqe.user_data != RECEIVE_USER_DATA) {
+            if (cqe.res < 0) {
+                net_log_error("Failed to send data over io_uring (%d)", -cqe.res);
+            }
+
+            free_send_slots.push_back(static_cast<uint32_t>(cqe.user_data));
+            continue;
+        }
+
+        if (!is_receive) {
+            // ENOBUFS means every receive buffer is still being handled, the flags of failed receives carry no buffer
+            if (cqe.res != -ENOBUFS) {
+                net_log_error("Failed to receive data over io_uring (%d)", -cqe.res);
+            }
+
+            if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+                receive_armed = false;
+            }
+
+            continue;
+        }
+
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+            receive_armed = false;
+        }
+
+        auto buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        auto buffer = receive_storage.get() + static_cast<size_t>(buffer_id) * receive_buffer_size;
+        io_uring_recvmsg_out header;
+        memcpy(&header, buffer, sizeof(header));
+
+        auto name_offset = sizeof(io_uring_recvmsg_out);
+        auto payload_offset = name_offset + receive_message->msg_namelen + receive_message->msg_controllen;
+
+        [[unlikely]]
+        if ((header.flags & MSG_TRUNC) != 0 || payload_offset + header.payloadlen > static_cast<uint32_t>(cqe.res)) {
+            net_log_error("Dropped a datagram larger than the io_uring receive buffers");
+            recycle_receive_buffer(buffer_id);
+            continue;
+        }
+
+        sockaddr_in socketAddress;
+        memcpy(&socketAddress, buffer + name_offset, sizeof(socketAddress));
+
+        on_receive(Address(socketAddress), { buffer + payload_offset, header.payloadlen });
+        recycle_receive_buffer(buffer_id);
+        ++receive_count;
+    }
+
+    return receive_count;
+}
+
+void UringSocket::recycle_receive_buffer(uint16_t buffer_id) const {
+    // Not bufs[], in C++ the kernel header's flexible array member starts after an empty struct instead of at 0
+    auto& buffer = reinterpret_cast<io_uring_buf*>(buffer_ring)[buffer_ring_tail & buffer_ring_mask];
+    buffer.addr = reinterpret_cast<uint64_t>(receive_storage.get() + static_cast<size_t>(buffer_id) * receive_buffer_size);
+    buffer.len = receive_buffer_size;
+    buffer.bid = buffer_id;
+    store_release(&buffer_ring->tail, ++buffer_ring_tail);
+}
+
+auto UringSocket::send(Address to, std::span<const std::byte> data) const -> size_t {
+    if (!is_using_uring()) {
+        return socket.send(to, data);
+    }
+
+    if (!queue_send(to, data)) {
+        return SOCKET_ERROR_RESULT;
+    }
+
+    flush();
+    return data.size();
+}
+
+auto UringSocket::receive(Address& from, std::span<std::byte> receive_buffer) const -> size_t {
+    IncomingPacket packet = {};
+    packet.buffer = receive_buffer;
+
+    if (receive_batch({ &packet, 1 }) == 0) {
+        return 0;
+    }
+
+    from = packet.from;
+    return packet.size;
+}
+
+auto UringSocket::send_batch(std::span<const OutgoingPacket> packets) const -> size_t {
+    if (!is_using_uring()) {
+        return socket.send_batch(packets);
+    }
+
+    auto sent_count = size_t{ 0 };
+
+    for (const auto& packet : packets) {
+        if (!queue_send(packet.to, packet.data)) {
+            break;
+        }
+
+        ++sent_count;
+    }
+
+    flush();
+    return sent_count;
+}
+
+bool UringSocket::queue_send(Address to, std::span<const std::byte> data) const {
+    if (data.size() > send_slot_size) {
+        net_log_error("Data does not fit in an io_uring send slot");
+        return false;
+    }
+
+    if (free_send_slots.empty()) {
+        flush();
+        reap([](const Address&, std::span<const std::byte>) {}, 0);
+    }
+
+    [[unlikely]]
+    if (free_send_slots.empty()) {
+        net_log_error("Every io_uring send slot is in flight");
+        return false;
+    }
+
+    auto sqe = next_sqe();
+
+    [[unlikely]]
+    if (sqe == nullptr) {
+        return false;
+    }
+
+    auto slot_index = free_send_slots.back();
+    free_send_slots.pop_back();
+
+    auto& slot = send_slots[slot_index];
+    auto storage = send_storage.get() + static_cast<size_t>(slot_index) * send_slot_size;
+    std::copy(data.begin(), data.end(), storage);
+    slot.address = to.as_sockaddr_in();
+    slot.vector = { storage, data.size() };
+    slot.message = {};
+    slot.message.msg_name = &slot.address;
+    slot.message.msg_namelen = sizeof(slot.address);
+    slot.message.msg_iov = &slot.vector;
+    slot.message.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket.get_handle();
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.message);
+    sqe->len = 1;
+    sqe->user_data = slot_index;
+
+    return true;
+}
+
+auto UringSocket::receive_batch(std::span<IncomingPacket> packets) const -> size_t {
+    auto received_count = size_t{ 0 };
+    auto copy_out = [&](const Address& from, std::span<const std::byte> data) {
+        auto& packet = packets[received_count];
+
+        // Left for the next datagram as Socket does, the entry only counts once it is filled
+        if (data.size() > packet.buffer.size()) {
+            net_log_error("Dropped a datagram larger than the receive buffer");
+            return;
+        }
+
+        std::ranges::copy(data, packet.buffer.begin());
+        packet.size = data.size();
+        packet.from = from;
+        packet.received_at = std::chrono::steady_clock::now();
+        ++received_count;
+    };
+
+    if (!is_using_uring()) {
+        return poll_socket(copy_out, packets.size());
+    }
+
+    if (queued_sqes > 0) {
+        submit(0, {});
+    }
+
+    reap(copy_out, packets.size());
+
+    if (!receive_armed) {
+        arm_receive();
+        submit(0, {});
+    }
+
+    return received_count;
+}
+
+bool UringSocket::flush() const {
+    if (!is_using_uring() || queued_sqes == 0) {
+        return true;
+    }
+
+    return submit(0, {});
+}
+
+auto UringSocket::poll(const ReceiveCallback& on_receive) const -> size_t {
+    if (!is_using_uring()) {
+        return poll_socket(on_receive, SIZE_MAX);
+    }
+
+    if (queued_sqes > 0) {
+        submit(0, {});
+    }
+
+    auto receive_count = reap(on_receive, SIZE_MAX);
+
+    if (!receive_armed) {
+        arm_receive();
+        submit(0, {});
+    }
+
+    return receive_count;
+}
+
+auto UringSocket::wait(const ReceiveCallback& on_receive, std::chrono::milliseconds timeout) const -> size_t {
+    if (!is_using_uring()) {
+        pollfd poll_fd = { socket.get_handle(), POLLIN, 0 };
+        ::poll(&poll_fd, 1, static_cast<int>(timeout.count()));
+        return poll_socket(on_receive, SIZE_MAX);
+    }
+
+    if (*cq_head == load_acquire(cq_tail)) {
+        submit(1, timeout);
+    }
+
+    return poll(on_receive);
+}
+
+auto UringSocket::poll_socket(const ReceiveCallback& on_receive, size_t max_receives) const -> size_t {
+    auto receive_count = size_t{ 0 };
+    auto buffer = std::span(receive_storage.get(), receive_buffer_size);
+
+    while (receive_count < max_receives) {
+        Address from;
+        auto received_bytes = socket.receive(from, buffer);
+
+        if (received_bytes == 0 || received_bytes > buffer.size()) {
+            break;
+        }
+
+        on_receive(from, buffer.first(received_bytes));
+        ++receive_count;
+    }
+
+    return receive_count;
+}
+}
@@ -0,0 +1,412 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "ducklib/net/crc32c.h"
+#include "ducklib/net/packet.h"
+#include "ducklib/net/range_coder.h"
+#include "ducklib/net/schema.h"
+#include "ducklib/net/serialization.h"
+
+using namespace ducklib;
+
+namespace {
+constexpr auto BUFFER_SIZE = 4096U;
+constexpr auto TARGET_BYTES = 256U * 1024 * 1024;
+constexpr auto ENTITY_COUNT = 64U;
+
+/// Keeps results of benchmarked pure functions from being optimized away
+volatile uint32_t result_sink;
+
+/// Snapshot entry shaped like typical game state: ids, bounded counters, flags, quantized transform
+struct EntitySnapshot {
+    uint16_t id;
+    uint8_t health;
+    uint32_t tick_delta;
+    bool grounded;
+    ducklib::Vector3 position;
+    ducklib::Quaternion rotation;
+    float yaw;
+
+    using Schema = net::MessageSchema<
+        net::BoundedIntField<&EntitySnapshot::id, 0, 4095>,
+        net::BoundedIntField<&EntitySnapshot::health, 0, 200>,
+        net::VarintField<&EntitySnapshot::tick_delta, 4>,
+        net::BoolField<&EntitySnapshot::grounded>,
+        net::Vector3Field<&EntitySnapshot::position, -1024.0f, 1024.0f, 1.0f / 64.0f>,
+        net::QuaternionField<&EntitySnapshot::rotation, 10>,
+        net::QuantizedFloatField<&EntitySnapshot::yaw, -180.0f, 180.0f, 0.1f>>;
+};
+
+/// Reference copy loops with the shape of the original byte-at-a-time implementation, kept to compare against
+void bytewise_write(std::byte* buffer, uint32_t bit_offset, const std::byte* data, uint32_t data_bit_size) {
+    auto destination = buffer + (bit_offset >> 3);
+    auto shift = bit_offset & 0x7;
+    auto whole_bytes = data_bit_size >> 3;
+
+    if (shift == 0) {
+        for (auto i = 0U; i < whole_bytes; ++i) {
+            destination[i] = data[i];
+        }
+    } else {
+        for (auto i = 0U; i < whole_bytes; ++i) {
+            destination[i] |= data[i] << shift;
+            destination[i + 1] = data[i] >> (8 - shift);
+        }
+    }
+
+    for (auto i = whole_bytes * 8; i < data_bit_size; ++i) {
+        auto bit = (static_cast<uint8_t>(data[i >> 3]) >> (i & 0x7)) & 1;
+        auto target = bit_offset + i;
+        buffer[target >> 3] |= static_cast<std::byte>(bit << (target & 0x7));
+    }
+}
+
+void bytewise_read(const std::byte* buffer, uint32_t bit_offset, std::byte* data, uint32_t data_bit_size) {
+    auto source = buffer + (bit_offset >> 3);
+    auto shift = bit_offset & 0x7;
+    auto whole_bytes = data_bit_size >> 3;
+
+    for (auto i = 0U; i < whole_bytes; ++i) {
+        data[i] = shift == 0 ? source[i] : (source[i] >> shift) | (source[i + 1] << (8 - shift));
+    }
+
+    for (auto i = whole_bytes * 8; i < data_bit_size; ++i) {
+        auto source_bit = bit_offset + i;
+        auto bit = (static_cast<uint8_t>(buffer[source_bit >> 3]) >> (source_bit & 0x7)) & 1;
+        data[i >> 3] |= static_cast<std::byte>(bit << (i & 0x7));
+    }
+}
+
+template <typename F>
+double measure_mb_per_s(uint32_t data_bit_size, F&& f) {
+    auto iterations = std::max(1U, TARGET_BYTES / std::max(1U, data_bit_size / 8));
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto i = 0U; i < iterations; ++i) {
+        f();
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(iterations) * data_bit_size / 8.0 / seconds / (1024.0 * 1024.0);
+}
+
+void run_case(uint32_t bit_offset, uint32_t data_bit_size) {
+    std::vector<std::byte> data((data_bit_size + 7) / 8);
+    std::vector<std::byte> result(data.size() + 1);
+    std::vector<std::byte> buffer(BUFFER_SIZE);
+    std::mt19937 rng(data_bit_size);
+
+    for (auto& b : data) {
+        b = static_cast<std::byte>(rng());
+    }
+
+    auto prefix = 0U;
+
+    auto stream_write = measure_mb_per_s(data_bit_size, [&] {
+        auto writer = net::NetWriteStream(buffer);
+        if (bit_offset > 0) {
+            writer.serialize_value(prefix, static_cast<uint8_t>(bit_offset));
+        }
+        writer.serialize_data(data.data(), data_bit_size);
+        writer.flush_scratch();
+    });
+
+    auto stream_read = measure_mb_per_s(data_bit_size, [&] {
+        auto reader = net::NetReadStream(buffer.data(), bit_offset + data_bit_size);
+        if (bit_offset > 0) {
+            reader.serialize_value(prefix, static_cast<uint8_t>(bit_offset));
+        }
+        reader.serialize_data(result.data(), static_cast<uint16_t>(data_bit_size));
+    });
+
+    auto bytewise_write_speed = measure_mb_per_s(data_bit_size, [&] {
+        bytewise_write(buffer.data(), bit_offset, data.data(), data_bit_size);
+    });
+
+    auto bytewise_read_speed = measure_mb_per_s(data_bit_size, [&] {
+        bytewise_read(buffer.data(), bit_offset, result.data(), data_bit_size);
+    });
+
+    std::printf(
+        "%6u %6u | %10.1f %10.1f | %10.1f %10.1f\n",
+        bit_offset,
+        data_bit_size,
+        stream_write,
+        bytewise_write_speed,
+        stream_read,
+        bytewise_read_speed);
+}
+
+template <typename F>
+double measure_ns_per_op(uint32_t iterations, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto i = 0U; i < iterations; ++i) {
+        f();
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * 1e9 / iterations;
+}
+
+/// Writes and reads count values of the given width with serialize_value, reports ns per value and Mbit/s
+void run_value_case(uint8_t bits) {
+    constexpr auto count = 4096U;
+    constexpr auto iterations = 2000U;
+    std::vector<uint64_t> values(count);
+    std::vector<std::byte> buffer(count * sizeof(uint64_t));
+    std::mt19937_64 rng(bits);
+    auto mask = ~0ULL >> (64 - bits);
+
+    for (auto& value : values) {
+        value = rng() & mask;
+    }
+
+    auto write = measure_ns_per_op(iterations, [&] {
+        auto writer = net::NetWriteStream(buffer);
+        for (auto value : values) {
+            writer.serialize_value(value, bits);
+        }
+        writer.flush_scratch();
+    }) / count;
+
+    auto read = measure_ns_per_op(iterations, [&] {
+        auto reader = net::NetReadStream(buffer.data(), count * bits);
+        for (auto& value : values) {
+            reader.serialize_value(value, bits);
+        }
+    }) / count;
+
+    std::printf("%4u | %8.2f %10.1f | %8.2f %10.1f\n", bits, write, bits / write * 1000.0, read, bits / read * 1000.0);
+}
+
+std::vector<EntitySnapshot> make_entities(std::mt19937& rng) {
+    std::vector<EntitySnapshot> entities(ENTITY_COUNT);
+
+    for (auto i = 0U; i < ENTITY_COUNT; ++i) {
+        auto& entity = entities[i];
+        entity.id = static_cast<uint16_t>(i * 37 % 4096);
+        entity.health = static_cast<uint8_t>(rng() % 201);
+        entity.tick_delta = rng() % 4 == 0 ? rng() % 5000 : rng() % 8;
+        entity.grounded = rng() & 1;
+        entity.position = {
+            static_cast<float>(rng() % 2000) - 1000.0f,
+            static_cast<float>(rng() % 200) * 0.25f,
+            static_cast<float>(rng() % 2000) - 1000.0f
+        };
+        entity.rotation = { 0.0f, 0.38268343f, 0.0f, 0.92387953f };
+        entity.yaw = static_cast<float>(rng() % 360) - 180.0f;
+    }
+
+    return entities;
+}
+
+uint32_t run_snapshot_case() {
+    constexpr auto iterations = 20000U;
+    std::vector<std::byte> buffer(ENTITY_COUNT * (net::max_bit_size<EntitySnapshot>() + 7) / 8);
+    std::mt19937 rng(ENTITY_COUNT);
+    auto entities = make_entities(rng);
+
+    auto measure = net::NetMeasureStream(UINT32_MAX);
+    for (auto& entity : entities) {
+        net::serialize_message(measure, entity);
+    }
+
+    auto write = measure_ns_per_op(iterations, [&] {
+        auto writer = net::NetWriteStream(buffer);
+        for (auto& entity : entities) {
+            net::serialize_message(writer, entity);
+        }
+        writer.flush_scratch();
+    });
+
+    auto read = measure_ns_per_op(iterations, [&] {
+        auto reader = net::NetReadStream(buffer.data(), measure.bits_measured);
+        for (auto& entity : entities) {
+            net::serialize_message(reader, entity);
+        }
+    });
+
+    std::printf(
+        "%u entities, %u bits (max %u) | write %.1f ns | read %.1f ns\n",
+        ENTITY_COUNT,
+        measure.bits_measured,
+        ENTITY_COUNT * net::max_bit_size<EntitySnapshot>(),
+        write,
+        read);
+
+    return measure.bits_measured;
+}
+
+/// Every entity in its own stream like Connection::send_reliable, over a sequence of frames so the models adapt
+void run_range_coded_case(uint32_t packed_bits) {
+    constexpr auto frame_count = 1000U;
+    constexpr auto max_entity_bytes = (net::max_bit_size<EntitySnapshot>() + 7) / 8 * 2;
+    std::mt19937 rng(ENTITY_COUNT);
+    std::vector<std::vector<EntitySnapshot>> frames;
+    for (auto i = 0U; i < frame_count; ++i) {
+        frames.push_back(make_entities(rng));
+    }
+
+    auto writer_models = std::make_unique<net::RangeCoderModels>();
+    auto reader_models = std::make_unique<net::RangeCoderModels>();
+    std::vector<std::byte> output(frame_count * ENTITY_COUNT * max_entity_bytes);
+    std::vector<uint32_t> sizes(frame_count * ENTITY_COUNT);
+    auto frame = 0U;
+
+    auto write = measure_ns_per_op(frame_count, [&] {
+        for (auto i = 0U; i < ENTITY_COUNT; ++i) {
+            auto index = frame * ENTITY_COUNT + i;
+            auto writer = net::NetRangeWriteStream(
+                { output.data() + index * max_entity_bytes, max_entity_bytes }, *writer_models);
+            net::serialize_message(writer, frames[frame][i]);
+            writer.flush_scratch();
+            sizes[index] = writer.bits_written;
+        }
+        ++frame;
+    });
+
+    frame = 0;
+    auto read = measure_ns_per_op(frame_count, [&] {
+        for (auto i = 0U; i < ENTITY_COUNT; ++i) {
+            auto index = frame * ENTITY_COUNT + i;
+            auto reader = net::NetRangeReadStream(output.data() + index * max_entity_bytes, sizes[index], *reader_models);
+            net::serialize_message(reader, frames[frame][i]);
+        }
+        ++frame;
+    });
+
+    auto last_frame_bits = 0U;
+    for (auto i = 0U; i < ENTITY_COUNT; ++i) {
+        last_frame_bits += sizes[(frame_count - 1) * ENTITY_COUNT + i];
+    }
+
+    std::printf(
+        "range coded, %u bits (%.0f%% of bit-packed) | write %.1f ns | read %.1f ns\n",
+        last_frame_bits,
+        100.0 * last_frame_bits / packed_bits,
+        write,
+        read);
+}
+
+void run_crc_case(uint32_t size) {
+    std::vector<std::byte> packet(size);
+    std::mt19937 rng(size);
+
+    for (auto& b : packet) {
+        b = static_cast<std::byte>(rng());
+    }
+
+    auto crc = measure_mb_per_s(size * 8, [&] {
+        result_sink = net::crc32c(packet);
+    });
+    auto software = measure_mb_per_s(size * 8, [&] {
+        result_sink = net::crc32c_software(packet);
+    });
+
+    // Junk traffic is rejected after the CRC, nothing else is looked at
+    auto reject_ns = measure_ns_per_op(1000000, [&] {
+        result_sink = net::check_packet_crc(packet, net::DEFAULT_PROTOCOL_ID);
+    });
+
+    std::printf("%6u | %10.1f %10.1f | %8.1f\n", size, crc, software, reject_ns);
+}
+
+void run_int_array_case(uint32_t max, uint32_t count) {
+    constexpr auto iterations = 200000U;
+    std::vector<uint32_t> values(count);
+    std::vector<std::byte> buffer(BUFFER_SIZE);
+    std::mt19937 rng(count);
+
+    for (auto& value : values) {
+        value = rng() % (max + 1);
+    }
+
+    auto element_write = measure_ns_per_op(iterations, [&] {
+        auto writer = net::NetWriteStream(buffer);
+        for (auto& value : values) {
+            net::serialize_int(writer, value, 0U, max);
+        }
+        writer.flush_scratch();
+    });
+
+    auto array_write = measure_ns_per_op(iterations, [&] {
+        auto writer = net::NetWriteStream(buffer);
+        net::serialize_int_array(writer, std::span(values), 0U, max);
+        writer.flush_scratch();
+    });
+
+    auto element_read = measure_ns_per_op(iterations, [&] {
+        auto reader = net::NetReadStream(buffer.data(), BUFFER_SIZE * 8);
+        for (auto& value : values) {
+            net::serialize_int(reader, value, 0U, max);
+        }
+    });
+
+    auto array_read = measure_ns_per_op(iterations, [&] {
+        auto reader = net::NetReadStream(buffer.data(), BUFFER_SIZE * 8);
+        net::serialize_int_array(reader, std::span(values), 0U, max);
+    });
+
+    std::printf(
+        "%10u %6u | %10.1f %10.1f | %10.1f %10.1f\n",
+        max,
+        count,
+        element_write,
+        array_write,
+        element_read,
+        array_read);
+}
+}
+
+int main() {
+    std::printf("serialize_data throughput (MB/s)\n");
+    std::printf("offset   bits |   write    bytewise |    read    bytewise\n");
+
+    // Tiny payloads
+    for (auto data_bit_size : { 5U, 16U, 24U, 48U }) {
+        run_case(3, data_bit_size);
+    }
+
+    // Aligned and 1-7 bit misaligned snapshot-sized blobs
+    for (auto bit_offset = 0U; bit_offset < 8; ++bit_offset) {
+        run_case(bit_offset, 512 * 8);
+    }
+
+    for (auto bit_offset : { 0U, 5U }) {
+        run_case(bit_offset, 1000 * 8 + 3);
+    }
+
+    std::printf("\nserialize_value (ns per value, Mbit/s)\n");
+    std::printf("bits |    write     Mbit/s |     read     Mbit/s\n");
+
+    for (auto bits : { 1, 3, 8, 13, 16, 24, 32, 47, 64 }) {
+        run_value_case(static_cast<uint8_t>(bits));
+    }
+
+    std::printf("\nserialize_int_array (ns per array)\n");
+    std::printf("       max  count | per-element    array | per-element    array\n");
+
+    for (auto max : { 1U, 63U, 1023U, 100000U }) {
+        run_int_array_case(max, 500);
+    }
+
+    std::printf("\ncrc32c (MB/s, %s), ns to reject a junk packet\n", net::crc32c_hardware_available() ? "hardware" : "software");
+    std::printf("  size |      crc32c   software |   reject\n");
+
+    for (auto size : { 64U, 512U, 1200U }) {
+        run_crc_case(size);
+    }
+
+    std::printf("\nEntity snapshot message\n");
+    auto packed_bits = run_snapshot_case();
+    run_range_coded_case(packed_bits);
+
+    return 0;
+}
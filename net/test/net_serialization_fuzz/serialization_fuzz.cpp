@@ -0,0 +1,427 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "ducklib/net/range_coder.h"
+#include "ducklib/net/serialization.h"
+
+using namespace ducklib;
+
+/*
+ * Randomized schema fuzzer for the bitstream. Every iteration builds a random sequence of fields, writes it with
+ * NetWriteStream into a randomly sized buffer and checks that
+ *  - the output is bit-exact with a trivial one-bit-at-a-time reference stream running the same serialize functions,
+ *  - the writer runs out of space on the same field as the reference,
+ *  - NetMeasureStream counts the same number of bits,
+ *  - NetReadStream reads every field back,
+ *  - reading a truncated copy fails on the first field crossing the cut instead of returning garbage,
+ *  - the range coder streams read back the same fields, with models carried over between iterations.
+ *
+ * Usage: ducklib-net-serialization-fuzz [seed] [iterations]
+ */
+
+namespace {
+constexpr auto MAX_FIELDS = 48U;
+constexpr auto MAX_BUFFER_SIZE = 1500U;
+
+/// Reference writer that appends one bit at a time, used to check the word-at-a-time paths of NetWriteStream
+struct BitWriteStream {
+    std::vector<uint8_t> bits;
+    uint32_t capacity_bits = 0;
+    uint32_t align_slack = 0; // Bits NetMeasureStream counts on top of the real padding
+
+    explicit BitWriteStream(uint32_t capacity_bits)
+        : capacity_bits(capacity_bits) {}
+
+    template <std::integral T>
+    bool serialize_value(T value, uint8_t bits) {
+        if (bits > bits_left()) {
+            return false;
+        }
+
+        for (auto i = 0U; i < bits; ++i) {
+            this->bits.push_back(static_cast<uint8_t>((static_cast<uint64_t>(value) >> i) & 1));
+        }
+
+        return true;
+    }
+
+    bool serialize_data(std::byte* data, uint32_t data_bit_size) {
+        if (data_bit_size > bits_left()) {
+            return false;
+        }
+
+        for (auto i = 0U; i < data_bit_size; ++i) {
+            bits.push_back(static_cast<uint8_t>((static_cast<uint8_t>(data[i >> 3]) >> (i & 0x7)) & 1));
+        }
+
+        return true;
+    }
+
+    bool serialize_packed(const uint32_t* values, uint32_t count, uint8_t bits) {
+        if (count * bits > bits_left()) {
+            return false;
+        }
+
+        for (auto i = 0U; i < count; ++i) {
+            serialize_value(values[i], bits);
+        }
+
+        return true;
+    }
+
+    void align_to_byte() {
+        auto padding = (8 - (bits.size() & 0x7)) & 0x7;
+        bits.resize(bits.size() + padding, 0);
+        align_slack += 7 - static_cast<uint32_t>(padding);
+    }
+
+    uint16_t bits_left() const {
+        return static_cast<uint16_t>(capacity_bits - bits.size());
+    }
+
+    std::vector<std::byte> to_bytes() const {
+        std::vector<std::byte> bytes((bits.size() + 7) / 8);
+
+        for (auto i = 0U; i < bits.size(); ++i) {
+            bytes[i >> 3] |= static_cast<std::byte>(bits[i] << (i & 0x7));
+        }
+
+        return bytes;
+    }
+
+    static constexpr bool can_write() { return true; }
+    static constexpr bool can_read() { return false; }
+};
+
+enum class FieldType {
+    VALUE,
+    BOUNDED_INT,
+    VARINT32,
+    VARINT64,
+    BOOL,
+    DATA,
+    FLOAT,
+    QUANTIZED_FLOAT,
+    INT_ARRAY,
+    SIGNED_INT_ARRAY,
+    ALIGN,
+    COUNT
+};
+
+struct Field {
+    FieldType type = FieldType::VALUE;
+    uint8_t bits = 0;
+    uint16_t bit_size = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+    uint64_t value = 0;
+    int64_t signed_value = 0;
+    bool flag = false;
+    float float_value = 0.0f;
+    float float_min = 0.0f;
+    float float_max = 0.0f;
+    float resolution = 0.0f;
+    std::vector<std::byte> data;
+    std::vector<uint32_t> array;
+    std::vector<int16_t> signed_array;
+};
+
+template <typename StreamType>
+bool serialize_field(StreamType& stream, Field& field) {
+    switch (field.type) {
+    case FieldType::VALUE:
+        return stream.serialize_value(field.value, field.bits);
+    case FieldType::BOUNDED_INT:
+        return net::serialize_int(stream, field.signed_value, field.min, field.max);
+    case FieldType::VARINT32: {
+        auto value = static_cast<int32_t>(field.signed_value);
+        DL_NET_CHECK(net::serialize_varint(stream, value, field.bits));
+        field.signed_value = value;
+        return true;
+    }
+    case FieldType::VARINT64:
+        return net::serialize_varint(stream, field.signed_value, field.bits);
+    case FieldType::BOOL:
+        return net::serialize_bool(stream, field.flag);
+    case FieldType::DATA:
+        return net::serialize_data(stream, field.data.data(), field.bit_size);
+    case FieldType::FLOAT:
+        return net::serialize_float(stream, field.float_value);
+    case FieldType::QUANTIZED_FLOAT:
+        return net::serialize_float(stream, field.float_value, field.float_min, field.float_max, field.resolution);
+    case FieldType::INT_ARRAY:
+        return net::serialize_int_array(
+            stream,
+            std::span(field.array),
+            static_cast<uint32_t>(field.min),
+            static_cast<uint32_t>(field.max));
+    case FieldType::SIGNED_INT_ARRAY:
+        return net::serialize_int_array(
+            stream,
+            std::span(field.signed_array),
+            static_cast<int16_t>(field.min),
+            static_cast<int16_t>(field.max));
+    case FieldType::ALIGN:
+        stream.align_to_byte();
+        return true;
+    default:
+        return false;
+    }
+}
+
+template <typename T>
+T random_range(std::mt19937_64& rng, T min, T max) {
+    return std::uniform_int_distribution<T>(min, max)(rng);
+}
+
+Field random_field(std::mt19937_64& rng) {
+    Field field;
+    field.type = static_cast<FieldType>(random_range<int>(rng, 0, static_cast<int>(FieldType::COUNT) - 1));
+
+    switch (field.type) {
+    case FieldType::VALUE:
+        // Bits above the field width are left set on purpose, the stream has to mask them
+        field.bits = static_cast<uint8_t>(random_range(rng, 1, 64));
+        field.value = rng();
+        break;
+    case FieldType::BOUNDED_INT:
+        field.min = random_range<int64_t>(rng, -(1LL << 40), 1LL << 40);
+        field.max = field.min + random_range<int64_t>(rng, 1, (1LL << random_range(rng, 1, 40)) - 1) + 1;
+        field.signed_value = random_range(rng, field.min, field.max);
+        break;
+    case FieldType::VARINT32:
+        field.bits = static_cast<uint8_t>(random_range(rng, 1, 31));
+        field.signed_value = static_cast<int32_t>(rng() >> random_range(rng, 33, 63));
+        field.signed_value *= rng() & 1 ? -1 : 1;
+        break;
+    case FieldType::VARINT64:
+        field.bits = static_cast<uint8_t>(random_range(rng, 1, 63));
+        field.signed_value = static_cast<int64_t>(rng() >> random_range(rng, 0, 63));
+        break;
+    case FieldType::BOOL:
+        field.flag = rng() & 1;
+        break;
+    case FieldType::DATA: {
+        // Mostly short payloads, sometimes snapshot-sized ones that take the word-at-a-time paths
+        field.bit_size = static_cast<uint16_t>(rng() % 4 == 0 ? random_range(rng, 65, 2000) : random_range(rng, 1, 64));
+        field.data.resize((field.bit_size + 7) / 8);
+        for (auto& b : field.data) {
+            b = static_cast<std::byte>(rng());
+        }
+        break;
+    }
+    case FieldType::FLOAT:
+        field.float_value = std::bit_cast<float>(static_cast<uint32_t>(rng()));
+        break;
+    case FieldType::QUANTIZED_FLOAT:
+        field.float_min = static_cast<float>(random_range(rng, -1000, 0));
+        field.float_max = field.float_min + static_cast<float>(random_range(rng, 1, 2000));
+        field.resolution = std::ldexp(1.0f, random_range(rng, -10, 2));
+        field.float_value = std::uniform_real_distribution<float>(field.float_min, field.float_max)(rng);
+        break;
+    case FieldType::INT_ARRAY:
+        field.min = random_range(rng, 0, 1000);
+        field.max = field.min + std::max<int64_t>(1, static_cast<int64_t>(rng() >> random_range(rng, 32, 63)));
+        field.max = std::min<int64_t>(field.max, UINT32_MAX);
+        field.array.resize(random_range(rng, 1, 150));
+        for (auto& value : field.array) {
+            value = static_cast<uint32_t>(random_range(rng, field.min, field.max));
+        }
+        break;
+    case FieldType::SIGNED_INT_ARRAY:
+        field.min = random_range(rng, -1000, 0);
+        field.max = random_range(rng, 1, 1000);
+        field.signed_array.resize(random_range(rng, 1, 150));
+        for (auto& value : field.signed_array) {
+            value = static_cast<int16_t>(random_range(rng, field.min, field.max));
+        }
+        break;
+    default:
+        break;
+    }
+
+    return field;
+}
+
+/// A copy of field with the values cleared, for reading into
+Field blank_field(const Field& field) {
+    auto blank = field;
+    blank.value = 0;
+    blank.signed_value = 0;
+    blank.flag = false;
+    blank.float_value = 0.0f;
+    std::ranges::fill(blank.data, std::byte{ 0 });
+    std::ranges::fill(blank.array, 0);
+    std::ranges::fill(blank.signed_array, 0);
+    return blank;
+}
+
+bool read_matches(const Field& written, const Field& read) {
+    switch (written.type) {
+    case FieldType::VALUE: {
+        auto mask = ~0ULL >> (64 - written.bits);
+        return (written.value & mask) == read.value;
+    }
+    case FieldType::BOUNDED_INT:
+    case FieldType::VARINT32:
+    case FieldType::VARINT64:
+        return written.signed_value == read.signed_value;
+    case FieldType::BOOL:
+        return written.flag == read.flag;
+    case FieldType::DATA: {
+        uint32_t bit_size = written.bit_size;
+        auto whole_bytes = bit_size / 8;
+        auto tail_mask = static_cast<uint8_t>((1U << (bit_size & 0x7)) - 1);
+        return memcmp(written.data.data(), read.data.data(), whole_bytes) == 0
+            && (tail_mask == 0
+                || (static_cast<uint8_t>(written.data[whole_bytes]) & tail_mask)
+                == static_cast<uint8_t>(read.data[whole_bytes]));
+    }
+    case FieldType::FLOAT:
+        return std::bit_cast<uint32_t>(written.float_value) == std::bit_cast<uint32_t>(read.float_value);
+    case FieldType::QUANTIZED_FLOAT:
+        return net::quantize_float(written.float_value, written.float_min, written.float_max, written.resolution)
+            == read.float_value;
+    case FieldType::INT_ARRAY:
+        return written.array == read.array;
+    case FieldType::SIGNED_INT_ARRAY:
+        return written.signed_array == read.signed_array;
+    default:
+        return true;
+    }
+}
+
+#define FUZZ_CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            std::fprintf(stderr, "seed %llu iteration %u: check failed: %s\n", \
+                static_cast<unsigned long long>(seed), iteration, #expr); \
+            return false; \
+        } \
+    } while (false)
+
+bool check_range_coded(uint64_t seed, uint32_t iteration, std::span<Field> fields, uint32_t buffer_size) {
+    static auto writer_models = std::make_unique<net::RangeCoderModels>();
+    static auto reader_models = std::make_unique<net::RangeCoderModels>();
+
+    // Coding random values can take a little more than their raw size
+    std::vector<std::byte> buffer(buffer_size * 2 + 64);
+    auto writer = net::NetRangeWriteStream(buffer, *writer_models);
+    for (auto& field : fields) {
+        auto copy = field;
+        FUZZ_CHECK(serialize_field(writer, copy));
+    }
+    FUZZ_CHECK(writer.flush_scratch());
+
+    auto reader = net::NetRangeReadStream(buffer.data(), writer.bits_written, *reader_models);
+    for (auto& field : fields) {
+        auto read = blank_field(field);
+        FUZZ_CHECK(serialize_field(reader, read));
+        FUZZ_CHECK(read_matches(field, read));
+    }
+
+    return true;
+}
+
+bool run_iteration(uint64_t seed, uint32_t iteration) {
+    std::mt19937_64 rng(seed ^ (static_cast<uint64_t>(iteration) * 0x9e3779b97f4a7c15ULL));
+    std::vector<Field> fields(random_range(rng, 1U, MAX_FIELDS));
+    for (auto& field : fields) {
+        field = random_field(rng);
+    }
+
+    auto buffer_size = random_range(rng, 1U, MAX_BUFFER_SIZE);
+    std::vector<std::byte> buffer(buffer_size);
+    auto writer = net::NetWriteStream(buffer);
+    auto reference = BitWriteStream(buffer_size * 8);
+
+    // Both streams must run out of space on the same field
+    auto written_count = 0U;
+    for (; written_count < fields.size(); ++written_count) {
+        auto reference_field = fields[written_count];
+        auto reference_ok = serialize_field(reference, reference_field);
+        auto writer_ok = serialize_field(writer, fields[written_count]);
+        FUZZ_CHECK(reference_ok == writer_ok);
+
+        if (!writer_ok) {
+            break;
+        }
+    }
+
+    FUZZ_CHECK(writer.flush_scratch());
+
+    // Fields past a failed one are not read back, so measure and compare only the ones that fit
+    auto measure = net::NetMeasureStream{};
+    auto complete = BitWriteStream(buffer_size * 8);
+    std::vector<uint32_t> field_end_bits;
+    for (auto i = 0U; i < written_count; ++i) {
+        FUZZ_CHECK(serialize_field(measure, fields[i]));
+        FUZZ_CHECK(serialize_field(complete, fields[i]));
+        field_end_bits.push_back(static_cast<uint32_t>(complete.bits.size()));
+    }
+
+    FUZZ_CHECK(measure.bits_measured == complete.bits.size() + complete.align_slack);
+
+    auto expected = reference.to_bytes();
+    FUZZ_CHECK(expected.size() <= writer.bits_written / 8);
+    FUZZ_CHECK(std::ranges::equal(expected, std::span(buffer).first(expected.size())));
+
+    auto total_bits = static_cast<uint32_t>(complete.bits.size());
+    if (total_bits == 0) {
+        return true;
+    }
+
+    // Read back from an exactly sized copy so out of bounds reads are caught by sanitizers
+    std::vector<std::byte> packet(buffer.begin(), buffer.begin() + (total_bits + 7) / 8);
+    auto reader = net::NetReadStream(packet.data(), total_bits);
+    for (auto i = 0U; i < written_count; ++i) {
+        auto read = blank_field(fields[i]);
+        FUZZ_CHECK(serialize_field(reader, read));
+        FUZZ_CHECK(read_matches(fields[i], read));
+    }
+
+    DL_NET_CHECK(check_range_coded(seed, iteration, std::span(fields).first(written_count), buffer_size));
+
+    // Truncated packets must fail on the first field crossing the cut, alignment padding does not read anything
+    auto cut = random_range(rng, 0U, total_bits - 1);
+    std::vector<std::byte> truncated(packet.begin(), packet.begin() + (cut + 7) / 8);
+    auto truncated_reader = net::NetReadStream(truncated.data(), cut);
+    auto failed = false;
+    for (auto i = 0U; i < written_count && !failed; ++i) {
+        auto read = blank_field(fields[i]);
+        auto ok = serialize_field(truncated_reader, read);
+
+        if (field_end_bits[i] <= cut) {
+            FUZZ_CHECK(ok);
+            FUZZ_CHECK(read_matches(fields[i], read));
+        } else if (fields[i].type != FieldType::ALIGN) {
+            FUZZ_CHECK(!ok);
+            failed = true;
+        }
+    }
+
+    return true;
+}
+}
+
+int main(int argc, char** argv) {
+    auto seed = argc > 1 ? std::strtoull(argv[1], nullptr, 0) : 1ULL;
+    auto iterations = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 0)) : 20000U;
+
+    for (auto iteration = 0U; iteration < iterations; ++iteration) {
+        if (!run_iteration(seed, iteration)) {
+            return 1;
+        }
+    }
+
+    std::printf("%u iterations passed (seed %llu)\n", iterations, static_cast<unsigned long long>(seed));
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <chrono>
+#include "third_party/doctest.h"
+#include "ducklib/net/congestion_control.h"
+#include "ducklib/net/shared.h"
+
+using namespace ducklib;
+using namespace std::chrono_literals;
+
+namespace {
+using Clock = net::CongestionController::Clock;
+
+/// Keeps the link busy at the controller's rate for duration, acking every 10ms with the given RTT
+void run_link(net::CongestionController& controller, Clock::time_point& now, Clock::duration duration, std::chrono::microseconds rtt) {
+    for (auto end = now + duration; now < end; now += 10ms) {
+        controller.on_packet_sent(controller.rate() / 100);
+        controller.on_rtt_sample(rtt, now);
+    }
+}
+}
+
+TEST_SUITE("congestion_control") {
+    TEST_CASE("TokenBucket_InDebt_WaitsForRefill") {
+        net::TokenBucket bucket;
+        auto now = Clock::now();
+
+        bucket.set_rate(128 * 1024, now);
+        REQUIRE(bucket.can_send(now));
+
+        // The bucket starts full, 2 * MTU at this rate. 1024 bytes at 128 KiB/s take 1/128 of a second.
+        bucket.consume(2 * net::MTU + 1024, now);
+        REQUIRE_FALSE(bucket.can_send(now + 7ms));
+        REQUIRE_EQ(bucket.next_send_time(), now + 7812500ns);
+        REQUIRE(bucket.can_send(now + 8ms));
+    }
+
+    TEST_CASE("TokenBucket_NoRate_LetsEverythingThrough") {
+        net::TokenBucket bucket;
+        auto now = Clock::now();
+
+        bucket.consume(1000000, now);
+        REQUIRE(bucket.can_send(now));
+    }
+
+    TEST_CASE("OnRttSample_CleanPath_ProbesUp") {
+        net::CongestionController controller;
+        auto now = Clock::now();
+
+        REQUIRE_EQ(controller.rate(), net::CongestionController::INITIAL_RATE);
+        run_link(controller, now, 2s, 30ms);
+        REQUIRE_GT(controller.rate(), net::CongestionController::INITIAL_RATE);
+    }
+
+    TEST_CASE("OnRttSample_Idle_DoesNotProbe") {
+        net::CongestionController controller;
+        auto now = Clock::now();
+
+        for (auto end = now + 2s; now < end; now += 10ms) {
+            controller.on_rtt_sample(30ms, now);
+        }
+
+        REQUIRE_EQ(controller.rate(), net::CongestionController::INITIAL_RATE);
+    }
+
+    TEST_CASE("OnRttSample_QueueBuildsUp_BacksOff") {
+        net::CongestionController controller;
+        auto now = Clock::now();
+
+        run_link(controller, now, 2s, 30ms);
+        auto clean_rate = controller.rate();
+
+        // 70ms over the lowest RTT is waiting in a queue somewhere
+        run_link(controller, now, 500ms, 100ms);
+        REQUIRE_LT(controller.rate(), clean_rate);
+    }
+
+    TEST_CASE("OnPacketLost_BacksOff_NotBelowMinimum") {
+        net::CongestionController controller;
+        auto now = Clock::now();
+
+        controller.on_packet_lost(now);
+        REQUIRE_LT(controller.rate(), net::CongestionController::INITIAL_RATE);
+
+        // At most one back off per round
+        auto rate = controller.rate();
+        controller.on_packet_lost(now + 1ms);
+        REQUIRE_EQ(controller.rate(), rate);
+
+        for (auto i = 0; i < 100; ++i) {
+            now += 50ms;
+            controller.on_packet_lost(now);
+        }
+
+        REQUIRE_EQ(controller.rate(), net::CongestionController::MIN_RATE);
+    }
+
+    TEST_CASE("SetBudget_CapsRate") {
+        net::CongestionController controller;
+        auto now = Clock::now();
+
+        controller.set_budget(20000);
+        REQUIRE_EQ(controller.rate(), 20000);
+        run_link(controller, now, 2s, 30ms);
+        REQUIRE_EQ(controller.rate(), 20000);
+
+        controller.set_enabled(false);
+        controller.set_budget(0);
+        REQUIRE_EQ(controller.rate(), 0);
+    }
+}
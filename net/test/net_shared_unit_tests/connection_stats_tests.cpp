@@ -0,0 +1,101 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "third_party/doctest.h"
+#include "ducklib/net/connection_stats.h"
+
+using namespace ducklib;
+using namespace std::chrono_literals;
+
+TEST_SUITE("connection_stats") {
+    TEST_CASE("RttEstimator_Samples_FollowRfc6298") {
+        net::RttEstimator estimator;
+
+        REQUIRE_FALSE(estimator.has_samples());
+        REQUIRE_EQ(estimator.retransmission_timeout(), net::RttEstimator::INITIAL_TIMEOUT);
+
+        estimator.add_sample(100ms);
+        REQUIRE_EQ(estimator.smoothed(), 100ms);
+        REQUIRE_EQ(estimator.variance(), 50ms);
+        REQUIRE_EQ(estimator.retransmission_timeout(), 300ms);
+
+        // RTTVAR = 3/4 * 50 + 1/4 * |100 - 200|, SRTT = 7/8 * 100 + 1/8 * 200
+        estimator.add_sample(200ms);
+        REQUIRE_EQ(estimator.variance(), 62500us);
+        REQUIRE_EQ(estimator.smoothed(), 112500us);
+        REQUIRE_EQ(estimator.retransmission_timeout(), 362500us);
+    }
+
+    TEST_CASE("RttEstimator_RetransmissionTimeout_Clamped") {
+        net::RttEstimator estimator;
+
+        for (auto i = 0; i < 100; ++i) {
+            estimator.add_sample(1ms);
+        }
+        REQUIRE_EQ(estimator.retransmission_timeout(), net::RttEstimator::MIN_TIMEOUT);
+
+        for (auto i = 0; i < 100; ++i) {
+            estimator.add_sample(30s);
+        }
+        REQUIRE_EQ(estimator.retransmission_timeout(), net::RttEstimator::MAX_TIMEOUT);
+    }
+
+    TEST_CASE("LossWindow_SlidesOverOldest") {
+        net::LossWindow window;
+
+        REQUIRE_EQ(window.loss_percent(), 0.0f);
+        window.add(true);
+        window.add(false);
+        window.add(false);
+        window.add(false);
+        REQUIRE_EQ(window.loss_percent(), doctest::Approx(25.0f));
+
+        for (auto i = 0U; i < net::LossWindow::WINDOW - 1; ++i) {
+            window.add(false);
+        }
+        REQUIRE_EQ(window.loss_percent(), 0.0f);
+    }
+
+    TEST_CASE("BandwidthMeter_Intervals_SmoothedAndDecayWhenIdle") {
+        net::BandwidthMeter meter;
+        auto time = std::chrono::steady_clock::time_point();
+
+        // 1000 bytes over an interval of 250ms is 32 kbps
+        meter.add(0, time);
+        meter.add(1000, time + 100ms);
+        REQUIRE_EQ(meter.kbps(), 0.0f);
+        meter.advance(time + 250ms);
+        REQUIRE_EQ(meter.kbps(), doctest::Approx(32.0f));
+
+        meter.advance(time + 500ms);
+        REQUIRE_LT(meter.kbps(), 32.0f);
+        REQUIRE_GT(meter.kbps(), 0.0f);
+    }
+
+    TEST_CASE("Snapshot_ReadWhilePublishing_NeverTorn") {
+        struct Pair {
+            uint64_t a;
+            uint64_t b;
+            uint32_t c;
+        };
+        net::Snapshot<Pair> snapshot;
+        std::atomic<bool> done = false;
+        auto torn = 0;
+
+        std::thread writer([&] {
+            for (auto i = uint64_t{ 1 }; i <= 100000; ++i) {
+                snapshot.publish({ i, i * 3, static_cast<uint32_t>(i) });
+            }
+            done = true;
+        });
+
+        while (!done) {
+            auto value = snapshot.read();
+            torn += value.b != value.a * 3 || value.c != static_cast<uint32_t>(value.a);
+        }
+
+        writer.join();
+        REQUIRE_EQ(torn, 0);
+        REQUIRE_EQ(snapshot.read().a, 100000);
+    }
+}
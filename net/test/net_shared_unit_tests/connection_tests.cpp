@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/connection.h"
+#include "ducklib/net/link_conditioner.h"
+#include "ducklib/net/loopback_transport.h"
+
+using namespace ducklib;
+
+namespace {
+using Datagrams = std::vector<std::vector<std::byte>>;
+
+Datagrams receive_all(const net::Transport& transport) {
+    Datagrams datagrams;
+    std::array<std::byte, net::MTU> buffer;
+    net::Address from;
+
+    for (auto size = transport.receive(from, buffer); size > 0; size = transport.receive(from, buffer)) {
+        datagrams.emplace_back(buffer.begin(), buffer.begin() + size);
+    }
+
+    return datagrams;
+}
+
+struct ConnectionPair {
+    ConnectionPair() {
+        auto [client_transport, server_transport] = net::LoopbackTransport::make_pair(512);
+        client = std::make_unique<net::Connection>(server_transport->get_address(), client_transport);
+        server = std::make_unique<net::Connection>(client_transport->get_address(), server_transport);
+    }
+
+    /// Queues a message on the client and sends it in a packet of its own
+    net::PacketIdType send_from_client() {
+        std::array<std::byte, 4> message = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 } };
+        client->send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        return client->send_message_packet();
+    }
+
+    std::unique_ptr<net::Connection> client;
+    std::unique_ptr<net::Connection> server;
+};
+
+struct DeltaState {
+    uint32_t health;
+};
+
+template <typename StreamT>
+bool serialize_delta(StreamT& stream, DeltaState& state, const DeltaState& baseline) {
+    return net::serialize_int_relative(stream, state.health, baseline.health, 0U, 1000U);
+}
+}
+
+TEST_SUITE("connection") {
+    TEST_CASE("ReceivePacket_Reply_AcksSentPackets") {
+        ConnectionPair pair;
+        std::array<net::PacketIdType, 3> sent;
+
+        for (auto& sequence : sent) {
+            sequence = pair.send_from_client();
+        }
+
+        REQUIRE_FALSE(pair.server->has_pending_sends());
+        for (auto& packet : receive_all(*pair.server->get_transport())) {
+            REQUIRE(pair.server->receive_packet(packet));
+        }
+
+        // Packets with messages have to be acked even when the server has nothing to say
+        REQUIRE(pair.server->has_pending_sends());
+        REQUIRE(pair.server->update(net::Connection::Clock::now()));
+        REQUIRE_FALSE(pair.server->has_pending_sends());
+
+        for (auto& packet : receive_all(*pair.client->get_transport())) {
+            REQUIRE(pair.client->receive_packet(packet));
+        }
+
+        for (auto sequence : sent) {
+            REQUIRE(pair.client->is_packet_acked(sequence));
+        }
+
+        // A packet that only acks is not acked back
+        REQUIRE_FALSE(pair.client->has_pending_sends());
+    }
+
+    TEST_CASE("ReceivePacket_LostPackets_LeftUnacked") {
+        ConnectionPair pair;
+
+        for (auto i = 0; i < 6; ++i) {
+            pair.send_from_client();
+        }
+
+        auto packets = receive_all(*pair.server->get_transport());
+        REQUIRE_EQ(packets.size(), 6);
+
+        // 1 and 3 are lost, 4 arrives after 5
+        for (auto index : { 0, 2, 5, 4 }) {
+            REQUIRE(pair.server->receive_packet(packets[index]));
+        }
+
+        pair.server->send_message_packet();
+
+        for (auto& packet : receive_all(*pair.client->get_transport())) {
+            REQUIRE(pair.client->receive_packet(packet));
+        }
+
+        for (auto sequence : { 0U, 2U, 4U, 5U }) {
+            REQUIRE(pair.client->is_packet_acked(sequence));
+        }
+        REQUIRE_FALSE(pair.client->is_packet_acked(1));
+        REQUIRE_FALSE(pair.client->is_packet_acked(3));
+    }
+
+    TEST_CASE("ReceivePacket_DuplicateOrTooOld_Dropped") {
+        ConnectionPair pair;
+
+        for (auto i = 0; i < net::MAX_TRACKED_PACKETS + 1; ++i) {
+            pair.send_from_client();
+        }
+
+        auto packets = receive_all(*pair.server->get_transport());
+        REQUIRE_EQ(packets.size(), net::MAX_TRACKED_PACKETS + 1);
+
+        REQUIRE(pair.server->receive_packet(packets.back()));
+        REQUIRE_FALSE(pair.server->receive_packet(packets.back()));
+        REQUIRE_FALSE(pair.server->receive_packet(packets.front()));
+        REQUIRE(pair.server->receive_packet(packets[1]));
+    }
+
+    TEST_CASE("GetStats_Acks_MeasureRttAndLoss") {
+        ConnectionPair pair;
+        auto start = net::Connection::Clock::now();
+        std::array<std::byte, 4> message = {};
+
+        REQUIRE_EQ(pair.client->get_stats().retransmission_timeout, net::RttEstimator::INITIAL_TIMEOUT);
+
+        // Every packet but 3 and 10 arrives and is acked 50ms after it was sent
+        for (auto i = 0; i < 40; ++i) {
+            auto sent_at = start + i * std::chrono::milliseconds(10);
+            pair.client->send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+            pair.client->send_message_packet(sent_at);
+            auto packets = receive_all(*pair.server->get_transport());
+            REQUIRE_EQ(packets.size(), 1);
+
+            if (i == 3 || i == 10) {
+                continue;
+            }
+
+            REQUIRE(pair.server->receive_packet(packets[0]));
+            pair.server->send_message_packet(sent_at + std::chrono::milliseconds(20));
+
+            for (auto& ack : receive_all(*pair.client->get_transport())) {
+                REQUIRE(pair.client->receive_packet(ack, sent_at + std::chrono::milliseconds(50)));
+            }
+        }
+
+        auto stats = pair.client->get_stats();
+        REQUIRE_EQ(stats.rtt, std::chrono::milliseconds(50));
+        REQUIRE_EQ(stats.packets_sent, 40);
+        REQUIRE_EQ(stats.packets_received, 38);
+        REQUIRE_EQ(stats.packets_acked, 38);
+        // 10 is still inside the ack trail of the newest ack, 3 is not
+        REQUIRE_EQ(stats.packets_lost, 1);
+        REQUIRE_EQ(stats.packet_loss, doctest::Approx(100.0f / 39.0f));
+        REQUIRE_GT(stats.sent_kbps, 0.0f);
+        REQUIRE_GT(stats.acked_kbps, 0.0f);
+        REQUIRE_EQ(pair.server->get_stats().packets_received, 38);
+    }
+
+    TEST_CASE("ReceivePacket_Messages_HandedToCallback") {
+        ConnectionPair pair;
+        std::vector<std::pair<uint8_t, std::vector<std::byte>>> received;
+        std::array<std::byte, 3> first = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 } };
+        std::array<std::byte, 300> second;
+        second.fill(std::byte{ 9 });
+
+        pair.server->set_message_callback([&](const net::ReceivedMessage& message) {
+            REQUIRE_EQ(message.data.size(), (message.bit_size + 7) / 8);
+            received.emplace_back(message.type, std::vector(message.data.begin(), message.data.end()));
+        });
+        pair.client->send_reliable(first.data(), static_cast<uint16_t>(first.size() * 8), 4, false, 2);
+        pair.client->send_reliable(second.data(), static_cast<uint16_t>(second.size() * 8), 5, true, 1);
+        pair.client->send_message_packet();
+
+        for (auto& packet : receive_all(*pair.server->get_transport())) {
+            REQUIRE(pair.server->receive_packet(packet));
+        }
+
+        REQUIRE_EQ(received.size(), 2);
+        REQUIRE_EQ(received[0].first, 4);
+        REQUIRE(std::ranges::equal(received[0].second, first));
+        REQUIRE_EQ(received[1].first, 5);
+        REQUIRE(std::ranges::equal(received[1].second, second));
+    }
+
+    TEST_CASE("SendDelta_AckedBaselines_RemoteDecodesSameState") {
+        constexpr uint8_t TYPE = 7;
+        ConnectionPair pair;
+        std::vector<uint32_t> received;
+
+        pair.server->set_message_callback([&](const net::ReceivedMessage& message) {
+            auto reader = net::NetReadStream(message.data.data(), message.bit_size);
+            DeltaState state = {};
+            REQUIRE(pair.server->receive_delta(reader, state, message.packet_id, message.type));
+            received.push_back(state.health);
+        });
+
+        // Sends what is queued in one packet and lets the ack come back
+        auto exchange = [&] {
+            pair.client->send_message_packet();
+
+            for (auto& packet : receive_all(*pair.server->get_transport())) {
+                REQUIRE(pair.server->receive_packet(packet));
+            }
+
+            pair.server->send_message_packet();
+
+            for (auto& packet : receive_all(*pair.client->get_transport())) {
+                REQUIRE(pair.client->receive_packet(packet));
+            }
+        };
+
+        // No baseline yet, then one against the acked first
+        DeltaState state = { 100 };
+        pair.client->send_delta(state, TYPE);
+        exchange();
+        state.health = 150;
+        pair.client->send_delta(state, TYPE);
+        exchange();
+        REQUIRE_EQ(received, std::vector<uint32_t>{ 100, 150 });
+
+        // Two of one type in a packet, the high priority one goes first but the low one was queued first. Both ends
+        // have to take the same one of them as the next baseline.
+        received.clear();
+        state.health = 100;
+        pair.client->send_delta(state, TYPE, net::Connection::LOW_PRIORITY);
+        state.health = 200;
+        pair.client->send_delta(state, TYPE, net::Connection::HIGH_PRIORITY);
+        exchange();
+        state.health = 100;
+        pair.client->send_delta(state, TYPE);
+        exchange();
+        REQUIRE_EQ(received, std::vector<uint32_t>{ 200, 100, 100 });
+
+        // Around both baseline rings a few times
+        for (auto i = 0U; i < 3 * net::NUM_BASELINES; ++i) {
+            received.clear();
+            state.health = i;
+            pair.client->send_delta(state, TYPE, static_cast<uint8_t>(i % 3));
+            state.health = i + 500;
+            pair.client->send_delta(state, TYPE, static_cast<uint8_t>(2 - i % 3));
+            exchange();
+            REQUIRE_EQ(received.size(), 2);
+            REQUIRE(std::ranges::is_permutation(received, std::vector<uint32_t>{ i, i + 500 }));
+        }
+    }
+
+    TEST_CASE("SendReliable_LargerThanPacket_ResendsOnlyLostSlices") {
+        ConnectionPair pair;
+        auto now = net::Connection::Clock::now();
+        std::vector<std::byte> snapshot(10 * net::SLICE_SIZE - 100);
+        std::vector<std::byte> received;
+        auto received_type = uint8_t{ 0 };
+        auto client_packets = 0U;
+
+        for (auto i = 0U; i < snapshot.size(); ++i) {
+            snapshot[i] = static_cast<std::byte>(i * 13);
+        }
+
+        pair.server->set_message_callback([&](const net::ReceivedMessage& message) {
+            received.assign(message.data.begin(), message.data.end());
+            received_type = message.type;
+        });
+        pair.client->send_reliable(snapshot.data(), static_cast<uint32_t>(snapshot.size() * 8), 6);
+
+        // Every 10ms the client sends what is due, the first two packets with slices are lost and the rest acked 5ms
+        // later
+        for (auto step = 0; step < 100 && pair.client->has_pending_sends(); ++step) {
+            now += std::chrono::milliseconds(10);
+
+            if (!pair.client->update(now)) {
+                continue;
+            }
+
+            for (auto& packet : receive_all(*pair.server->get_transport())) {
+                if (++client_packets == 2 || client_packets == 4) {
+                    continue;
+                }
+
+                REQUIRE(pair.server->receive_packet(packet, now));
+            }
+
+            pair.server->update(now);
+
+            for (auto& packet : receive_all(*pair.client->get_transport())) {
+                REQUIRE(pair.client->receive_packet(packet, now + std::chrono::milliseconds(5)));
+            }
+        }
+
+        REQUIRE_FALSE(pair.client->has_pending_sends());
+        REQUIRE_EQ(received_type, 6);
+        REQUIRE(std::ranges::equal(received, snapshot));
+        REQUIRE_EQ(client_packets, 12);
+    }
+
+    TEST_CASE("Update_BandwidthBudget_PacesSends") {
+        ConnectionPair pair;
+        auto now = net::Connection::Clock::now();
+        std::array<std::byte, 100> message = {};
+        auto sent_bytes = size_t{ 0 };
+
+        pair.client->set_bandwidth_budget(12000);
+
+        for (auto i = 0; i < 200; ++i) {
+            pair.client->send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        }
+
+        // A second of updates every millisecond sends the budget and the bucket it started with
+        for (auto step = 0; step < 1000; ++step) {
+            now += std::chrono::milliseconds(1);
+            pair.client->update(now);
+
+            for (auto& packet : receive_all(*pair.server->get_transport())) {
+                sent_bytes += packet.size();
+            }
+        }
+
+        REQUIRE(pair.client->has_pending_sends());
+        REQUIRE_GE(sent_bytes, 12000);
+        REQUIRE_LE(sent_bytes, 12000 + 3 * net::MTU);
+        REQUIRE_EQ(pair.client->get_stats().send_rate_kbps, doctest::Approx(96.0f));
+    }
+
+    TEST_CASE("ReceivePacket_SlowSendingRemote_RateHolds") {
+        using namespace std::chrono_literals;
+        auto [client_loopback, server_transport] = net::LoopbackTransport::make_pair(512);
+        auto now = net::Connection::Clock::now();
+        auto client_link = std::make_shared<net::LinkConditioner>(
+            client_loopback,
+            net::LinkConditionerConfig{ .send = { .latency = 10ms }, .receive = { .latency = 10ms }, .clock = [&] { return now; } });
+        net::Connection client(server_transport->get_address(), client_link);
+        net::Connection server(client_loopback->get_address(), server_transport);
+        std::array<std::byte, 8> message = {};
+        std::array<std::byte, net::MTU> buffer;
+        std::array<net::IncomingPacket, 16> incoming;
+        incoming.fill({ .buffer = buffer });
+
+        // Acks leave the server only every 100ms, the client sends every 70ms, so the server holds the newest ack for
+        // anywhere up to 70ms on a clean 20ms round trip
+        server.set_send_interval(100ms);
+
+        for (auto step = 0; step < 3000; ++step) {
+            now += 1ms;
+
+            if (step % 70 == 0) {
+                client.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+            }
+
+            client.update(now);
+
+            for (auto& packet : receive_all(*server_transport)) {
+                REQUIRE(server.receive_packet(packet, now));
+            }
+
+            server.update(now);
+
+            // One buffer is enough, the server never sends more than a packet a step
+            for (auto count = client_link->receive_batch({ incoming.data(), 1 }); count > 0; count = client_link->receive_batch({ incoming.data(), 1 })) {
+                REQUIRE(client.receive_packet(std::span(buffer).first(incoming[0].size), incoming[0].received_at));
+            }
+        }
+
+        auto stats = client.get_stats();
+        REQUIRE_EQ(stats.packets_lost, 0);
+        REQUIRE_GE(stats.rtt, 20ms);
+        REQUIRE_GE(stats.send_rate_kbps, net::CongestionController::INITIAL_RATE * 8.0f / 1000.0f);
+    }
+
+    TEST_CASE("SendMessagePacket_Overloaded_LowPriorityStillSent") {
+        ConnectionPair pair;
+        std::array<std::byte, 100> message = {};
+        auto low_received_at = -1;
+        auto packet = 0;
+
+        pair.server->set_message_callback([&](const net::ReceivedMessage& received) {
+            if (received.type == 1) {
+                low_received_at = packet;
+            }
+        });
+        pair.client->send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 1, false, net::Connection::LOW_PRIORITY);
+
+        // Several times more high priority messages are queued than a packet holds
+        for (; packet < 2 * net::MAX_MESSAGE_WAIT && low_received_at < 0; ++packet) {
+            for (auto i = 0; i < 40; ++i) {
+                pair.client->send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 2, false, net::Connection::HIGH_PRIORITY);
+            }
+
+            pair.client->send_message_packet();
+
+            for (auto& datagram : receive_all(*pair.server->get_transport())) {
+                REQUIRE(pair.server->receive_packet(datagram));
+            }
+        }
+
+        REQUIRE_EQ(low_received_at, net::MAX_MESSAGE_WAIT);
+    }
+}
@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/fragment.h"
+
+using namespace ducklib;
+using namespace std::chrono_literals;
+
+namespace {
+/// Message of byte_size bytes counting up from 0
+std::vector<std::byte> counting_message(uint32_t byte_size) {
+    std::vector<std::byte> message(byte_size);
+
+    for (auto i = 0U; i < byte_size; ++i) {
+        message[i] = static_cast<std::byte>(i * 7);
+    }
+
+    return message;
+}
+
+net::MessageBuffer pooled_copy(net::MessagePool& pool, const std::vector<std::byte>& message) {
+    auto buffer = pool.acquire(static_cast<uint32_t>(message.size()));
+    memcpy(buffer.data(), message.data(), message.size());
+    return buffer;
+}
+}
+
+TEST_SUITE("fragment") {
+    TEST_CASE("SliceSize_LastSliceHoldsRest") {
+        REQUIRE_EQ(net::slice_count(1), 1);
+        REQUIRE_EQ(net::slice_count(net::SLICE_SIZE * 8), 1);
+        REQUIRE_EQ(net::slice_count(net::SLICE_SIZE * 8 + 1), 2);
+        REQUIRE_EQ(net::slice_count(net::MAX_FRAGMENTED_MESSAGE_SIZE * 8), net::MAX_SLICES);
+        REQUIRE_EQ(net::slice_byte_size(net::SLICE_SIZE * 8 + 9, 0), net::SLICE_SIZE);
+        REQUIRE_EQ(net::slice_byte_size(net::SLICE_SIZE * 8 + 9, 1), 2);
+    }
+
+    TEST_CASE("NextSlice_Unacked_ResentAfterTimeout") {
+        net::MessagePool pool;
+        net::FragmentSender sender;
+        auto now = net::FragmentSender::Clock::now();
+        uint8_t slice = 0;
+
+        REQUIRE_FALSE(sender.next_slice(now, 100ms, slice));
+        sender.queue(pooled_copy(pool, counting_message(3 * net::SLICE_SIZE - 10)), (3 * net::SLICE_SIZE - 10) * 8, 5);
+        REQUIRE(sender.is_sending());
+
+        for (auto i = 0U; i < 3; ++i) {
+            REQUIRE(sender.next_slice(now, 100ms, slice));
+            REQUIRE_EQ(slice, i);
+            sender.on_slice_sent(slice, now);
+        }
+
+        REQUIRE_FALSE(sender.next_slice(now + 50ms, 100ms, slice));
+        REQUIRE_EQ(sender.next_send_time(100ms), now + 100ms);
+
+        // Only the slice that was not acked is sent again
+        sender.on_slice_acked(0, 0);
+        sender.on_slice_acked(0, 2);
+        REQUIRE(sender.next_slice(now + 100ms, 100ms, slice));
+        REQUIRE_EQ(slice, 1);
+
+        auto [header, data] = sender.slice(1);
+        REQUIRE_EQ(header.fragment_id, 0);
+        REQUIRE_EQ(header.type, 5);
+        REQUIRE_EQ(header.slice_index, 1);
+        REQUIRE_EQ(data.size(), net::SLICE_SIZE);
+
+        sender.on_slice_acked(0, 1);
+        REQUIRE_FALSE(sender.is_sending());
+    }
+
+    TEST_CASE("NextSlice_MessageAcked_NextMessageStarts") {
+        net::MessagePool pool;
+        net::FragmentSender sender;
+        auto now = net::FragmentSender::Clock::now();
+        uint8_t slice = 0;
+
+        sender.queue(pooled_copy(pool, counting_message(2000)), 2000 * 8, 1);
+        sender.queue(pooled_copy(pool, counting_message(1500)), 1500 * 8, 2);
+        sender.on_slice_acked(0, 0);
+        sender.on_slice_acked(0, 1);
+
+        REQUIRE(sender.next_slice(now, 100ms, slice));
+        auto [header, data] = sender.slice(slice);
+        REQUIRE_EQ(header.fragment_id, 1);
+        REQUIRE_EQ(header.type, 2);
+
+        // Late acks for the previous message are not taken for this one
+        sender.on_slice_acked(0, 0);
+        sender.on_slice_acked(0, 1);
+        REQUIRE(sender.is_sending());
+    }
+
+    TEST_CASE("Receive_OutOfOrderAndDuplicates_Reassembles") {
+        net::MessagePool pool;
+        net::FragmentReceiver receiver;
+        auto message = counting_message(2 * net::SLICE_SIZE + 300);
+        auto bit_size = static_cast<uint32_t>(message.size() * 8);
+        auto receive = [&](uint8_t slice_index) {
+            auto header = net::SliceHeader{ 7, 3, bit_size, slice_index };
+            auto data = std::span(message).subspan(slice_index * net::SLICE_SIZE, net::slice_byte_size(bit_size, slice_index));
+            return receiver.receive(header, data, pool);
+        };
+
+        REQUIRE(receive(2));
+        REQUIRE(receive(0));
+        REQUIRE(receive(2));
+        REQUIRE_FALSE(receiver.is_complete());
+        REQUIRE(receive(1));
+        REQUIRE(receiver.is_complete());
+        REQUIRE_EQ(receiver.message_type(), 3);
+        REQUIRE_EQ(receiver.message_bit_size(), bit_size);
+
+        auto received = receiver.take_message();
+        REQUIRE_EQ(memcmp(received.data(), message.data(), message.size()), 0);
+
+        // Resent slices of a message already received are ignored
+        REQUIRE(receive(1));
+        REQUIRE_FALSE(receiver.is_receiving());
+    }
+
+    TEST_CASE("Receive_InconsistentSlice_Rejected") {
+        net::MessagePool pool;
+        net::FragmentReceiver receiver;
+        auto message = counting_message(net::SLICE_SIZE + 1);
+        auto bit_size = static_cast<uint32_t>(message.size() * 8);
+
+        REQUIRE_FALSE(receiver.receive({ 0, 0, net::MAX_FRAGMENTED_MESSAGE_SIZE * 8 + 1, 0 }, message, pool));
+        REQUIRE_FALSE(receiver.receive({ 0, 0, bit_size, 2 }, std::span(message).first(1), pool));
+        REQUIRE_FALSE(receiver.receive({ 0, 0, bit_size, 1 }, std::span(message).first(2), pool));
+        REQUIRE(receiver.receive({ 0, 0, bit_size, 1 }, std::span(message).first(1), pool));
+        REQUIRE_FALSE(receiver.receive({ 0, 1, bit_size, 0 }, std::span(message).first(net::SLICE_SIZE), pool));
+        REQUIRE_FALSE(receiver.is_complete());
+    }
+}
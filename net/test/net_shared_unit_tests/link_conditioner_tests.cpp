@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/link_conditioner.h"
+
+using namespace ducklib;
+using namespace std::chrono_literals;
+
+namespace {
+/// Records what is sent through it and hands out whatever is put in its inbox
+class RecordingTransport : public net::Transport {
+public:
+    struct Datagram {
+        net::Address address;
+        std::vector<std::byte> data;
+        net::ReceiveTime received_at = {}; ///< Handed out as the receive time of inbox datagrams
+    };
+
+    auto get_port() const -> uint16_t override { return 1; }
+    auto get_handle() const -> net::SocketHandle override { return net::INVALID_SOCKET_HANDLE; }
+
+    auto send(net::Address to, std::span<const std::byte> data) const -> size_t override {
+        sent.push_back({ to, { data.begin(), data.end() } });
+        return data.size();
+    }
+
+    auto receive(net::Address& from, std::span<std::byte> receive_buffer) const -> size_t override {
+        auto packet = net::IncomingPacket{ .buffer = receive_buffer };
+        auto count = receive_batch({ &packet, 1 });
+        from = packet.from;
+        return count == 0 ? 0 : packet.size;
+    }
+
+    auto send_batch(std::span<const net::OutgoingPacket> packets) const -> size_t override {
+        for (auto& packet : packets) {
+            send(packet.to, packet.data);
+        }
+        return packets.size();
+    }
+
+    auto receive_batch(std::span<net::IncomingPacket> packets) const -> size_t override {
+        auto count = size_t{ 0 };
+
+        for (; count < packets.size() && !inbox.empty(); ++count) {
+            auto& datagram = inbox.front();
+            packets[count].from = datagram.address;
+            packets[count].size = datagram.data.size();
+            packets[count].received_at = datagram.received_at;
+            std::ranges::copy(datagram.data, packets[count].buffer.begin());
+            inbox.pop_front();
+        }
+
+        return count;
+    }
+
+    mutable std::vector<Datagram> sent;
+    mutable std::deque<Datagram> inbox;
+};
+
+std::array<std::byte, 4> numbered(uint32_t number) {
+    return { static_cast<std::byte>(number), static_cast<std::byte>(number >> 8), std::byte{}, std::byte{} };
+}
+
+uint32_t number_of(const RecordingTransport::Datagram& datagram) {
+    return static_cast<uint32_t>(datagram.data[0]) | static_cast<uint32_t>(datagram.data[1]) << 8;
+}
+
+/// Sends count numbered packets 1ms apart and lets the last of them arrive
+std::vector<uint32_t> send_numbered(const net::LinkProfile& profile, uint64_t seed, uint32_t count, net::LinkStats* stats = nullptr) {
+    auto inner = std::make_shared<RecordingTransport>();
+    auto time = net::ReceiveTime();
+    net::LinkConditioner link(inner, { .send = profile, .seed = seed, .clock = [&] { return time; } });
+    auto to = net::Address("127.0.0.1", 1000);
+
+    for (auto i = 0U; i < count; ++i) {
+        REQUIRE_EQ(link.send(to, numbered(i)), 4);
+        time += 1ms;
+    }
+
+    time += 10s;
+    link.flush();
+
+    if (stats) {
+        *stats = link.send_stats();
+    }
+
+    std::vector<uint32_t> numbers;
+    for (auto& datagram : inner->sent) {
+        REQUIRE_EQ(datagram.address, to);
+        numbers.push_back(number_of(datagram));
+    }
+    return numbers;
+}
+}
+
+TEST_SUITE("link_conditioner") {
+    TEST_CASE("Send_WithLatency_HeldUntilDue") {
+        auto inner = std::make_shared<RecordingTransport>();
+        auto time = net::ReceiveTime();
+        net::LinkConditioner link(inner, { .send = { .latency = 50ms }, .clock = [&] { return time; } });
+
+        REQUIRE_FALSE(link.next_wakeup());
+        REQUIRE_EQ(link.send(net::Address("127.0.0.1", 1000), numbered(7)), 4);
+        REQUIRE(inner->sent.empty());
+        REQUIRE_EQ(link.next_wakeup(), time + 50ms);
+
+        time += 49ms;
+        REQUIRE_EQ(link.flush(), 0);
+        time += 1ms;
+        REQUIRE_EQ(link.flush(), 1);
+        REQUIRE_EQ(inner->sent.size(), 1);
+        REQUIRE_EQ(number_of(inner->sent[0]), 7);
+        REQUIRE_FALSE(link.next_wakeup());
+    }
+
+    TEST_CASE("Send_DefaultProfile_PassesStraightThrough") {
+        auto numbers = send_numbered({}, 0, 50);
+
+        REQUIRE_EQ(numbers.size(), 50);
+        for (auto i = 0U; i < numbers.size(); ++i) {
+            REQUIRE_EQ(numbers[i], i);
+        }
+    }
+
+    TEST_CASE("Send_SameSeed_SameOutcome") {
+        auto profile = net::LinkProfile{ .latency = 20ms, .jitter = 5ms, .loss = 0.2f, .duplicate = 0.1f };
+        net::LinkStats stats;
+        auto first = send_numbered(profile, 42, 500, &stats);
+        auto second = send_numbered(profile, 42, 500);
+        auto other_seed = send_numbered(profile, 43, 500);
+
+        REQUIRE_EQ(first, second);
+        REQUIRE_NE(first, other_seed);
+        REQUIRE_EQ(first.size(), 500 - stats.dropped + stats.duplicated);
+        REQUIRE_EQ(stats.delivered, first.size());
+        // Loose bounds, the seed fixes the exact counts
+        REQUIRE_GT(stats.dropped, 50);
+        REQUIRE_LT(stats.dropped, 150);
+        REQUIRE_GT(stats.duplicated, 0);
+        // Jitter wider than the send interval reorders
+        REQUIRE_FALSE(std::ranges::is_sorted(first));
+    }
+
+    TEST_CASE("Send_BurstLoss_LosesRuns") {
+        auto profile = net::LinkProfile{ .burst_enter = 0.05f, .burst_exit = 0.25f, .burst_loss = 1.0f };
+        net::LinkStats stats;
+        auto numbers = send_numbered(profile, 7, 1000, &stats);
+        auto longest_gap = 0U;
+
+        for (auto i = 1U; i < numbers.size(); ++i) {
+            longest_gap = std::max(longest_gap, numbers[i] - numbers[i - 1] - 1);
+        }
+
+        REQUIRE_GT(stats.dropped, 0);
+        REQUIRE_EQ(stats.burst_dropped, stats.dropped);
+        REQUIRE_EQ(numbers.size(), 1000 - stats.dropped);
+        REQUIRE_GT(longest_gap, 3);
+    }
+
+    TEST_CASE("Send_Reorder_LaterPacketsOvertake") {
+        net::LinkStats stats;
+        auto numbers = send_numbered({ .reorder = 0.2f, .reorder_delay = 5ms }, 3, 200, &stats);
+
+        REQUIRE_GT(stats.reordered, 0);
+        REQUIRE_EQ(numbers.size(), 200);
+        REQUIRE_FALSE(std::ranges::is_sorted(numbers));
+        std::ranges::sort(numbers);
+        for (auto i = 0U; i < numbers.size(); ++i) {
+            REQUIRE_EQ(numbers[i], i);
+        }
+    }
+
+    TEST_CASE("Send_BandwidthCap_SpacesAndDropsOverQueueLimit") {
+        auto inner = std::make_shared<RecordingTransport>();
+        auto time = net::ReceiveTime();
+        auto start = time;
+        net::LinkConditioner link(inner, { .send = { .bandwidth = 1000, .queue_limit = 300 }, .clock = [&] { return time; } });
+        std::array<std::byte, 100> payload = {};
+
+        for (auto i = 0; i < 5; ++i) {
+            REQUIRE_EQ(link.send(net::Address("127.0.0.1", 1000), payload), payload.size());
+        }
+
+        REQUIRE_EQ(link.send_stats().overflowed, 2);
+
+        // 100 bytes take 100ms at 1000 bytes per second
+        for (auto i = 1; i <= 3; ++i) {
+            REQUIRE_EQ(link.next_wakeup(), start + i * 100ms);
+            time = *link.next_wakeup() - 1ms;
+            REQUIRE_EQ(link.flush(), 0);
+            time += 1ms;
+            REQUIRE_EQ(link.flush(), 1);
+        }
+
+        REQUIRE_EQ(inner->sent.size(), 3);
+    }
+
+    TEST_CASE("Receive_WithLatency_StampedWithRelease") {
+        auto inner = std::make_shared<RecordingTransport>();
+        auto time = net::ReceiveTime();
+        auto start = time;
+        net::LinkConditioner link(inner, { .receive = { .latency = 20ms }, .clock = [&] { return time; } });
+        std::array<std::byte, net::MTU> buffer = {};
+        std::array<net::IncomingPacket, 4> packets;
+        packets.fill({ .buffer = buffer });
+
+        auto payload = numbered(9);
+        inner->inbox.push_back({ net::Address("127.0.0.1", 2000), { payload.begin(), payload.end() }, time });
+
+        REQUIRE_EQ(link.receive_batch(packets), 0);
+        REQUIRE(inner->inbox.empty());
+        REQUIRE_EQ(link.next_wakeup(), start + 20ms);
+
+        time += 20ms;
+        REQUIRE_EQ(link.receive_batch(packets), 1);
+        REQUIRE_EQ(packets[0].from, net::Address("127.0.0.1", 2000));
+        REQUIRE_EQ(packets[0].size, 4);
+        REQUIRE_EQ(packets[0].received_at, start + 20ms);
+        REQUIRE_EQ(buffer[0], std::byte{ 9 });
+        REQUIRE_EQ(link.receive_stats().delivered, 1);
+    }
+
+    TEST_CASE("Receive_PulledLate_DelayedFromInnerReceiveTime") {
+        auto inner = std::make_shared<RecordingTransport>();
+        net::LinkConditioner link(inner, { .receive = { .latency = 20s } });
+        std::array<std::byte, net::MTU> buffer = {};
+        auto packet = net::IncomingPacket{ .buffer = buffer };
+
+        // Sat in the inner transport for a while before the link got to it, that counts towards the latency
+        auto received_at = std::chrono::steady_clock::now() - 5s;
+        auto payload = numbered(3);
+        inner->inbox.push_back({ net::Address("127.0.0.1", 2000), { payload.begin(), payload.end() }, received_at });
+
+        REQUIRE_EQ(link.receive_batch({ &packet, 1 }), 0);
+        REQUIRE_EQ(link.next_wakeup(), received_at + 20s);
+    }
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/loopback_transport.h"
+#include "ducklib/net/net_reactor.h"
+
+using namespace ducklib;
+
+TEST_SUITE("loopback_transport") {
+    TEST_CASE("Send_Receive_ArrivesFromPeer") {
+        auto [first, second] = net::LoopbackTransport::make_pair();
+        std::array<std::byte, 3> payload = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 } };
+        std::array<std::byte, net::MTU> buffer = {};
+        net::Address from;
+
+        REQUIRE_NE(first->get_address(), second->get_address());
+        REQUIRE_EQ(first->get_handle(), net::INVALID_SOCKET_HANDLE);
+        REQUIRE_FALSE(second->next_wakeup());
+        REQUIRE_EQ(second->receive(from, buffer), 0);
+
+        REQUIRE_EQ(first->send(second->get_address(), payload), payload.size());
+        REQUIRE(second->next_wakeup());
+        REQUIRE_EQ(first->receive(from, buffer), 0);
+        REQUIRE_EQ(second->receive(from, buffer), payload.size());
+        REQUIRE_EQ(from, first->get_address());
+        REQUIRE(std::equal(payload.begin(), payload.end(), buffer.begin()));
+        REQUIRE_FALSE(second->next_wakeup());
+    }
+
+    TEST_CASE("Send_NotToPeerOrTooLarge_Fails") {
+        auto [first, second] = net::LoopbackTransport::make_pair();
+        std::array<std::byte, net::MTU + 1> payload = {};
+
+        REQUIRE_EQ(first->send(first->get_address(), std::span(payload).first(8)), static_cast<size_t>(-1));
+        REQUIRE_EQ(first->send(second->get_address(), payload), static_cast<size_t>(-1));
+        REQUIRE_FALSE(second->next_wakeup());
+    }
+
+    TEST_CASE("SendBatch_FullRing_DropsRest") {
+        auto [first, second] = net::LoopbackTransport::make_pair(3);
+        std::array<std::byte, 8> payload = {};
+        std::array<net::OutgoingPacket, 6> outgoing;
+        outgoing.fill({ second->get_address(), payload });
+        std::array<std::byte, 6 * net::MTU> buffers = {};
+        std::array<net::IncomingPacket, 6> incoming;
+
+        for (auto i = 0U; i < incoming.size(); ++i) {
+            incoming[i].buffer = std::span(buffers).subspan(i * net::MTU, net::MTU);
+        }
+
+        // Capacity is rounded up to 4, sent like UDP even when the receiver has no room
+        REQUIRE_EQ(first->send_batch(outgoing), outgoing.size());
+        REQUIRE_EQ(first->dropped_count(), 2);
+        REQUIRE_EQ(second->receive_batch(incoming), 4);
+        REQUIRE_EQ(incoming[3].size, payload.size());
+        REQUIRE_EQ(second->receive_batch(incoming), 0);
+    }
+
+    TEST_CASE("Send_FromOtherThread_ArrivesInOrder") {
+        constexpr auto PACKET_COUNT = 100000U;
+        auto [first, second] = net::LoopbackTransport::make_pair(16);
+        std::array<std::byte, 32 * net::MTU> buffers = {};
+        std::array<net::IncomingPacket, 32> incoming;
+        auto received = 0U;
+        auto last = uint32_t{ 0 };
+        auto ordered = true;
+        std::atomic<uint32_t> failed_sends = 0;
+
+        for (auto i = 0U; i < incoming.size(); ++i) {
+            incoming[i].buffer = std::span(buffers).subspan(i * net::MTU, net::MTU);
+        }
+
+        std::thread sender([&, first = first, to = second->get_address()] {
+            for (auto i = 1U; i <= PACKET_COUNT; ++i) {
+                auto data = std::as_bytes(std::span(&i, 1));
+                failed_sends += first->send(to, data) != data.size();
+            }
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+        while (received + first->dropped_count() < PACKET_COUNT && std::chrono::steady_clock::now() < deadline) {
+            auto count = second->receive_batch(incoming);
+
+            for (auto i = 0U; i < count; ++i) {
+                auto number = uint32_t{ 0 };
+                memcpy(&number, incoming[i].buffer.data(), sizeof(number));
+                ordered = ordered && number > last;
+                last = number;
+            }
+
+            received += static_cast<uint32_t>(count);
+        }
+
+        sender.join();
+        received += static_cast<uint32_t>(second->receive_batch(incoming));
+        REQUIRE_EQ(failed_sends, 0);
+        REQUIRE(ordered);
+        REQUIRE_GT(received, 0);
+        REQUIRE_EQ(received + first->dropped_count(), PACKET_COUNT);
+    }
+
+    TEST_CASE("Connections_OverReactor_DeliverWithoutWaiting") {
+        auto [client, server] = net::LoopbackTransport::make_pair();
+        net::Connection client_connection(server->get_address(), client);
+        net::Connection server_connection(client->get_address(), server);
+        net::NetReactor reactor;
+        std::array<std::byte, 4> message = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 } };
+        auto unknown_count = 0;
+
+        REQUIRE(reactor.add_connection(client_connection));
+        REQUIRE(reactor.add_connection(server_connection));
+        reactor.set_unknown_sender_callback(
+            [&](const std::shared_ptr<net::Transport>&, const net::Address&, std::span<const std::byte>, net::ReceiveTime) { ++unknown_count; });
+        REQUIRE_EQ(reactor.transport_count(), 2);
+
+        client_connection.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        auto start = std::chrono::steady_clock::now();
+        auto received = size_t{ 0 };
+
+        // First pass sends, the next ones see the datagram waiting and do not sleep the full wait
+        for (auto i = 0; i < 3 && received == 0; ++i) {
+            received += reactor.run_once(std::chrono::seconds(5));
+        }
+
+        REQUIRE_EQ(received, 1);
+        REQUIRE_EQ(unknown_count, 0);
+        REQUIRE_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    }
+}
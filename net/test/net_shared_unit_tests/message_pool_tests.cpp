@@ -0,0 +1,102 @@
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/connection.h"
+#include "ducklib/net/message_pool.h"
+
+using namespace ducklib;
+
+TEST_SUITE("message_pool") {
+    TEST_CASE("Acquire_PicksSmallestFittingClass") {
+        net::MessagePool pool(4);
+
+        auto tiny = pool.acquire(1);
+        auto exact = pool.acquire(64);
+        auto between = pool.acquire(65);
+        auto largest = pool.acquire(net::MTU);
+
+        REQUIRE_EQ(tiny.capacity(), 16);
+        REQUIRE_EQ(exact.capacity(), 64);
+        REQUIRE_EQ(between.capacity(), 128);
+        REQUIRE_EQ(largest.capacity(), net::MTU);
+        REQUIRE_EQ(pool.oversize_count(), 0);
+    }
+
+    TEST_CASE("Release_ReusesBlockWithoutGrowing") {
+        net::MessagePool pool(2);
+        std::byte* first_block = nullptr;
+
+        {
+            auto buffer = pool.acquire(100);
+            first_block = buffer.data();
+        }
+
+        auto buffer = pool.acquire(100);
+        auto& stats = pool.stats()[3];
+
+        REQUIRE_EQ(buffer.data(), first_block);
+        REQUIRE_EQ(stats.block_size, 128);
+        REQUIRE_EQ(stats.capacity, 2);
+        REQUIRE_EQ(stats.in_use, 1);
+        REQUIRE_EQ(stats.acquires, 2);
+        REQUIRE_EQ(stats.misses, 1);
+    }
+
+    TEST_CASE("Acquire_PastSlab_AllocatesAnother") {
+        net::MessagePool pool(2);
+        std::vector<net::MessageBuffer> buffers;
+
+        for (auto i = 0; i < 5; ++i) {
+            buffers.push_back(pool.acquire(16));
+            buffers.back().data()[15] = static_cast<std::byte>(i);
+        }
+
+        auto& stats = pool.stats()[0];
+        REQUIRE_EQ(stats.capacity, 6);
+        REQUIRE_EQ(stats.misses, 3);
+        REQUIRE_EQ(stats.peak_in_use, 5);
+        REQUIRE_EQ(pool.reserved_bytes(), 6 * 16);
+
+        // Blocks never overlap, each still holds what was written to it
+        for (auto i = 0; i < 5; ++i) {
+            REQUIRE_EQ(buffers[i].data()[15], static_cast<std::byte>(i));
+        }
+
+        buffers.clear();
+        REQUIRE_EQ(pool.stats()[0].in_use, 0);
+    }
+
+    TEST_CASE("Acquire_Oversize_FallsBackToHeap") {
+        net::MessagePool pool;
+
+        {
+            auto buffer = pool.acquire(net::MTU + 1);
+            REQUIRE(buffer);
+            REQUIRE_EQ(buffer.capacity(), net::MTU + 1);
+        }
+
+        REQUIRE_EQ(pool.oversize_count(), 1);
+        REQUIRE_EQ(pool.reserved_bytes(), 0);
+    }
+
+    TEST_CASE("Connection_SendReliable_AllocatesNothingOnceWarm") {
+        net::Socket receiver(0);
+        net::Connection connection("127.0.0.1", receiver.get_port());
+        auto pool = std::make_shared<net::MessagePool>(8);
+        std::array<std::byte, 40> message = {};
+
+        connection.set_message_pool(pool);
+
+        for (auto round = 0; round < 10; ++round) {
+            for (auto i = 0; i < 8; ++i) {
+                connection.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+            }
+
+            connection.send_message_packet();
+        }
+
+        auto& stats = pool->stats()[2];
+        REQUIRE_EQ(stats.acquires, 80);
+        REQUIRE_EQ(stats.misses, 1);
+        REQUIRE_EQ(stats.in_use, 0);
+    }
+}
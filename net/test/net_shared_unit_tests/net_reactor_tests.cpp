@@ -0,0 +1,164 @@
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/link_conditioner.h"
+#include "ducklib/net/net_reactor.h"
+
+using namespace ducklib;
+
+namespace {
+/// Loopback delivery is not guaranteed to be instant, runs the reactor a few times before giving up
+size_t run_until_received(net::NetReactor& reactor, size_t expected) {
+    auto received = size_t{ 0 };
+
+    for (auto i = 0; i < 20 && received < expected; ++i) {
+        received += reactor.run_once(std::chrono::milliseconds(50));
+    }
+
+    return received;
+}
+}
+
+TEST_SUITE("net_reactor") {
+    TEST_CASE("RunOnce_UnknownSender_GoesToCallback") {
+        auto socket = std::make_shared<net::Socket>(0);
+        net::Socket sender(0);
+        net::NetReactor reactor;
+        std::vector<std::byte> received_data;
+        net::Address received_from;
+        net::ReceiveTime received_time;
+        std::array<std::byte, 5> payload = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 }, std::byte{ 5 } };
+
+        REQUIRE(reactor.add_transport(socket));
+        reactor.set_unknown_sender_callback(
+            [&](const std::shared_ptr<net::Transport>& from_transport,
+                const net::Address& from,
+                std::span<const std::byte> data,
+                net::ReceiveTime received_at) {
+                REQUIRE_EQ(from_transport, socket);
+                received_from = from;
+                received_data.assign(data.begin(), data.end());
+                received_time = received_at;
+            });
+
+        auto sent_at = std::chrono::steady_clock::now();
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", socket->get_port()), payload), payload.size());
+        REQUIRE_EQ(run_until_received(reactor, 1), 1);
+        REQUIRE_GE(received_time, sent_at);
+        REQUIRE_LE(received_time, std::chrono::steady_clock::now());
+        REQUIRE_EQ(received_from.get_port(), sender.get_port());
+        REQUIRE_EQ(received_data.size(), payload.size());
+        REQUIRE(std::equal(payload.begin(), payload.end(), received_data.begin()));
+    }
+
+    TEST_CASE("RunOnce_RegisteredConnection_DoesNotReachCallback") {
+        auto socket = std::make_shared<net::Socket>(0);
+        net::Socket sender(0);
+        net::Connection connection("127.0.0.1", sender.get_port(), socket);
+        net::NetReactor reactor;
+        auto unknown_count = 0;
+        std::array<std::byte, 8> payload = {};
+
+        REQUIRE(reactor.add_connection(connection));
+        REQUIRE_FALSE(reactor.add_connection(connection));
+        REQUIRE_EQ(reactor.transport_count(), 1);
+        reactor.set_unknown_sender_callback(
+            [&](const std::shared_ptr<net::Transport>&, const net::Address&, std::span<const std::byte>, net::ReceiveTime) { ++unknown_count; });
+
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", socket->get_port()), payload), payload.size());
+        REQUIRE_EQ(run_until_received(reactor, 1), 1);
+        REQUIRE_EQ(unknown_count, 0);
+
+        reactor.remove_connection(connection);
+        REQUIRE_EQ(reactor.connection_count(), 0);
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", socket->get_port()), payload), payload.size());
+        REQUIRE_EQ(run_until_received(reactor, 1), 1);
+        REQUIRE_EQ(unknown_count, 1);
+    }
+
+    TEST_CASE("RunOnce_QueuedMessages_AreSentWhenDue") {
+        net::Socket receiver(0);
+        net::Connection connection("127.0.0.1", receiver.get_port());
+        net::NetReactor reactor;
+        std::array<std::byte, 4> message = { std::byte{ 0xde }, std::byte{ 0xad }, std::byte{ 0xbe }, std::byte{ 0xef } };
+        std::array<std::byte, net::MTU> buffer = {};
+        net::Address from;
+
+        REQUIRE(reactor.add_connection(connection));
+        connection.set_send_interval(std::chrono::milliseconds(20));
+        connection.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        REQUIRE(connection.has_pending_sends());
+
+        // The first packet is due straight away, so the wait must not last the whole max_wait
+        auto start = std::chrono::steady_clock::now();
+        reactor.run_once(std::chrono::seconds(5));
+        REQUIRE_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+        REQUIRE_FALSE(connection.has_pending_sends());
+
+        auto received_bytes = size_t{ 0 };
+        for (auto polls = 0; polls < 100000 && received_bytes == 0; ++polls) {
+            received_bytes = receiver.receive(from, buffer);
+        }
+        REQUIRE_GT(received_bytes, 0);
+        REQUIRE_EQ(from.get_port(), connection.get_transport()->get_port());
+
+        // The next one waits for the send interval, and the reactor wakes up for it
+        connection.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < 10 && connection.has_pending_sends(); ++i) {
+            reactor.run_once(std::chrono::seconds(5));
+        }
+        REQUIRE_FALSE(connection.has_pending_sends());
+        REQUIRE_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    }
+
+    TEST_CASE("RemoveTransport_FromCallback_StopsDispatch") {
+        auto socket = std::make_shared<net::Socket>(0);
+        net::Socket sender(0);
+        net::NetReactor reactor;
+        auto calls = 0;
+        std::array<std::byte, 8> payload = {};
+
+        REQUIRE(reactor.add_transport(socket));
+        reactor.set_unknown_sender_callback(
+            [&](const std::shared_ptr<net::Transport>& from_transport, const net::Address&, std::span<const std::byte>, net::ReceiveTime) {
+                ++calls;
+                reactor.remove_transport(*from_transport);
+            });
+
+        auto to = net::Address("127.0.0.1", socket->get_port());
+        REQUIRE_EQ(sender.send(to, payload), payload.size());
+        REQUIRE_EQ(sender.send(to, payload), payload.size());
+        run_until_received(reactor, 1);
+        REQUIRE_EQ(calls, 1);
+        REQUIRE_EQ(reactor.transport_count(), 0);
+    }
+
+    TEST_CASE("RunOnce_DelayedTransport_WakesWhenDue") {
+        auto socket = std::make_shared<net::Socket>(0);
+        auto link = std::make_shared<net::LinkConditioner>(
+            socket, net::LinkConditionerConfig{ .receive = { .latency = std::chrono::milliseconds(30) } });
+        net::Socket sender(0);
+        net::NetReactor reactor;
+        auto received = size_t{ 0 };
+        std::array<std::byte, 8> payload = {};
+
+        REQUIRE(reactor.add_transport(link));
+        reactor.set_unknown_sender_callback(
+            [&](const std::shared_ptr<net::Transport>&, const net::Address&, std::span<const std::byte>, net::ReceiveTime) { ++received; });
+
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", socket->get_port()), payload), payload.size());
+
+        // The socket wakes the reactor, the link holds the packet and wakes it again once the latency has passed
+        for (auto i = 0; i < 10 && received == 0; ++i) {
+            reactor.run_once(std::chrono::seconds(5));
+        }
+
+        REQUIRE_EQ(received, 1);
+        REQUIRE_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(30));
+        REQUIRE_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    }
+}
@@ -0,0 +1,92 @@
+#include <array>
+#include "third_party/doctest.h"
+#include "ducklib/net/packet_buffer.h"
+#include "ducklib/net/serialization.h"
+
+using namespace ducklib;
+
+TEST_SUITE("packet_buffer") {
+    TEST_CASE("PacketBufferPool_AcquireUntilExhausted") {
+        net::PacketBufferPool pool(2, 64);
+
+        {
+            auto first = pool.acquire();
+            auto second = pool.acquire();
+            auto third = pool.acquire();
+
+            REQUIRE(first);
+            REQUIRE(second);
+            REQUIRE_FALSE(third);
+            REQUIRE_EQ(pool.available(), 0);
+            REQUIRE_EQ(first.storage().size(), 64);
+            REQUIRE_NE(first.storage().data(), second.storage().data());
+        }
+
+        REQUIRE_EQ(pool.available(), 2);
+
+        auto stats = pool.stats();
+        REQUIRE_EQ(stats.capacity, 2);
+        REQUIRE_EQ(stats.in_use, 0);
+        REQUIRE_EQ(stats.peak_in_use, 2);
+        REQUIRE_EQ(stats.acquires, 3);
+        REQUIRE_EQ(stats.misses, 1);
+    }
+
+    TEST_CASE("PacketView_KeepsBufferAlive") {
+        net::PacketBufferPool pool(1, 64);
+        net::PacketView view;
+
+        {
+            auto packet = pool.acquire();
+            packet.set_size(16);
+            view = packet.view(packet.data().subspan(4, 8));
+
+            REQUIRE_EQ(packet.use_count(), 2);
+        }
+
+        REQUIRE_EQ(view.packet.use_count(), 1);
+        REQUIRE_EQ(pool.available(), 0);
+
+        view = {};
+        REQUIRE_EQ(pool.available(), 1);
+    }
+
+    TEST_CASE("SerializeDataView_PointsIntoPacket") {
+        net::PacketBufferPool pool(1, 64);
+        std::array<std::byte, 5> payload = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 }, std::byte{ 5 } };
+        net::PacketView view;
+
+        {
+            auto packet = pool.acquire();
+            auto writer = net::NetWriteStream(packet.storage());
+            uint32_t header = 0x5;
+            REQUIRE(writer.serialize_value(header, 3));
+            REQUIRE(net::serialize_aligned_data(writer, payload.data(), static_cast<uint16_t>(payload.size())));
+            REQUIRE(writer.flush_scratch());
+            packet.set_size(writer.bits_written / 8);
+
+            auto reader = net::NetReadStream(packet.data().data(), packet.size() * 8);
+            uint32_t read_header = 0;
+            REQUIRE(reader.serialize_value(read_header, 3));
+            REQUIRE(net::serialize_data_view(reader, packet, view, static_cast<uint16_t>(payload.size())));
+            REQUIRE_EQ(read_header, header);
+            REQUIRE_EQ(view.bytes.data(), packet.data().data() + 1);
+        }
+
+        REQUIRE_EQ(view.bytes.size(), payload.size());
+        REQUIRE(std::ranges::equal(view.bytes, payload));
+    }
+
+    TEST_CASE("SerializeView_FailsWhenMisaligned") {
+        std::array<std::byte, 8> buffer = {};
+        auto reader = net::NetReadStream(buffer.data(), 64);
+        std::span<const std::byte> view;
+        uint32_t value;
+
+        REQUIRE(reader.serialize_value(value, 3));
+        REQUIRE_FALSE(reader.serialize_view(view, 2));
+        reader.align_to_byte();
+        REQUIRE(reader.serialize_view(view, 2));
+        REQUIRE_FALSE(reader.serialize_view(view, 6));
+    }
+}
@@ -0,0 +1,70 @@
+#include <array>
+#include <random>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/crc32c.h"
+#include "ducklib/net/packet.h"
+
+using namespace ducklib;
+
+TEST_SUITE("packet") {
+    TEST_CASE("Crc32c_KnownValues") {
+        const char check[] = "123456789";
+        auto check_bytes = std::as_bytes(std::span(check, 9));
+        std::array<std::byte, 32> zeros = {};
+
+        REQUIRE_EQ(net::crc32c(check_bytes), 0xe3069283);
+        REQUIRE_EQ(net::crc32c_software(check_bytes), 0xe3069283);
+        REQUIRE_EQ(net::crc32c(zeros), 0x8a9136aa);
+        REQUIRE_EQ(net::crc32c({}), 0);
+    }
+
+    TEST_CASE("Crc32c_HardwareMatchesSoftware") {
+        std::mt19937 rng(9);
+        std::vector<std::byte> data(1200);
+        for (auto& b : data) {
+            b = static_cast<std::byte>(rng());
+        }
+
+        for (auto offset : { 0U, 1U, 3U, 7U }) {
+            for (auto size : { 0U, 1U, 7U, 8U, 9U, 63U, 64U, 1000U }) {
+                CAPTURE(offset);
+                CAPTURE(size);
+                auto span = std::span(data).subspan(offset, size);
+                auto split = size / 3;
+
+                REQUIRE_EQ(net::crc32c(span), net::crc32c_software(span));
+                REQUIRE_EQ(net::crc32c(span.subspan(split), net::crc32c(span.first(split))), net::crc32c(span));
+            }
+        }
+    }
+
+    TEST_CASE("PacketCrc_RejectsCorruptedAndForeignPackets") {
+        std::array<std::byte, 64> packet = {};
+        for (auto i = 0U; i < packet.size(); ++i) {
+            packet[i] = static_cast<std::byte>(i * 7);
+        }
+
+        net::write_packet_crc(packet, net::DEFAULT_PROTOCOL_ID);
+        REQUIRE(net::check_packet_crc(packet, net::DEFAULT_PROTOCOL_ID));
+        REQUIRE_FALSE(net::check_packet_crc(packet, net::DEFAULT_PROTOCOL_ID + 1));
+        REQUIRE_FALSE(net::check_packet_crc(std::span(packet).first(net::PACKET_CRC_SIZE - 1), net::DEFAULT_PROTOCOL_ID));
+        REQUIRE_FALSE(net::check_packet_crc(std::span(packet).first(packet.size() - 1), net::DEFAULT_PROTOCOL_ID));
+
+        for (auto bit = 0U; bit < packet.size() * 8; ++bit) {
+            CAPTURE(bit);
+            packet[bit / 8] ^= static_cast<std::byte>(1 << (bit % 8));
+            REQUIRE_FALSE(net::check_packet_crc(packet, net::DEFAULT_PROTOCOL_ID));
+            packet[bit / 8] ^= static_cast<std::byte>(1 << (bit % 8));
+        }
+    }
+
+    TEST_CASE("PacketCrc_EmptyPayload") {
+        std::array<std::byte, net::PACKET_CRC_SIZE> packet = {};
+
+        net::write_packet_crc(packet, 1234);
+        REQUIRE(net::check_packet_crc(packet, 1234));
+        REQUIRE(net::packet_payload(packet).empty());
+        REQUIRE_FALSE(net::check_packet_crc(packet, 4321));
+    }
+}
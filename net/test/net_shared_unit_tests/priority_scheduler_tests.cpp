@@ -0,0 +1,124 @@
+#include <memory>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/priority_scheduler.h"
+
+using namespace ducklib;
+
+namespace {
+using Scheduler = net::PriorityScheduler<int, 3>;
+
+/// Takes the next item, -1 if there is none
+int take(Scheduler& scheduler, Scheduler::Tick now) {
+    uint32_t level = 0;
+
+    if (!scheduler.next_level(now, level)) {
+        return -1;
+    }
+
+    auto item = scheduler.front(level);
+    scheduler.pop(level);
+    return item;
+}
+}
+
+TEST_SUITE("priority_scheduler") {
+    TEST_CASE("NextLevel_SameAge_HigherLevelFirst") {
+        Scheduler scheduler({ 1, 4, 16 }, 1000);
+
+        scheduler.push(0, 0, 0);
+        scheduler.push(1, 1, 0);
+        scheduler.push(2, 2, 0);
+        scheduler.push(3, 7, 0);
+        REQUIRE_EQ(scheduler.size(), 4);
+
+        REQUIRE_EQ(take(scheduler, 0), 2);
+        REQUIRE_EQ(take(scheduler, 0), 3);
+        REQUIRE_EQ(take(scheduler, 0), 1);
+        REQUIRE_EQ(take(scheduler, 0), 0);
+        REQUIRE_EQ(take(scheduler, 0), -1);
+        REQUIRE(scheduler.empty());
+    }
+
+    TEST_CASE("NextLevel_OneLevel_FirstInFirstOut") {
+        Scheduler scheduler({ 1, 4, 16 }, 1000);
+
+        // Past the initial ring capacity, so growing has to keep the order across the wrap
+        for (auto i = 0; i < 10; ++i) {
+            scheduler.push(i, 1, 0);
+        }
+
+        for (auto i = 0; i < 5; ++i) {
+            REQUIRE_EQ(take(scheduler, 0), i);
+        }
+
+        for (auto i = 10; i < 40; ++i) {
+            scheduler.push(i, 1, 0);
+        }
+
+        for (auto i = 5; i < 40; ++i) {
+            REQUIRE_EQ(take(scheduler, 0), i);
+        }
+    }
+
+    TEST_CASE("NextLevel_UnderLoad_LowLevelNotStarved") {
+        Scheduler scheduler({ 1, 4, 16 }, 1000);
+        auto low_taken_at = -1;
+
+        scheduler.push(-2, 0, 0);
+
+        // A new high level item every tick and one item taken a tick
+        for (auto tick = 0U; tick < 100 && low_taken_at < 0; ++tick) {
+            scheduler.push(static_cast<int>(tick), 2, tick);
+
+            if (take(scheduler, tick) == -2) {
+                low_taken_at = static_cast<int>(tick);
+            }
+        }
+
+        // Overtaken by the items queued since, until it has accumulated more than a fresh high one
+        REQUIRE_EQ(low_taken_at, 16);
+    }
+
+    TEST_CASE("NextLevel_Overloaded_OverdueGoesFirst") {
+        Scheduler scheduler({ 1, 4, 16 }, 8);
+        auto low_taken_at = -1;
+
+        scheduler.push(-2, 0, 0);
+
+        // Twice as many high level items queued as taken, their backlog ages too and would keep overtaking
+        for (auto tick = 0U; tick < 100 && low_taken_at < 0; ++tick) {
+            scheduler.push(static_cast<int>(tick), 2, tick);
+            scheduler.push(static_cast<int>(tick), 2, tick);
+
+            if (take(scheduler, tick) == -2) {
+                low_taken_at = static_cast<int>(tick);
+            }
+        }
+
+        REQUIRE_EQ(low_taken_at, 8);
+    }
+
+    TEST_CASE("NextLevel_Skipped_LeftOut") {
+        Scheduler scheduler({ 1, 4, 16 }, 1000);
+        uint32_t level = 0;
+
+        scheduler.push(0, 0, 0);
+        scheduler.push(2, 2, 0);
+        REQUIRE(scheduler.next_level(0, level, 1U << 2));
+        REQUIRE_EQ(level, 0);
+        REQUIRE_FALSE(scheduler.next_level(0, level, 1U << 2 | 1U << 0));
+    }
+
+    TEST_CASE("Pop_ReleasesItem") {
+        net::PriorityScheduler<std::shared_ptr<int>, 2> scheduler({ 1, 2 }, 1000);
+        auto item = std::make_shared<int>(1);
+        uint32_t level = 0;
+
+        scheduler.push(item, 1, 0);
+        REQUIRE_EQ(item.use_count(), 2);
+        REQUIRE(scheduler.next_level(0, level));
+        scheduler.pop(level);
+        REQUIRE_EQ(item.use_count(), 1);
+    }
+}
@@ -0,0 +1,152 @@
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/range_coder.h"
+#include "ducklib/net/schema.h"
+
+using namespace ducklib;
+
+namespace {
+struct LobbyMember {
+    uint16_t player_id;
+    uint8_t team;
+    bool ready;
+    uint32_t score;
+    float rating;
+
+    using Schema = net::MessageSchema<
+        net::BoundedIntField<&LobbyMember::player_id, uint16_t{ 0 }, uint16_t{ 4095 }>,
+        net::BoundedIntField<&LobbyMember::team, uint8_t{ 0 }, uint8_t{ 3 }>,
+        net::BoolField<&LobbyMember::ready>,
+        net::IntField<&LobbyMember::score>,
+        net::QuantizedFloatField<&LobbyMember::rating, 0.0f, 4000.0f, 1.0f>>;
+};
+
+LobbyMember make_member(std::mt19937& rng) {
+    // Skewed like real lobby state: few teams used, most players ready, small scores
+    return {
+        static_cast<uint16_t>(rng() % 64),
+        static_cast<uint8_t>(rng() % 4 == 0 ? 1 : 0),
+        rng() % 8 != 0,
+        static_cast<uint32_t>(rng() % 16 == 0 ? rng() % 100000 : rng() % 200),
+        static_cast<float>(1000 + rng() % 500)
+    };
+}
+}
+
+TEST_SUITE("range_coder") {
+    TEST_CASE("RangeCoder_SchemaRoundTripWithSharedModels") {
+        auto writer_models = std::make_unique<net::RangeCoderModels>();
+        auto reader_models = std::make_unique<net::RangeCoderModels>();
+        std::mt19937 rng(3);
+
+        for (auto i = 0; i < 200; ++i) {
+            CAPTURE(i);
+            auto member = make_member(rng);
+            std::byte buffer[64] = {};
+
+            auto writer = net::NetRangeWriteStream(buffer, *writer_models);
+            REQUIRE(net::serialize_message(writer, member));
+            REQUIRE(writer.flush_scratch());
+
+            auto reader = net::NetRangeReadStream(buffer, writer.bits_written, *reader_models);
+            LobbyMember read_member = {};
+            REQUIRE(net::serialize_message(reader, read_member));
+            REQUIRE_EQ(read_member.player_id, member.player_id);
+            REQUIRE_EQ(read_member.team, member.team);
+            REQUIRE_EQ(read_member.ready, member.ready);
+            REQUIRE_EQ(read_member.score, member.score);
+            REQUIRE_EQ(read_member.rating, net::quantize_float(member.rating, 0.0f, 4000.0f, 1.0f));
+        }
+    }
+
+    TEST_CASE("RangeCoder_SkewedValuesCompress") {
+        auto models = std::make_unique<net::RangeCoderModels>();
+        std::mt19937 rng(5);
+        auto packed_bits = 0U;
+        auto range_bits = 0U;
+
+        // One stream per message like Connection::send_reliable, the models carry over between them
+        for (auto i = 0; i < 300; ++i) {
+            auto member = make_member(rng);
+            std::byte packed_buffer[64] = {};
+            std::byte range_buffer[64] = {};
+            auto packed_writer = net::NetWriteStream(packed_buffer);
+            auto range_writer = net::NetRangeWriteStream(range_buffer, *models);
+
+            REQUIRE(net::serialize_message(packed_writer, member));
+            REQUIRE(net::serialize_message(range_writer, member));
+            REQUIRE(range_writer.flush_scratch());
+            packed_bits += sizeof(packed_buffer) * 8 - packed_writer.bits_left();
+            range_bits += range_writer.bits_written;
+        }
+
+        REQUIRE(range_bits < packed_bits * 7 / 10);
+    }
+
+    TEST_CASE("RangeCoder_DataAndArrays") {
+        auto writer_models = std::make_unique<net::RangeCoderModels>();
+        auto reader_models = std::make_unique<net::RangeCoderModels>();
+        std::byte data[13] = {};
+        for (auto i = 0U; i < sizeof(data); ++i) {
+            data[i] = static_cast<std::byte>(i * 31);
+        }
+        std::vector<uint16_t> values = { 0, 1, 2, 500, 1000, 3, 3, 3 };
+        int64_t wide = -(int64_t{ 1 } << 50);
+        std::byte buffer[128] = {};
+
+        auto writer = net::NetRangeWriteStream(buffer, *writer_models);
+        REQUIRE(net::serialize_data(writer, data, 101));
+        REQUIRE(net::serialize_int_array(writer, std::span(values), uint16_t{ 0 }, uint16_t{ 1000 }));
+        REQUIRE(net::serialize_int(writer, wide));
+        REQUIRE(writer.flush_scratch());
+
+        auto reader = net::NetRangeReadStream(buffer, writer.bits_written, *reader_models);
+        std::byte read_data[13] = {};
+        std::vector<uint16_t> read_values(values.size());
+        int64_t read_wide = 0;
+        REQUIRE(net::serialize_data(reader, read_data, 101));
+        REQUIRE(net::serialize_int_array(reader, std::span(read_values), uint16_t{ 0 }, uint16_t{ 1000 }));
+        REQUIRE(net::serialize_int(reader, read_wide));
+        REQUIRE(memcmp(read_data, data, 12) == 0);
+        REQUIRE_EQ(read_data[12], data[12] & std::byte{ 0x1f });
+        REQUIRE(read_values == values);
+        REQUIRE_EQ(read_wide, wide);
+    }
+
+    TEST_CASE("RangeCoder_FailsOnOverflow") {
+        auto models = std::make_unique<net::RangeCoderModels>();
+        std::byte data[64] = {};
+        for (auto i = 0U; i < sizeof(data); ++i) {
+            data[i] = static_cast<std::byte>(i * 97 + 13);
+        }
+
+        std::byte small_buffer[16] = {};
+        auto small_writer = net::NetRangeWriteStream(small_buffer, *models);
+        REQUIRE_FALSE(net::serialize_data(small_writer, data, sizeof(data) * 8));
+        REQUIRE_EQ(small_writer.bits_left(), 0);
+    }
+
+    TEST_CASE("RangeCoder_EmptyAndTinyStreams") {
+        auto writer_models = std::make_unique<net::RangeCoderModels>();
+        auto reader_models = std::make_unique<net::RangeCoderModels>();
+        std::byte buffer[8] = {};
+
+        auto empty_writer = net::NetRangeWriteStream(buffer, *writer_models);
+        REQUIRE(empty_writer.flush_scratch());
+        REQUIRE_EQ(empty_writer.bits_written, 0);
+
+        auto writer = net::NetRangeWriteStream(buffer, *writer_models);
+        bool flag = false;
+        REQUIRE(net::serialize_bool(writer, flag));
+        REQUIRE(writer.flush_scratch());
+        REQUIRE(writer.bits_written <= 8);
+
+        auto reader = net::NetRangeReadStream(buffer, writer.bits_written, *reader_models);
+        bool read_flag = true;
+        REQUIRE(net::serialize_bool(reader, read_flag));
+        REQUIRE_FALSE(read_flag);
+    }
+}
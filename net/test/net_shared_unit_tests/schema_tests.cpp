@@ -0,0 +1,73 @@
+#include <array>
+#include "third_party/doctest.h"
+#include "ducklib/net/schema.h"
+
+using namespace ducklib;
+
+struct PlayerInput {
+    uint8_t buttons;
+    float yaw;
+    bool jumping;
+
+    using Schema = net::MessageSchema<
+        net::BoundedIntField<&PlayerInput::buttons, uint8_t{ 0 }, uint8_t{ 15 }>,
+        net::QuantizedFloatField<&PlayerInput::yaw, -180.0f, 180.0f, 0.1f>,
+        net::BoolField<&PlayerInput::jumping>>;
+};
+
+struct EntityUpdate {
+    uint32_t entity_id;
+    int16_t health_change;
+    ducklib::Vector3 position;
+    ducklib::Quaternion rotation;
+    PlayerInput input;
+    std::array<std::byte, 3> flags;
+
+    using Schema = net::MessageSchema<
+        net::IntField<&EntityUpdate::entity_id>,
+        net::VarintField<&EntityUpdate::health_change, 4>,
+        net::Vector3Field<&EntityUpdate::position, -512.0f, 512.0f, 0.01f>,
+        net::QuaternionField<&EntityUpdate::rotation, 9>,
+        net::MessageField<&EntityUpdate::input>,
+        net::BytesField<&EntityUpdate::flags>>;
+};
+
+static_assert(net::max_bit_size<PlayerInput>() == 4 + 12 + 1);
+static_assert(net::max_bit_size<EntityUpdate>() == 32 + 4 * 5 + 3 * 17 + 2 + 3 * 9 + 17 + 24);
+
+TEST_SUITE("schema") {
+    TEST_CASE("Schema_RoundTrip") {
+        EntityUpdate update = {
+            12345,
+            -20,
+            { 1.5f, -300.25f, 42.0f },
+            { 0.0f, 0.0f, 0.0f, 1.0f },
+            { 9, 90.0f, true },
+            { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 } }
+        };
+
+        std::array<std::byte, (net::max_bit_size<EntityUpdate>() + 7) / 8> buffer = {};
+        auto writer = net::NetWriteStream(buffer);
+        REQUIRE(net::serialize_message(writer, update));
+        auto written_bits = buffer.size() * 8 - writer.bits_left();
+        REQUIRE(written_bits <= net::max_bit_size<EntityUpdate>());
+        writer.flush_scratch();
+
+        auto measure = net::NetMeasureStream();
+        REQUIRE(net::serialize_message(measure, update));
+        REQUIRE_EQ(measure.bits_measured, written_bits);
+
+        auto reader = net::NetReadStream(buffer.data(), static_cast<uint32_t>(written_bits));
+        EntityUpdate read_update = {};
+        REQUIRE(net::serialize_message(reader, read_update));
+        REQUIRE_EQ(read_update.entity_id, update.entity_id);
+        REQUIRE_EQ(read_update.health_change, update.health_change);
+        REQUIRE_EQ(read_update.position.x, net::quantize_float(update.position.x, -512.0f, 512.0f, 0.01f));
+        REQUIRE_EQ(read_update.position.y, net::quantize_float(update.position.y, -512.0f, 512.0f, 0.01f));
+        REQUIRE_EQ(read_update.rotation.w, doctest::Approx(1.0f));
+        REQUIRE_EQ(read_update.input.buttons, update.input.buttons);
+        REQUIRE_EQ(read_update.input.yaw, net::quantize_float(update.input.yaw, -180.0f, 180.0f, 0.1f));
+        REQUIRE_EQ(read_update.input.jumping, update.input.jumping);
+        REQUIRE(read_update.flags == update.flags);
+    }
+}
@@ -0,0 +1,93 @@
+#include <cstdint>
+#include "third_party/doctest.h"
+#include "ducklib/net/sequence_buffer.h"
+
+using namespace ducklib;
+
+TEST_SUITE("sequence_buffer") {
+    TEST_CASE("SequenceGreaterThan_AcrossWraparound") {
+        REQUIRE(net::sequence_greater_than<uint16_t>(1, 0));
+        REQUIRE_FALSE(net::sequence_greater_than<uint16_t>(0, 1));
+        REQUIRE(net::sequence_greater_than<uint16_t>(0, 0xffff));
+        REQUIRE(net::sequence_greater_than<uint16_t>(10, 0xfff0));
+        REQUIRE(net::sequence_less_than<uint16_t>(0xfff0, 10));
+        REQUIRE(net::sequence_greater_than<uint32_t>(5, 0xfffffffb));
+        REQUIRE_FALSE(net::sequence_greater_than<uint32_t>(7, 7));
+    }
+
+    TEST_CASE("Insert_Find_OnlyExactSequence") {
+        net::SequenceBuffer<int, 8> buffer;
+
+        REQUIRE(buffer.empty());
+        REQUIRE_EQ(buffer.find(3), nullptr);
+
+        *buffer.insert(3) = 30;
+        REQUIRE_FALSE(buffer.empty());
+        REQUIRE_EQ(buffer.newest_sequence(), 3);
+        REQUIRE_EQ(*buffer.find(3), 30);
+        // Same slot, different sequence
+        REQUIRE_EQ(buffer.find(11), nullptr);
+
+        *buffer.insert(11) = 110;
+        REQUIRE_EQ(buffer.find(3), nullptr);
+        REQUIRE_EQ(*buffer.find(11), 110);
+
+        buffer.remove(11);
+        REQUIRE_FALSE(buffer.contains(11));
+    }
+
+    TEST_CASE("Insert_ResetsEntry") {
+        net::SequenceBuffer<int, 4> buffer;
+
+        *buffer.insert(1) = 5;
+        REQUIRE_EQ(*buffer.insert(1), 0);
+    }
+
+    TEST_CASE("Insert_TooOld_Refused") {
+        net::SequenceBuffer<int, 8> buffer;
+
+        REQUIRE(buffer.insert(20));
+        REQUIRE(buffer.insert(13));
+        REQUIRE_EQ(buffer.insert(12), nullptr);
+        REQUIRE_EQ(buffer.newest_sequence(), 20);
+        REQUIRE(buffer.contains(20));
+    }
+
+    TEST_CASE("Insert_JumpAhead_SkippedSlotsCleared") {
+        net::SequenceBuffer<int, 8> buffer;
+
+        REQUIRE(buffer.insert(0));
+        REQUIRE(buffer.insert(8 + 5));
+        REQUIRE_EQ(buffer.find(5), nullptr);
+        REQUIRE_EQ(buffer.find(0), nullptr);
+
+        // Only skipped slots are freed, what is still within the window stays
+        REQUIRE(buffer.insert(14));
+        REQUIRE(buffer.insert(17));
+        REQUIRE(buffer.contains(13));
+        REQUIRE(buffer.contains(14));
+
+        // A slot skipped on every lap would otherwise still hold its sequence once the sequences come back around
+        net::SequenceBuffer<int, 8, uint16_t> wrapping;
+        REQUIRE(wrapping.insert(3));
+        REQUIRE(wrapping.insert(0x4004));
+        REQUIRE(wrapping.insert(0x8004));
+        REQUIRE(wrapping.insert(0xc004));
+        REQUIRE(wrapping.insert(4));
+        REQUIRE_EQ(wrapping.find(3), nullptr);
+    }
+
+    TEST_CASE("Insert_AcrossWraparound_KeepsNewest") {
+        net::SequenceBuffer<int, 16, uint16_t> buffer;
+
+        for (auto sequence = uint16_t{ 0xfff8 }; sequence != 8; ++sequence) {
+            *buffer.insert(sequence) = sequence;
+        }
+
+        REQUIRE_EQ(buffer.newest_sequence(), 7);
+        REQUIRE_EQ(*buffer.find(0xfffa), 0xfffa);
+        REQUIRE_EQ(*buffer.find(7), 7);
+        REQUIRE_EQ(buffer.find(0xfff7), nullptr);
+        REQUIRE_EQ(buffer.insert(0xfff7), nullptr);
+    }
+}
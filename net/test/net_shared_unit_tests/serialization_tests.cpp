@@ -1,4 +1,6 @@
 #include <memory>
+#include <random>
+#include <vector>
 #include "third_party/doctest.h"
 #include "ducklib/net/shared.h"
 #include "ducklib/net/serialization.h"
@@ -11,6 +13,32 @@ void small_serialization(StreamT& stream, int& first, int& second) {
     net::serialize_int(stream, second, 60, 70);
 }
 
+bool get_bit(const std::byte* data, uint32_t bit_index) {
+    return (static_cast<uint8_t>(data[bit_index >> 3]) >> (bit_index & 0x7)) & 1;
+}
+
+void fill_random(std::span<std::byte> data, uint32_t seed) {
+    std::mt19937 rng(seed);
+
+    for (auto& b : data) {
+        b = static_cast<std::byte>(rng());
+    }
+}
+
+struct EntityState {
+    uint32_t health;
+    uint32_t ammo;
+    ducklib::Vector3 position;
+};
+
+template <typename StreamT>
+bool serialize_delta(StreamT& stream, EntityState& state, const EntityState& baseline) {
+    DL_NET_CHECK(net::serialize_int_relative(stream, state.health, baseline.health, 0U, 100U));
+    DL_NET_CHECK(net::serialize_int_relative(stream, state.ammo, baseline.ammo, 0U, 255U));
+    DL_NET_CHECK(net::serialize_vector3_relative(stream, state.position, baseline.position, -256.0f, 256.0f, 0.125f));
+    return true;
+}
+
 TEST_SUITE("serialization") {
     TEST_CASE("SmallSerialization_WithinScratchSize") {
         auto buffer_size = 128;
@@ -160,6 +188,7 @@ TEST_SUITE("serialization") {
         auto x = 4U;    
         REQUIRE(block_writer.serialize_value(x, 3));
         REQUIRE(block_writer.serialize_data(value_writer.buffer.data(), main_bit_size));
+        REQUIRE(block_writer.flush_scratch());
     
         auto block_dest_buffer = std::make_unique<std::byte[]>(buffer_size);
         auto block_reader = net::NetReadStream({ block_writer.buffer.data(), main_bit_size + 3 });
@@ -215,4 +244,381 @@ TEST_SUITE("serialization") {
         REQUIRE_EQ(reinterpret_cast<uint64_t*>(block_buffer.get())[0], data[0]);
         REQUIRE_EQ(reinterpret_cast<uint64_t*>(block_buffer.get())[1], data[1]);
     }
-}
\ No newline at end of file
+
+    TEST_CASE("SerializeData_MatchesBitOrder_ForAllOffsets") {
+        constexpr uint32_t data_bit_sizes[] = { 1, 7, 8, 9, 31, 56, 57, 63, 64, 65, 120, 127, 128, 129, 1000, 4003 };
+        constexpr auto buffer_size = 1024;
+
+        for (auto offset = 0U; offset < 8; ++offset) {
+            for (auto data_bit_size : data_bit_sizes) {
+                CAPTURE(offset);
+                CAPTURE(data_bit_size);
+                std::vector<std::byte> source((data_bit_size + 7) / 8);
+                fill_random(source, offset * 10000 + data_bit_size);
+
+                std::vector<std::byte> buffer(buffer_size);
+                auto writer = net::NetWriteStream(buffer);
+                auto prefix = 0x55U;
+                if (offset > 0) {
+                    REQUIRE(writer.serialize_value(prefix, static_cast<uint8_t>(offset)));
+                }
+                REQUIRE(writer.serialize_data(source.data(), data_bit_size));
+                auto suffix = 0x2DU;
+                REQUIRE(writer.serialize_value(suffix, 6));
+                REQUIRE_EQ(writer.bits_left(), buffer_size * 8 - offset - data_bit_size - 6);
+                REQUIRE(writer.flush_scratch());
+
+                for (auto i = 0U; i < data_bit_size; ++i) {
+                    REQUIRE_EQ(get_bit(buffer.data(), offset + i), get_bit(source.data(), i));
+                }
+
+                auto reader = net::NetReadStream(buffer.data(), offset + data_bit_size + 6);
+                std::vector<std::byte> result(source.size());
+                auto read_prefix = 0U;
+                if (offset > 0) {
+                    REQUIRE(reader.serialize_value(read_prefix, static_cast<uint8_t>(offset)));
+                    REQUIRE_EQ(read_prefix, prefix & ((1U << offset) - 1));
+                }
+                REQUIRE(reader.serialize_data(result.data(), static_cast<uint16_t>(data_bit_size)));
+                auto read_suffix = 0U;
+                REQUIRE(reader.serialize_value(read_suffix, 6));
+                REQUIRE_EQ(read_suffix, suffix);
+                REQUIRE_EQ(reader.bits_left(), 0);
+
+                for (auto i = 0U; i < data_bit_size; ++i) {
+                    REQUIRE_EQ(get_bit(result.data(), i), get_bit(source.data(), i));
+                }
+            }
+        }
+    }
+
+    TEST_CASE("SerializeData_FailsWhenBufferTooSmall") {
+        std::byte source[16] = {};
+        std::byte buffer[8] = {};
+        auto writer = net::NetWriteStream(buffer);
+        auto prefix = 1U;
+
+        REQUIRE(writer.serialize_value(prefix, 3));
+        REQUIRE_FALSE(writer.serialize_data(source, 62));
+        REQUIRE(writer.serialize_data(source, 61));
+    }
+
+    TEST_CASE("SerializeValue_NegativeValueSpillingScratch") {
+        std::byte buffer[16] = {};
+        auto writer = net::NetWriteStream(buffer);
+        auto prefix = 0x1fU;
+        int32_t value = -2;
+        auto suffix = 0x5U;
+
+        REQUIRE(writer.serialize_value(prefix, 40));
+        REQUIRE(net::serialize_int(writer, value));
+        REQUIRE(writer.serialize_value(suffix, 3));
+        REQUIRE(writer.flush_scratch());
+
+        auto reader = net::NetReadStream(buffer, 75);
+        auto read_prefix = 0U;
+        int32_t read_value = 0;
+        auto read_suffix = 0U;
+        REQUIRE(reader.serialize_value(read_prefix, 40));
+        REQUIRE(net::serialize_int(reader, read_value));
+        REQUIRE(reader.serialize_value(read_suffix, 3));
+        REQUIRE_EQ(read_prefix, prefix);
+        REQUIRE_EQ(read_value, value);
+        REQUIRE_EQ(read_suffix, suffix);
+    }
+
+    TEST_CASE("ReadStream_FailsPastEndOfPacket") {
+        std::byte buffer[2] = { std::byte{ 0xff }, std::byte{ 0x0f } };
+        auto reader = net::NetReadStream(buffer, 13);
+        auto value = 0U;
+        std::byte data[1] = {};
+
+        REQUIRE(reader.serialize_value(value, 10));
+        REQUIRE_FALSE(reader.serialize_value(value, 4));
+        reader.align_to_byte();
+        REQUIRE_EQ(reader.bits_left(), 0);
+        REQUIRE_FALSE(reader.serialize_data(data, 1));
+    }
+
+    TEST_CASE("MeasureStream_MatchesWrittenBits") {
+        auto buffer_size = 128;
+        auto buffer = std::make_unique<std::byte[]>(buffer_size);
+        auto writer = net::NetWriteStream({ buffer.get(), static_cast<size_t>(buffer_size) });
+        auto measure = net::NetMeasureStream();
+        std::byte data[12] = {};
+        auto first = 33;
+        auto second = 66;
+
+        small_serialization(writer, first, second);
+        REQUIRE(net::serialize_data(writer, data, 91));
+        small_serialization(measure, first, second);
+        REQUIRE(net::serialize_data(measure, data, 91));
+
+        REQUIRE_EQ(measure.bits_measured, buffer_size * 8U - writer.bits_left());
+    }
+
+    TEST_CASE("MeasureStream_CountsWorstCaseAlignment") {
+        auto measure = net::NetMeasureStream();
+        uint8_t val = 0x7;
+
+        REQUIRE(measure.serialize_value(val, 3));
+        measure.align_to_byte();
+        REQUIRE_EQ(measure.bits_measured, 10);
+    }
+
+    TEST_CASE("MeasureStream_FailsOverBudget") {
+        auto measure = net::NetMeasureStream(40);
+        uint32_t val = 0;
+
+        REQUIRE(measure.serialize_value(val, 32));
+        REQUIRE_EQ(measure.bits_left(), 8);
+        REQUIRE_FALSE(measure.serialize_value(val, 9));
+        REQUIRE(measure.serialize_value(val, 8));
+        REQUIRE_EQ(measure.bits_left(), 0);
+    }
+
+    TEST_CASE("QuantizedFloat_RoundTrip") {
+        std::byte buffer[64] = {};
+        auto writer = net::NetWriteStream(buffer);
+        float values[] = { -512.0f, -0.37f, 0.0f, 13.21f, 511.99f, 512.0f };
+
+        for (auto value : values) {
+            REQUIRE(net::serialize_float(writer, value, -512.0f, 512.0f, 0.01f));
+        }
+        writer.flush_scratch();
+
+        auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+        for (auto value : values) {
+            auto read_value = 0.0f;
+            REQUIRE(net::serialize_float(reader, read_value, -512.0f, 512.0f, 0.01f));
+            REQUIRE_EQ(read_value, net::quantize_float(value, -512.0f, 512.0f, 0.01f));
+            REQUIRE(std::abs(read_value - value) <= 0.005f + 1e-4f);
+        }
+    }
+
+    TEST_CASE("QuantizedVector3_UsesBoundedBits") {
+        std::byte buffer[16] = {};
+        auto writer = net::NetWriteStream(buffer);
+        auto measure = net::NetMeasureStream();
+        ducklib::Vector3 position = { 100.25f, -3.5f, 250.0f };
+
+        REQUIRE(net::serialize_vector3(writer, position, -256.0f, 256.0f, 1.0f / 32.0f));
+        REQUIRE(net::serialize_vector3(measure, position, -256.0f, 256.0f, 1.0f / 32.0f));
+        REQUIRE_EQ(measure.bits_measured, 3 * 15);
+        writer.flush_scratch();
+
+        auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+        ducklib::Vector3 read_position = {};
+        REQUIRE(net::serialize_vector3(reader, read_position, -256.0f, 256.0f, 1.0f / 32.0f));
+        REQUIRE_EQ(read_position.x, position.x);
+        REQUIRE_EQ(read_position.y, position.y);
+        REQUIRE_EQ(read_position.z, position.z);
+    }
+
+    TEST_CASE("SmallestThreeQuaternion_RoundTrip") {
+        ducklib::Quaternion rotations[] = {
+            { 0.0f, 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, 0.0f, -1.0f },
+            { 0.5f, -0.5f, 0.5f, -0.5f },
+            { 0.18257419f, 0.36514837f, -0.54772256f, 0.73029674f },
+            { -0.70710677f, 0.0f, 0.70710677f, 0.0f },
+        };
+
+        for (auto rotation : rotations) {
+            std::byte buffer[8] = {};
+            auto writer = net::NetWriteStream(buffer);
+            REQUIRE(net::serialize_quaternion(writer, rotation, 10));
+            REQUIRE_EQ(sizeof(buffer) * 8 - writer.bits_left(), 32);
+            writer.flush_scratch();
+
+            auto reader = net::NetReadStream(buffer, 32);
+            ducklib::Quaternion read_rotation = {};
+            REQUIRE(net::serialize_quaternion(reader, read_rotation, 10));
+
+            // q and -q are the same rotation
+            auto d = rotation.x * read_rotation.x + rotation.y * read_rotation.y + rotation.z * read_rotation.z
+                + rotation.w * read_rotation.w;
+            REQUIRE(std::abs(d) > 0.9999f);
+        }
+    }
+
+    TEST_CASE("RelativeSerialization_UnchangedFieldsCostOneBit") {
+        EntityState baseline = { 100, 30, { 10.0f, 0.0f, -4.5f } };
+        EntityState state = baseline;
+        state.ammo = 29;
+        state.position.y = 1.25f;
+
+        std::byte buffer[32] = {};
+        auto writer = net::NetWriteStream(buffer);
+        auto measure = net::NetMeasureStream();
+        REQUIRE(serialize_delta(writer, state, baseline));
+        REQUIRE(serialize_delta(measure, state, baseline));
+        // Unchanged fields cost their changed bit, ammo moved 1 step (one varint group) and y 10 steps (two)
+        REQUIRE_EQ(measure.bits_measured, 1 + (1 + 5) + 1 + (1 + 10) + 1);
+        writer.flush_scratch();
+
+        auto reader = net::NetReadStream(buffer, measure.bits_measured);
+        EntityState read_state = {};
+        REQUIRE(serialize_delta(reader, read_state, baseline));
+        REQUIRE_EQ(read_state.health, state.health);
+        REQUIRE_EQ(read_state.ammo, state.ammo);
+        REQUIRE_EQ(read_state.position.x, state.position.x);
+        REQUIRE_EQ(read_state.position.y, state.position.y);
+        REQUIRE_EQ(read_state.position.z, state.position.z);
+    }
+
+    TEST_CASE("RelativeSerialization_LargeChange_RoundTrip") {
+        EntityState baseline = { 0, 255, { -256.0f, 256.0f, 0.0f } };
+        EntityState state = { 100, 0, { 256.0f, -256.0f, 0.125f } };
+
+        std::byte buffer[32] = {};
+        auto writer = net::NetWriteStream(buffer);
+        REQUIRE(serialize_delta(writer, state, baseline));
+        writer.flush_scratch();
+
+        auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+        EntityState read_state = {};
+        REQUIRE(serialize_delta(reader, read_state, baseline));
+        REQUIRE_EQ(read_state.health, state.health);
+        REQUIRE_EQ(read_state.ammo, state.ammo);
+        REQUIRE_EQ(read_state.position.x, state.position.x);
+        REQUIRE_EQ(read_state.position.y, state.position.y);
+        REQUIRE_EQ(read_state.position.z, state.position.z);
+    }
+
+    TEST_CASE("RelativeSerialization_DifferenceOutOfBounds_Fails") {
+        uint32_t value = 90;
+
+        std::byte buffer[8] = {};
+        auto writer = net::NetWriteStream(buffer);
+        REQUIRE(net::serialize_int_relative(writer, value, 10U, 0U, 100U));
+        writer.flush_scratch();
+
+        // Read against a baseline the writer did not use, 80 on top of 50 leaves the range
+        auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+        uint32_t read_value = 0;
+        REQUIRE_FALSE(net::serialize_int_relative(reader, read_value, 50U, 0U, 100U));
+    }
+
+    TEST_CASE("Varint_RoundTrip") {
+        int32_t signed_values[] = { 0, 1, -1, 63, -64, 64, 1000, -1000, INT32_MAX, INT32_MIN };
+        uint64_t unsigned_values[] = { 0, 1, 15, 16, 127, 128, 300, UINT32_MAX, UINT64_MAX };
+
+        for (uint8_t group_bits : { 4, 7 }) {
+            CAPTURE(group_bits);
+            std::byte buffer[256] = {};
+            auto writer = net::NetWriteStream(buffer);
+
+            for (auto value : signed_values) {
+                REQUIRE(net::serialize_varint(writer, value, group_bits));
+            }
+            for (auto value : unsigned_values) {
+                REQUIRE(net::serialize_varint(writer, value, group_bits));
+            }
+            writer.flush_scratch();
+
+            auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+            for (auto value : signed_values) {
+                int32_t read_value = 0;
+                REQUIRE(net::serialize_varint(reader, read_value, group_bits));
+                REQUIRE_EQ(read_value, value);
+            }
+            for (auto value : unsigned_values) {
+                uint64_t read_value = 0;
+                REQUIRE(net::serialize_varint(reader, read_value, group_bits));
+                REQUIRE_EQ(read_value, value);
+            }
+        }
+    }
+
+    TEST_CASE("Varint_SmallValuesUseFewBits") {
+        auto measure = net::NetMeasureStream();
+        uint32_t counter = 5;
+        int16_t delta = -3;
+
+        REQUIRE(net::serialize_varint(measure, counter, 4));
+        REQUIRE_EQ(measure.bits_measured, 5);
+        REQUIRE(net::serialize_varint(measure, delta, 4));
+        REQUIRE_EQ(measure.bits_measured, 10);
+        counter = 300;
+        REQUIRE(net::serialize_varint(measure, counter));
+        REQUIRE_EQ(measure.bits_measured, 26);
+    }
+
+    TEST_CASE("IntArray_MatchesPerElementBitstream") {
+        constexpr auto buffer_size = 2048;
+        std::mt19937 rng(7);
+
+        for (auto max : { 1U, 5U, 63U, 255U, 1000U, 65535U, 65536U, 1U << 20, 0xffffffffU }) {
+            for (auto offset : { 0U, 3U }) {
+                for (auto count : { 1U, 3U, 4U, 63U, 64U, 65U, 301U }) {
+                    CAPTURE(max);
+                    CAPTURE(offset);
+                    CAPTURE(count);
+                    std::vector<uint32_t> values(count);
+                    for (auto& value : values) {
+                        value = static_cast<uint32_t>(rng() % (static_cast<uint64_t>(max) + 1));
+                    }
+
+                    std::vector<std::byte> element_buffer(buffer_size);
+                    auto element_writer = net::NetWriteStream(element_buffer);
+                    std::vector<std::byte> array_buffer(buffer_size);
+                    auto array_writer = net::NetWriteStream(array_buffer);
+                    auto prefix = 5U;
+
+                    if (offset > 0) {
+                        REQUIRE(element_writer.serialize_value(prefix, static_cast<uint8_t>(offset)));
+                        REQUIRE(array_writer.serialize_value(prefix, static_cast<uint8_t>(offset)));
+                    }
+                    for (auto value : values) {
+                        REQUIRE(net::serialize_int(element_writer, value, 0U, max));
+                    }
+                    REQUIRE(net::serialize_int_array(array_writer, std::span(values), 0U, max));
+                    REQUIRE_EQ(array_writer.bits_left(), element_writer.bits_left());
+                    element_writer.flush_scratch();
+                    array_writer.flush_scratch();
+                    REQUIRE(element_buffer == array_buffer);
+
+                    auto reader = net::NetReadStream(array_buffer.data(), buffer_size * 8);
+                    if (offset > 0) {
+                        REQUIRE(reader.serialize_value(prefix, static_cast<uint8_t>(offset)));
+                    }
+                    std::vector<uint32_t> read_values(count);
+                    REQUIRE(net::serialize_int_array(reader, std::span(read_values), 0U, max));
+                    REQUIRE(read_values == values);
+                }
+            }
+        }
+    }
+
+    TEST_CASE("IntArray_SignedAndWideTypes") {
+        std::byte buffer[512] = {};
+        auto writer = net::NetWriteStream(buffer);
+        std::vector<int16_t> small = { -100, 0, 37, 100, -1, 99 };
+        std::vector<int64_t> wide = { -(int64_t{ 1 } << 40), -1, 0, int64_t{ 1 } << 40 };
+
+        REQUIRE(net::serialize_int_array(writer, std::span(small), int16_t{ -100 }, int16_t{ 100 }));
+        REQUIRE(net::serialize_int_array(writer, std::span(wide), wide.front(), wide.back()));
+        writer.flush_scratch();
+
+        auto reader = net::NetReadStream(buffer, sizeof(buffer) * 8);
+        std::vector<int16_t> read_small(small.size());
+        std::vector<int64_t> read_wide(wide.size());
+        REQUIRE(net::serialize_int_array(reader, std::span(read_small), int16_t{ -100 }, int16_t{ 100 }));
+        REQUIRE(net::serialize_int_array(reader, std::span(read_wide), wide.front(), wide.back()));
+        REQUIRE(read_small == small);
+        REQUIRE(read_wide == wide);
+    }
+
+    TEST_CASE("IntArray_FailsWithoutWritingWhenTooLarge") {
+        std::byte buffer[8] = {};
+        auto writer = net::NetWriteStream(buffer);
+        std::vector<uint8_t> values(11, 42);
+
+        REQUIRE_FALSE(net::serialize_int_array(writer, std::span(values), uint8_t{ 0 }, uint8_t{ 63 }));
+        REQUIRE_EQ(writer.bits_left(), 64);
+        values.resize(10);
+        REQUIRE(net::serialize_int_array(writer, std::span(values), uint8_t{ 0 }, uint8_t{ 63 }));
+        REQUIRE_EQ(writer.bits_left(), 4);
+    }
+}
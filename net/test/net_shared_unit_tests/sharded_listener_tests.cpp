@@ -0,0 +1,144 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/packet.h"
+#include "ducklib/net/sharded_listener.h"
+
+using namespace ducklib;
+
+namespace {
+/// Zeroed payload behind a CRC for protocol_id, enough to be accepted
+std::array<std::byte, 16> make_packet(uint32_t protocol_id = net::DEFAULT_PROTOCOL_ID) {
+    std::array<std::byte, 16> packet = {};
+    net::write_packet_crc(packet, protocol_id);
+    return packet;
+}
+}
+
+TEST_SUITE("sharded_listener") {
+    TEST_CASE("Start_ManySenders_EachPinnedToOneShard") {
+        constexpr auto SHARD_COUNT = 4U;
+        constexpr auto SENDER_COUNT = 16U;
+        constexpr auto PACKETS_PER_SENDER = 5U;
+        net::ShardedListener listener(0, { .shard_count = SHARD_COUNT, .max_wait = std::chrono::milliseconds(1) });
+        std::mutex accepted_mutex;
+        std::map<uint16_t, std::vector<uint32_t>> accepted_shards;
+
+        REQUIRE_NE(listener.get_port(), 0);
+#if defined(DL_NET_SOCKET_REUSEPORT)
+        REQUIRE_EQ(listener.shard_count(), SHARD_COUNT);
+#else
+        REQUIRE_EQ(listener.shard_count(), 1);
+#endif
+
+        REQUIRE(listener.start([&](uint32_t shard, const net::Address& from, std::span<const std::byte>) {
+            std::lock_guard lock(accepted_mutex);
+            accepted_shards[from.get_port()].push_back(shard);
+            return true;
+        }));
+        REQUIRE_FALSE(listener.start([](uint32_t, const net::Address&, std::span<const std::byte>) { return true; }));
+
+        std::vector<std::unique_ptr<net::Socket>> senders;
+        auto payload = make_packet();
+        auto to = net::Address("127.0.0.1", listener.get_port());
+
+        for (auto i = 0U; i < SENDER_COUNT; ++i) {
+            senders.push_back(std::make_unique<net::Socket>(0));
+
+            for (auto j = 0U; j < PACKETS_PER_SENDER; ++j) {
+                REQUIRE_EQ(senders.back()->send(to, payload), payload.size());
+            }
+        }
+
+        auto total_received = [&] {
+            auto total = uint64_t{ 0 };
+            for (auto shard = 0U; shard < listener.shard_count(); ++shard) {
+                total += listener.received_count(shard);
+            }
+            return total;
+        };
+        auto total_connections = [&] {
+            auto total = size_t{ 0 };
+            for (auto shard = 0U; shard < listener.shard_count(); ++shard) {
+                total += listener.connection_count(shard);
+            }
+            return total;
+        };
+
+        for (auto i = 0; i < 500 && (total_received() < SENDER_COUNT * PACKETS_PER_SENDER || total_connections() < SENDER_COUNT); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        listener.stop();
+        REQUIRE_EQ(total_received(), SENDER_COUNT * PACKETS_PER_SENDER);
+        REQUIRE_EQ(total_connections(), SENDER_COUNT);
+        REQUIRE_EQ(accepted_shards.size(), SENDER_COUNT);
+
+        // Later packets went to the connection made on the first one, never to another shard
+        for (auto& sender : senders) {
+            auto& shards = accepted_shards[sender->get_port()];
+            REQUIRE_EQ(shards.size(), 1);
+
+            if (listener.is_steered()) {
+                REQUIRE_EQ(shards[0], net::ShardedListener::steered_shard(net::Address("127.0.0.1", sender->get_port()), SHARD_COUNT));
+            }
+        }
+    }
+
+    TEST_CASE("Disconnect_FromTick_RemovesConnection") {
+        net::ShardedListener listener(0, { .shard_count = 1, .max_wait = std::chrono::milliseconds(1) });
+        net::Socket sender(0);
+        auto payload = make_packet();
+        std::atomic<bool> disconnected = false;
+
+        REQUIRE(listener.start(
+            [](uint32_t, const net::Address&, std::span<const std::byte>) { return true; },
+            [&](uint32_t shard, net::ShardedListener::ShardConnections& connections) {
+                for (auto& [address, connection] : connections) {
+                    listener.disconnect(shard, address);
+                    disconnected = true;
+                }
+            }));
+
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", listener.get_port()), payload), payload.size());
+
+        for (auto i = 0; i < 500 && !disconnected; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        // One more tick applies the disconnect and publishes the count
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        listener.stop();
+        REQUIRE(disconnected);
+        REQUIRE_EQ(listener.connection_count(0), 0);
+    }
+
+    TEST_CASE("Start_WrongProtocol_NotAccepted") {
+        net::ShardedListener listener(0, { .shard_count = 1, .max_wait = std::chrono::milliseconds(1) });
+        net::Socket sender(0);
+        auto payload = make_packet(net::DEFAULT_PROTOCOL_ID + 1);
+        std::atomic<int> accept_count = 0;
+
+        REQUIRE(listener.start([&](uint32_t, const net::Address&, std::span<const std::byte>) {
+            ++accept_count;
+            return true;
+        }));
+        REQUIRE_EQ(sender.send(net::Address("127.0.0.1", listener.get_port()), payload), payload.size());
+
+        for (auto i = 0; i < 500 && listener.received_count(0) == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        // One more tick publishes the count
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        listener.stop();
+        REQUIRE_EQ(listener.received_count(0), 1);
+        REQUIRE_EQ(accept_count, 0);
+        REQUIRE_EQ(listener.connection_count(0), 0);
+    }
+}
@@ -0,0 +1,226 @@
+#include <array>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/net.h"
+#include "ducklib/net/socket.h"
+
+using namespace ducklib;
+
+namespace {
+/// Loopback delivery is not guaranteed to be instant, polls a little before giving up
+size_t receive_batch_polling(const net::Socket& socket, std::span<net::IncomingPacket> packets) {
+    auto received = size_t{ 0 };
+
+    for (auto polls = 0; polls < 100000 && received < packets.size(); ++polls) {
+        received += socket.receive_batch(packets.subspan(received));
+    }
+
+    return received;
+}
+}
+
+TEST_SUITE("socket") {
+    TEST_CASE("SendBatch_ReceiveBatch_RoundTrip") {
+        net::net_initialize();
+
+        {
+            net::Socket sender(0);
+            net::Socket receiver(0);
+            auto to = net::Address("127.0.0.1", receiver.get_port());
+            std::array<std::array<std::byte, 16>, 3> payloads = {};
+            std::array<std::array<std::byte, 64>, 4> buffers = {};
+            std::array<net::OutgoingPacket, 3> outgoing;
+            std::array<net::IncomingPacket, 4> incoming;
+
+            for (auto i = 0U; i < payloads.size(); ++i) {
+                payloads[i].fill(static_cast<std::byte>(i + 1));
+                outgoing[i] = { to, std::span(payloads[i]).first(8 + i) };
+            }
+
+            for (auto i = 0U; i < buffers.size(); ++i) {
+                incoming[i].buffer = buffers[i];
+            }
+
+            REQUIRE_EQ(sender.send_batch(outgoing), 3);
+            REQUIRE_EQ(receive_batch_polling(receiver, std::span(incoming).first(3)), 3);
+            REQUIRE_EQ(receiver.receive_batch(incoming), 0);
+
+            for (auto i = 0U; i < outgoing.size(); ++i) {
+                REQUIRE_EQ(incoming[i].size, outgoing[i].data.size());
+                REQUIRE_EQ(incoming[i].from.get_port(), sender.get_port());
+                REQUIRE(std::ranges::equal(std::span(buffers[i]).first(incoming[i].size), outgoing[i].data));
+            }
+        }
+
+        net::net_shutdown();
+    }
+
+#if defined(DL_NET_SOCKET_MMSG)
+    TEST_CASE("ReceiveBatch_Truncated_Dropped") {
+        net::net_initialize();
+
+        {
+            net::Socket sender(0);
+            net::Socket receiver(0);
+            auto to = net::Address("127.0.0.1", receiver.get_port());
+            std::array<std::byte, 128> large = {};
+            std::array<std::byte, 8> small = {};
+            small.fill(std::byte{ 7 });
+            std::array<std::array<std::byte, 64>, 2> buffers = {};
+            std::array<net::IncomingPacket, 2> incoming;
+
+            for (auto i = 0U; i < buffers.size(); ++i) {
+                incoming[i].buffer = buffers[i];
+            }
+
+            // Both are waiting before the batch is received, so they arrive in the same recvmmsg
+            REQUIRE_EQ(sender.send(to, large), large.size());
+            REQUIRE_EQ(sender.send(to, small), small.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            REQUIRE_EQ(receiver.receive_batch(incoming), 1);
+            REQUIRE_EQ(incoming[0].size, small.size());
+            REQUIRE(std::ranges::equal(incoming[0].buffer.first(small.size()), small));
+            REQUIRE_EQ(receiver.receive_batch(incoming), 0);
+        }
+
+        net::net_shutdown();
+    }
+#endif
+
+    TEST_CASE("Receive_Truncated_Dropped") {
+        net::net_initialize();
+
+        {
+            net::Socket sender(0);
+            net::Socket receiver(0);
+            auto to = net::Address("127.0.0.1", receiver.get_port());
+            std::array<std::byte, 128> large = {};
+            std::array<std::byte, 8> small = {};
+            small.fill(std::byte{ 7 });
+            std::array<std::byte, 64> buffer = {};
+            net::Address from;
+            net::ReceiveTime received_at;
+
+            for (auto timestamped : { false, true }) {
+                CAPTURE(timestamped);
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+                // Stamped datagrams are read through recvmsg with a control buffer, a separate path to check
+                if (timestamped) {
+                    REQUIRE(receiver.enable_timestamps());
+                }
+#endif
+
+                REQUIRE_EQ(sender.send(to, large), large.size());
+                REQUIRE_EQ(sender.send(to, small), small.size());
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+                // The cut off datagram reads as nothing received rather than as a short one
+                REQUIRE_EQ(receiver.receive(from, buffer, received_at), 0);
+                REQUIRE_EQ(receiver.receive(from, buffer, received_at), small.size());
+                REQUIRE(std::ranges::equal(std::span(buffer).first(small.size()), small));
+            }
+        }
+
+        net::net_shutdown();
+    }
+
+    TEST_CASE("SendSegmented_ReceiveSegmented_RoundTrip") {
+        net::net_initialize();
+
+        for (auto offload : { false, true }) {
+            CAPTURE(offload);
+            net::Socket sender(0);
+            net::Socket receiver(0);
+            auto to = net::Address("127.0.0.1", receiver.get_port());
+            std::vector<std::byte> data(5 * 100 + 37);
+            std::vector<std::byte> received;
+            std::vector<std::byte> buffer(net::MAX_SEGMENTED_SIZE);
+
+            for (auto i = 0U; i < data.size(); ++i) {
+                data[i] = static_cast<std::byte>(i * 7);
+            }
+
+            // Without kernel support both stay off and the same calls fall back to one datagram per segment
+            if (offload) {
+                sender.enable_gso();
+                receiver.enable_gro();
+            }
+
+            REQUIRE_EQ(sender.send_segmented(to, data, 100), data.size());
+
+            for (auto polls = 0; polls < 100000 && received.size() < data.size(); ++polls) {
+                net::Address from;
+                uint16_t segment_size = 0;
+                auto received_bytes = receiver.receive_segmented(from, buffer, segment_size);
+
+                if (received_bytes > 0) {
+                    REQUIRE_EQ(from.get_port(), sender.get_port());
+                    REQUIRE((segment_size == 100 || received_bytes == 37));
+                    received.insert(received.end(), buffer.begin(), buffer.begin() + received_bytes);
+                }
+            }
+
+            REQUIRE(std::ranges::equal(received, data));
+        }
+
+        net::net_shutdown();
+    }
+
+    TEST_CASE("EnableTimestamps_ReceivedAt_IsArrivalTime") {
+        net::net_initialize();
+
+        {
+            using namespace std::chrono_literals;
+            net::Socket sender(0);
+            net::Socket receiver(0);
+            auto to = net::Address("127.0.0.1", receiver.get_port());
+            std::array<std::byte, 16> payload = {};
+            std::array<std::byte, 64> buffer = {};
+            std::array<net::IncomingPacket, 1> incoming;
+            incoming[0].buffer = buffer;
+
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+            REQUIRE(receiver.enable_timestamps());
+            // The kernel turns on stamping on arrival from a work queue, until then datagrams are stamped when read
+            std::this_thread::sleep_for(20ms);
+#else
+            REQUIRE_FALSE(receiver.enable_timestamps());
+#endif
+
+            for (auto use_batch : { true, false }) {
+                auto sent_at = std::chrono::steady_clock::now();
+                REQUIRE_EQ(sender.send(to, payload), payload.size());
+
+                // The datagram waits in the socket buffer before it is read
+                std::this_thread::sleep_for(30ms);
+                auto read_at = std::chrono::steady_clock::now();
+                auto received_at = net::ReceiveTime{};
+
+                if (use_batch) {
+                    REQUIRE_EQ(receive_batch_polling(receiver, incoming), 1);
+                    received_at = incoming[0].received_at;
+                } else {
+                    net::Address from;
+                    auto received_bytes = size_t{ 0 };
+                    for (auto polls = 0; polls < 100000 && received_bytes == 0; ++polls) {
+                        received_bytes = receiver.receive(from, buffer, received_at);
+                    }
+                    REQUIRE_EQ(received_bytes, payload.size());
+                }
+
+#if defined(DL_NET_SOCKET_TIMESTAMPS)
+                // Some slack for moving the stamp from the realtime clock onto steady_clock
+                REQUIRE_GT(received_at, sent_at - 1ms);
+                REQUIRE_LT(received_at, read_at - 20ms);
+#else
+                REQUIRE_GE(received_at, read_at);
+#endif
+            }
+        }
+
+        net::net_shutdown();
+    }
+}
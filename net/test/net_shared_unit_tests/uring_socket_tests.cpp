@@ -0,0 +1,127 @@
+#include <array>
+#include <memory>
+#include <vector>
+#include "third_party/doctest.h"
+#include "ducklib/net/connection.h"
+#include "ducklib/net/net_reactor.h"
+#include "ducklib/net/uring_socket.h"
+
+using namespace ducklib;
+using namespace std::chrono_literals;
+
+TEST_SUITE("uring_socket") {
+    TEST_CASE("UringSocket_ReceivesThroughCallback") {
+        // Small buffer ring so the multishot receive runs out of buffers and has to be armed again
+        net::UringSocket receiver(0, { 16, 4, 2048, 16 });
+        net::Socket sender(0);
+        auto to = net::Address("127.0.0.1", receiver.get_port());
+        std::vector<uint8_t> received;
+
+        CAPTURE(receiver.is_using_uring());
+
+        for (auto i = 0U; i < 10; ++i) {
+            std::array<std::byte, 4> payload = { std::byte{ 0xd0 }, std::byte{ 0x0c }, std::byte{ 0x5 }, static_cast<std::byte>(i) };
+            REQUIRE_EQ(sender.send(to, payload), payload.size());
+        }
+
+        for (auto polls = 0; polls < 1000 && received.size() < 10; ++polls) {
+            receiver.wait(
+                [&](const net::Address& from, std::span<const std::byte> data) {
+                    REQUIRE_EQ(from.get_port(), sender.get_port());
+                    REQUIRE_EQ(data.size(), 4);
+                    received.push_back(static_cast<uint8_t>(data[3]));
+                },
+                10ms);
+        }
+
+        REQUIRE_EQ(received.size(), 10);
+        for (auto i = 0U; i < received.size(); ++i) {
+            REQUIRE_EQ(received[i], i);
+        }
+    }
+
+    TEST_CASE("UringSocket_SendBatch_ReceiveBatch_RoundTrip") {
+        net::UringSocket sender(0);
+        net::UringSocket receiver(0);
+        auto to = net::Address("127.0.0.1", receiver.get_port());
+        std::array<std::array<std::byte, 16>, 3> payloads = {};
+        std::array<std::array<std::byte, 64>, 3> buffers = {};
+        std::array<net::OutgoingPacket, 3> outgoing;
+        std::array<net::IncomingPacket, 3> incoming;
+
+        for (auto i = 0U; i < payloads.size(); ++i) {
+            payloads[i].fill(static_cast<std::byte>(i + 1));
+            outgoing[i] = { to, std::span(payloads[i]).first(8 + i) };
+            incoming[i].buffer = buffers[i];
+        }
+
+        REQUIRE_EQ(sender.send_batch(outgoing), 3);
+        REQUIRE(sender.flush());
+
+        auto received = size_t{ 0 };
+        for (auto polls = 0; polls < 100000 && received < incoming.size(); ++polls) {
+            received += receiver.receive_batch(std::span(incoming).subspan(received));
+        }
+
+        REQUIRE_EQ(received, 3);
+
+        for (auto i = 0U; i < outgoing.size(); ++i) {
+            REQUIRE_EQ(incoming[i].from.get_port(), sender.get_port());
+            REQUIRE(std::ranges::equal(std::span(buffers[i]).first(incoming[i].size), outgoing[i].data));
+        }
+    }
+
+    TEST_CASE("UringSocket_ReceiveBatch_Truncated_Dropped") {
+        net::Socket sender(0);
+        net::UringSocket receiver(0);
+        auto to = net::Address("127.0.0.1", receiver.get_port());
+        std::array<std::byte, 128> large = {};
+        std::array<std::byte, 8> small = {};
+        small.fill(std::byte{ 7 });
+        std::array<std::array<std::byte, 64>, 2> buffers = {};
+        std::array<net::IncomingPacket, 2> incoming;
+
+        for (auto i = 0U; i < buffers.size(); ++i) {
+            incoming[i].buffer = buffers[i];
+        }
+
+        REQUIRE_EQ(sender.send(to, large), large.size());
+        REQUIRE_EQ(sender.send(to, small), small.size());
+
+        auto received = size_t{ 0 };
+        for (auto polls = 0; polls < 100000 && received < 1; ++polls) {
+            received += receiver.receive_batch(incoming);
+        }
+
+        // The large datagram does not take up an entry, the small one lands in the first
+        REQUIRE_EQ(received, 1);
+        REQUIRE_EQ(incoming[0].size, small.size());
+        REQUIRE(std::ranges::equal(incoming[0].buffer.first(small.size()), small));
+    }
+
+    TEST_CASE("UringSocket_AsConnectionTransport_DeliversMessages") {
+        auto client_socket = std::make_shared<net::UringSocket>(0);
+        auto server_socket = std::make_shared<net::UringSocket>(0);
+        net::Connection client("127.0.0.1", server_socket->get_port(), client_socket);
+        net::Connection server("127.0.0.1", client_socket->get_port(), server_socket);
+        net::NetReactor reactor;
+        std::vector<std::byte> received;
+        std::array<std::byte, 4> message = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 } };
+
+        CAPTURE(server_socket->is_using_uring());
+        REQUIRE(reactor.add_connection(server));
+        server.set_message_callback([&](const net::ReceivedMessage& received_message) {
+            received.assign(received_message.data.begin(), received_message.data.end());
+        });
+
+        client.send_reliable(message.data(), static_cast<uint16_t>(message.size() * 8), 0);
+        client.send_message_packet();
+
+        for (auto i = 0; i < 20 && received.empty(); ++i) {
+            reactor.run_once(std::chrono::milliseconds(50));
+        }
+
+        REQUIRE(std::ranges::equal(received, message));
+        REQUIRE_EQ(server.get_stats().packets_received, 1);
+    }
+}
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ducklib/net/connection.h"
+#include "ducklib/net/loopback_transport.h"
+#include "ducklib/net/net.h"
+#include "ducklib/net/sharded_listener.h"
+#include "ducklib/net/socket.h"
+#if defined(__linux__)
+#include "ducklib/net/uring_socket.h"
+#endif
+
+using namespace ducklib;
+
+namespace {
+constexpr auto PACKET_COUNT = 200000U;
+constexpr auto BATCH_SIZE = 32U; // Packets in flight at once, small enough to never overflow the receive buffer
+constexpr auto MAX_IDLE_POLLS = 100000U; // Gives up on packets the OS dropped after this many empty receives
+constexpr auto MESSAGES_PER_PACKET = 16U;
+constexpr auto MESSAGE_SIZE = 32U;
+
+/// Keeps received data from being optimized away
+volatile uint32_t result_sink;
+
+/// Sends BATCH_SIZE packets at a time from sender to receiver over loopback and drains them before sending more,
+/// reports received packets per second
+template <typename Send, typename Receive>
+double measure_packets_per_s(Send&& send, Receive&& receive) {
+    auto received_total = 0U;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto sent_total = 0U; sent_total < PACKET_COUNT;) {
+        auto sent = send();
+        auto received = 0U;
+
+        for (auto idle_polls = 0U; received < sent && idle_polls < MAX_IDLE_POLLS;) {
+            auto count = receive(sent - received);
+            received += count;
+            idle_polls = count == 0 ? idle_polls + 1 : 0;
+        }
+
+        sent_total += sent;
+        received_total += received;
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return received_total / seconds;
+}
+
+void run_case(const net::Transport& sender, const net::Transport& receiver, net::Address to, uint32_t size) {
+    std::vector<std::byte> payload(size, std::byte{ 0x5a });
+    std::vector<std::byte> buffers(BATCH_SIZE * net::MTU);
+    std::array<net::OutgoingPacket, BATCH_SIZE> outgoing;
+    std::array<net::IncomingPacket, BATCH_SIZE> incoming;
+
+    for (auto i = 0U; i < BATCH_SIZE; ++i) {
+        outgoing[i] = { to, payload };
+        incoming[i].buffer = std::span(buffers).subspan(i * net::MTU, net::MTU);
+    }
+
+    auto single = measure_packets_per_s(
+        [&] {
+            auto sent = 0U;
+            for (auto i = 0U; i < BATCH_SIZE; ++i) {
+                sent += sender.send(to, payload) == size ? 1 : 0;
+            }
+            return sent;
+        },
+        [&](uint32_t) {
+            net::Address from;
+            auto received_bytes = receiver.receive(from, incoming[0].buffer);
+            return received_bytes > 0 && received_bytes <= net::MTU ? 1U : 0U;
+        });
+
+    auto batched = measure_packets_per_s(
+        [&] { return static_cast<uint32_t>(sender.send_batch(outgoing)); },
+        [&](uint32_t expected) {
+            return static_cast<uint32_t>(receiver.receive_batch(std::span(incoming).first(expected)));
+        });
+
+    std::printf("%6u | %10.0f %10.0f | %6.2fx\n", size, single, batched, batched / single);
+}
+
+/// One Connection sending MESSAGES_PER_PACKET reliable messages a packet to another, reports messages per second
+double measure_connection_messages_per_s(
+    const std::shared_ptr<net::Transport>& sender,
+    const std::shared_ptr<net::Transport>& receiver,
+    net::Address sender_address,
+    net::Address receiver_address) {
+    net::Connection client(receiver_address, sender);
+    net::Connection server(sender_address, receiver);
+    std::array<std::byte, MESSAGE_SIZE> message = {};
+    std::array<std::byte, net::MTU> buffer;
+
+    auto packets_per_s = measure_packets_per_s(
+        [&] {
+            for (auto i = 0U; i < MESSAGES_PER_PACKET; ++i) {
+                client.send_reliable(message.data(), MESSAGE_SIZE * 8, 0);
+            }
+            client.send_message_packet();
+            return 1U;
+        },
+        [&](uint32_t) {
+            net::Address from;
+            auto received_bytes = receiver->receive(from, buffer);
+            auto valid = received_bytes > 0 && received_bytes <= net::MTU;
+            return valid && server.receive_packet(std::span(buffer).first(received_bytes)) ? 1U : 0U;
+        });
+
+    return packets_per_s * MESSAGES_PER_PACKET;
+}
+
+/// Bursts of MTU sized segments to one peer, send_batch/receive_batch against GSO sends and GRO receives
+void run_segmented_case() {
+    net::Socket sender(0);
+    net::Socket receiver(0);
+    net::Socket offload_receiver(0);
+    auto to_batched = net::Address("127.0.0.1", receiver.get_port());
+    auto to_offload = net::Address("127.0.0.1", offload_receiver.get_port());
+    auto gso = sender.enable_gso();
+    auto gro = offload_receiver.enable_gro();
+    std::vector<std::byte> burst(BATCH_SIZE * net::MTU, std::byte{ 0x5a });
+    std::vector<std::byte> buffers(BATCH_SIZE * net::MTU);
+    std::vector<std::byte> coalesced(net::MAX_SEGMENTED_SIZE);
+    std::array<net::OutgoingPacket, BATCH_SIZE> outgoing;
+    std::array<net::IncomingPacket, BATCH_SIZE> incoming;
+
+    for (auto i = 0U; i < BATCH_SIZE; ++i) {
+        outgoing[i] = { to_batched, std::span(burst).subspan(i * net::MTU, net::MTU) };
+        incoming[i].buffer = std::span(buffers).subspan(i * net::MTU, net::MTU);
+    }
+
+    auto batched = measure_packets_per_s(
+        [&] { return static_cast<uint32_t>(sender.send_batch(outgoing)); },
+        [&](uint32_t expected) {
+            return static_cast<uint32_t>(receiver.receive_batch(std::span(incoming).first(expected)));
+        });
+
+    auto offloaded = measure_packets_per_s(
+        [&] { return static_cast<uint32_t>(sender.send_segmented(to_offload, burst, net::MTU) / net::MTU); },
+        [&](uint32_t) {
+            net::Address from;
+            uint16_t segment_size = 0;
+            auto received_bytes = offload_receiver.receive_segmented(from, coalesced, segment_size);
+            return received_bytes > 0 ? static_cast<uint32_t>((received_bytes + segment_size - 1) / segment_size) : 0U;
+        });
+
+    std::printf(
+        "%6u | %10.0f %10.0f | %6.2fx (GSO %s, GRO %s)\n",
+        static_cast<uint32_t>(net::MTU),
+        batched,
+        offloaded,
+        offloaded / batched,
+        gso ? "on" : "off",
+        gro ? "on" : "off");
+}
+
+/// Several threads send from their own socket to a ShardedListener, reports the rate its shards received at
+double measure_sharded_packets_per_s(uint32_t shard_count, uint32_t sender_count) {
+    net::ShardedListener listener(0, { .shard_count = shard_count });
+    auto to = net::Address("127.0.0.1", listener.get_port());
+    auto total_received = [&] {
+        auto total = uint64_t{ 0 };
+        for (auto shard = 0U; shard < listener.shard_count(); ++shard) {
+            total += listener.received_count(shard);
+        }
+        return total;
+    };
+
+    listener.start([](uint32_t, const net::Address&, std::span<const std::byte>) { return false; });
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> senders;
+
+    for (auto i = 0U; i < sender_count; ++i) {
+        senders.emplace_back([&] {
+            net::Socket sender(0);
+            std::vector<std::byte> payload(256, std::byte{ 0x5a });
+            std::array<net::OutgoingPacket, BATCH_SIZE> outgoing;
+            outgoing.fill({ to, payload });
+
+            for (auto sent = 0U; sent < PACKET_COUNT / sender_count;) {
+                sent += static_cast<uint32_t>(sender.send_batch(outgoing));
+            }
+        });
+    }
+
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    // Whatever is still in the socket buffers counts once the shards get to it
+    for (auto received = total_received(), previous = uint64_t{ 0 }; received != previous; received = total_received()) {
+        previous = received;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total_received() / seconds;
+}
+
+#if defined(__linux__)
+/// UringSocket sending and receiving through its completion API, against Socket with send_batch/receive_batch
+void run_uring_case(uint32_t size) {
+    std::vector<std::byte> payload(size, std::byte{ 0x5a });
+    std::vector<std::byte> buffers(BATCH_SIZE * net::MTU);
+    std::array<net::OutgoingPacket, BATCH_SIZE> outgoing;
+    std::array<net::IncomingPacket, BATCH_SIZE> incoming;
+    net::Socket sender(0);
+    net::Socket receiver(0);
+    net::UringSocket uring_sender(0);
+    net::UringSocket uring_receiver(0);
+    auto to = net::Address("127.0.0.1", receiver.get_port());
+    auto uring_to = net::Address("127.0.0.1", uring_receiver.get_port());
+
+    for (auto i = 0U; i < BATCH_SIZE; ++i) {
+        outgoing[i] = { uring_to, payload };
+        incoming[i].buffer = std::span(buffers).subspan(i * net::MTU, net::MTU);
+    }
+
+    auto batched = measure_packets_per_s(
+        [&] {
+            for (auto& packet : outgoing) {
+                packet.to = to;
+            }
+            return static_cast<uint32_t>(sender.send_batch(outgoing));
+        },
+        [&](uint32_t expected) {
+            return static_cast<uint32_t>(receiver.receive_batch(std::span(incoming).first(expected)));
+        });
+
+    for (auto& packet : outgoing) {
+        packet.to = uring_to;
+    }
+
+    auto received_bytes = size_t{ 0 };
+    auto uring = measure_packets_per_s(
+        [&] {
+            auto sent = static_cast<uint32_t>(uring_sender.send_batch(outgoing));
+            uring_sender.flush();
+            return sent;
+        },
+        [&](uint32_t) {
+            // Send completions have to be reaped too or the send slots run out
+            uring_sender.poll([](const net::Address&, std::span<const std::byte>) {});
+            return static_cast<uint32_t>(uring_receiver.poll([&](const net::Address&, std::span<const std::byte> data) {
+                received_bytes += data.size();
+            }));
+        });
+
+    result_sink = static_cast<uint32_t>(received_bytes);
+    std::printf(
+        "%6u | %10.0f %10.0f | %6.2fx (%s)\n",
+        size,
+        batched,
+        uring,
+        uring / batched,
+        uring_receiver.is_using_uring() ? "io_uring" : "fell back to Socket");
+}
+#endif
+}
+
+int main() {
+    net::net_initialize();
+
+    {
+        net::Socket sender(0);
+        net::Socket receiver(0);
+        auto to = net::Address("127.0.0.1", receiver.get_port());
+
+#if defined(DL_NET_SOCKET_MMSG)
+        std::printf("Loopback UDP (packets/s, batches use sendmmsg/recvmmsg, %u per batch)\n", BATCH_SIZE);
+#else
+        std::printf("Loopback UDP (packets/s, batches loop over send/receive on this platform, %u per batch)\n", BATCH_SIZE);
+#endif
+        std::printf("  size | per-packet    batched | speedup\n");
+
+        for (auto size : { 32U, 256U, 1200U }) {
+            run_case(sender, receiver, to, size);
+        }
+    }
+
+    {
+        auto [sender, receiver] = net::LoopbackTransport::make_pair(BATCH_SIZE);
+
+        std::printf("\nIn-memory LoopbackTransport (packets/s, %u per batch)\n", BATCH_SIZE);
+        std::printf("  size | per-packet    batched | speedup\n");
+
+        for (auto size : { 32U, 256U, 1200U }) {
+            run_case(*sender, *receiver, receiver->get_address(), size);
+        }
+    }
+
+    {
+        auto sender = std::make_shared<net::Socket>(0);
+        auto receiver = std::make_shared<net::Socket>(0);
+        auto udp = measure_connection_messages_per_s(
+            sender, receiver, net::Address("127.0.0.1", sender->get_port()), net::Address("127.0.0.1", receiver->get_port()));
+        auto [loopback_sender, loopback_receiver] = net::LoopbackTransport::make_pair(BATCH_SIZE);
+        auto loopback = measure_connection_messages_per_s(
+            loopback_sender, loopback_receiver, loopback_sender->get_address(), loopback_receiver->get_address());
+
+        std::printf("\nConnection to Connection, %u messages of %u bytes per packet (messages/s)\n", MESSAGES_PER_PACKET, MESSAGE_SIZE);
+        std::printf("transport |   messages | speedup\n");
+        std::printf("      UDP | %10.0f | %6.2fx\n", udp, 1.0);
+        std::printf(" loopback | %10.0f | %6.2fx\n", loopback, loopback / udp);
+    }
+
+    std::printf("\nLoopback UDP bursts of %u MTU sized packets to one peer (packets/s)\n", BATCH_SIZE);
+    std::printf("  size |    batched  offloaded | speedup\n");
+    run_segmented_case();
+
+    {
+        auto core_count = std::max(std::thread::hardware_concurrency(), 1U);
+        std::printf("\nLoopback UDP into a ShardedListener from %u sender threads (packets/s, %u cores)\n", core_count, core_count);
+        std::printf("shards |   received | speedup\n");
+        auto single = measure_sharded_packets_per_s(1, core_count);
+        std::printf("%6u | %10.0f | %6.2fx\n", 1U, single, 1.0);
+
+        for (auto shard_count = 2U; shard_count <= core_count; shard_count *= 2) {
+            auto sharded = measure_sharded_packets_per_s(shard_count, core_count);
+            std::printf("%6u | %10.0f | %6.2fx\n", shard_count, sharded, sharded / single);
+        }
+    }
+
+#if defined(__linux__)
+    std::printf("\nLoopback UDP through io_uring (packets/s, %u per batch)\n", BATCH_SIZE);
+    std::printf("  size |    batched   io_uring | speedup\n");
+
+    for (auto size : { 32U, 1200U }) {
+        run_uring_case(size);
+    }
+#endif
+
+    net::net_shutdown();
+
+    return 0;
+}
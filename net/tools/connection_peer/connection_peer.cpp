@@ -3,6 +3,7 @@
 #include <thread>
 
 #include "ducklib/net/connection.h"
+#include "ducklib/net/net_reactor.h"
 
 using namespace ducklib;
 
@@ -23,6 +24,7 @@ void read_input(std::span<char> buffer, uint32_t& caret) {
 int main() {
     auto run = true;
     std::unique_ptr<net::Connection> connection = {};
+    net::NetReactor reactor;
     
     while (run) {
         while (has_input()) {
@@ -54,7 +56,12 @@ int main() {
                             std::cout << address_no_port << std::endl;
                         }
                         
+                        if (connection) {
+                            reactor.remove_transport(*connection->get_transport());
+                        }
+
                         connection = std::make_unique<net::Connection>(address_no_port, port);
+                        reactor.add_connection(*connection);
                     }
                 } else {
                     // TODO: Send over connection
@@ -64,6 +71,7 @@ int main() {
             }
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+        // Returns as soon as a packet arrives, the cap only bounds how long keyboard input waits
+        reactor.run_once(std::chrono::milliseconds(16));
     }
 }
\ No newline at end of file